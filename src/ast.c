@@ -6,12 +6,13 @@
 #include <string.h>
 
 #include "ast.h"
-#include "token.h"
 
 
 #define AST_INITIAL_CAPACITY        1
 #define AST_GROW_FACTOR             2
 #define AST_INDENT                  4
+// Nodes being destructed at once before the stack moves to the heap.
+#define AST_INITIAL_DEPTH           32
 
 
 /** Returned string must be freed! */
@@ -76,10 +77,11 @@ static void *_ast_print_tree(ASTNode *root, int depth) {
     }
 }
 
-/** Construct a generic node and keep a copy of *value*. */
-static ASTNode *_ast_construct(char *value, size_t capacity) {
+/** Construct a generic node and keep a copy of the *len* bytes of *value*. */
+static ASTNode *_ast_construct(
+    const char *value, size_t val_len, size_t capacity
+) {
     ASTNode *node = calloc(1, sizeof (ASTNode));
-    size_t val_len = strlen(value);
 
     if (!node) {
         return NULL;
@@ -97,9 +99,10 @@ static ASTNode *_ast_construct(char *value, size_t capacity) {
     if (!node->value) {
         return NULL;
     }
-    if (!memcpy(node->value, value, val_len + 1)) {
+    if (!memcpy(node->value, value, val_len)) {
         return NULL;
     }
+    node->value[val_len] = 0;
     return node;
 }
 
@@ -131,8 +134,8 @@ static bool _ast_grow(ASTNode *node) {
 
 
 /** Construct a null node and return its pointer or NULL. */
-ASTNode *ast_construct_nullnode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 0);
+ASTNode *ast_construct_nullnode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 0);
 
     if (!node) {
         return NULL;
@@ -142,8 +145,8 @@ ASTNode *ast_construct_nullnode(Token *token) {
 }
 
 /** Construct a true/false node and return its pointer or NULL. */
-ASTNode *ast_construct_boolnode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 0);
+ASTNode *ast_construct_boolnode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 0);
 
     if (!node) {
         return NULL;
@@ -153,8 +156,8 @@ ASTNode *ast_construct_boolnode(Token *token) {
 }
 
 /** Construct a number node and return its pointer or NULL. */
-ASTNode *ast_construct_numbernode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 0);
+ASTNode *ast_construct_numbernode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 0);
 
     if (!node) {
         return NULL;
@@ -164,8 +167,8 @@ ASTNode *ast_construct_numbernode(Token *token) {
 }
 
 /** Construct a string node and return its pointer or NULL. */
-ASTNode *ast_construct_stringnode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 0);
+ASTNode *ast_construct_stringnode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 0);
 
     if (!node) {
         return NULL;
@@ -175,8 +178,8 @@ ASTNode *ast_construct_stringnode(Token *token) {
 }
 
 /** Construct an array node and return its pointer or NULL. */
-ASTNode *ast_construct_arraynode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 4);
+ASTNode *ast_construct_arraynode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 4);
 
     if (!node) {
         return NULL;
@@ -186,8 +189,8 @@ ASTNode *ast_construct_arraynode(Token *token) {
 }
 
 /** Construct a key node and return its pointer or NULL. */
-ASTNode *ast_construct_keynode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 1);
+ASTNode *ast_construct_keynode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 1);
 
     if (!node) {
         return NULL;
@@ -197,8 +200,8 @@ ASTNode *ast_construct_keynode(Token *token) {
 }
 
 /** Construct an object node and return its pointer or NULL. */
-ASTNode *ast_construct_objectnode(Token *token) {
-    ASTNode *node = _ast_construct(token->value, 4);
+ASTNode *ast_construct_objectnode(const char *value, size_t len) {
+    ASTNode *node = _ast_construct(value, len, 4);
 
     if (!node) {
         return NULL;
@@ -207,15 +210,58 @@ ASTNode *ast_construct_objectnode(Token *token) {
     return node;
 }
 
-/** Recursively destruct entrie AST starting from *root*. */
+/** Destruct the entire AST starting from *root*.
+ *
+ * The nodes on the way down are kept on an explicit stack, so that deep
+ * trees do not exhaust the call stack. Children are unlinked from their
+ * parent, last first, as they are destructed.
+ */
 void *ast_destruct(ASTNode *root) {
-    size_t i;
-    if (root) {
-        for (i = 0; i < root->len; i++) {
-            ast_destruct(root->children[i]);
+    ASTNode *initial[AST_INITIAL_DEPTH];
+    ASTNode **stack = initial;
+    ASTNode **new_stack;
+    size_t cap = AST_INITIAL_DEPTH;
+    size_t depth = 0;
+    ASTNode *node;
+    ASTNode *child;
+
+    if (!root) {
+        return NULL;
+    }
+    stack[depth++] = root;
+    while (depth) {
+        node = stack[depth - 1];
+        if (!node->len) {
+            ast_destruct_node(node);
+            depth--;
+            continue;
+        }
+        child = node->children[--node->len];
+        if (!child->len) {
+            ast_destruct_node(child);
+            continue;
         }
-        ast_destruct_node(root);
+
+        if (depth == cap) {
+            new_stack = malloc(cap * AST_GROW_FACTOR * sizeof (ASTNode *));
+            if (!new_stack) {
+                // Out of memory: a nested call takes this subtree on a fresh stack.
+                ast_destruct(child);
+                continue;
+            }
+            memcpy(new_stack, stack, depth * sizeof (ASTNode *));
+            if (stack != initial) {
+                free(stack);
+            }
+            stack = new_stack;
+            cap *= AST_GROW_FACTOR;
+        }
+        stack[depth++] = child;
+    }
+    if (stack != initial) {
+        free(stack);
     }
+    return NULL;
 }
 
 /** Destruct a single AST node as well as textual values. */
@@ -4,8 +4,6 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-#include "token.h"
-
 
 typedef enum ASTKind {
     AST_NULL,
@@ -26,31 +24,33 @@ typedef struct ASTNode {
 } ASTNode;
 
 
+/* Node constructors keep a copy of the *len* bytes of *value*. */
+
 /** Construct a null node and return its pointer or NULL. */
-ASTNode *ast_construct_nullnode(Token *token);
+ASTNode *ast_construct_nullnode(const char *value, size_t len);
 
 /** Construct a true/false node and return its pointer or NULL. */
-ASTNode *ast_construct_boolnode(Token *token);
+ASTNode *ast_construct_boolnode(const char *value, size_t len);
 
 /** Construct a number node and return its pointer or NULL. */
-ASTNode *ast_construct_numbernode(Token *token);
+ASTNode *ast_construct_numbernode(const char *value, size_t len);
 
 /** Construct a string node and return its pointer or NULL. */
-ASTNode *ast_construct_stringnode(Token *token);
+ASTNode *ast_construct_stringnode(const char *value, size_t len);
 
 /** Construct an array node and return its pointer or NULL. */
-ASTNode *ast_construct_arraynode(Token *token);
+ASTNode *ast_construct_arraynode(const char *value, size_t len);
 
 /** Construct a key node and return its pointer or NULL. */
-ASTNode *ast_construct_keynode(Token *token);
+ASTNode *ast_construct_keynode(const char *value, size_t len);
 
 /** Construct an object node and return its pointer or NULL. */
-ASTNode *ast_construct_objectnode(Token *token);
+ASTNode *ast_construct_objectnode(const char *value, size_t len);
 
 /** Append a child node to the parent node and report success as bool. */
 bool ast_append(ASTNode *parent, ASTNode *child);
 
-/** Recursively destruct entrie AST starting from *root*. */
+/** Destruct the entire AST starting from *root*, without recursion. */
 void *ast_destruct(ASTNode *root);
 
 /** Destruct a single AST node as well as textual values. */
@@ -0,0 +1,607 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "jsonarr.h"
+#include "jsonobj.h"
+#include "token.h"
+#include "ast.h"
+#include "lexer.h"
+#include "parser.h"
+
+
+#define NRECORDS        20000
+#define NROUNDS         5
+// Where the file benchmarks find a copy of the text.
+#define BENCH_PATH      "bench.json"
+
+
+/** Generate an array of *n* records that look like typical API payloads. */
+char *gen_records(size_t n) {
+    size_t cap = n * 256 + 16;
+    size_t len = 0;
+    char *text = malloc(cap);
+
+    assert(text);
+    len += sprintf(&text[len], "[\n");
+    for (size_t i = 0; i < n; i++) {
+        len += sprintf(
+            &text[len],
+            "    {\"id\": %llu, \"name\": \"item \\\"%llu\\\"\", "
+            "\"score\": %g, \"active\": %s, \"tags\": [\"alpha\", \"beta\"], "
+            "\"nested\": {\"x\": -1.5e3, \"y\": null}}%s\n",
+            (unsigned long long) i,
+            (unsigned long long) i,
+            i * 0.25,
+            (i % 2) ? "true" : "false",
+            (i + 1 < n) ? "," : ""
+        );
+    }
+    len += sprintf(&text[len], "]\n");
+    return text;
+}
+
+/** Generate an array of log entries dominated by long string values. */
+char *gen_strings(size_t n) {
+    size_t cap = n * 1024 + 16;
+    size_t len = 0;
+    char *text = malloc(cap);
+
+    assert(text);
+    len += sprintf(&text[len], "[");
+    for (size_t i = 0; i < n; i++) {
+        len += sprintf(
+            &text[len],
+            "{\"level\": \"info\", \"message\": \"request %llu served in due "
+            "time by the upstream worker pool after the cache lookup missed "
+            "and the fallback path was taken; nothing to see here, move "
+            "along\", \"html\": \"<div class=\\\"entry\\\"><p>Entry "
+            "%llu</p>\\n<p>Some paragraph text that goes on for a while "
+            "before it is closed</p></div>\"}%s",
+            (unsigned long long) i,
+            (unsigned long long) i,
+            (i + 1 < n) ? ", " : ""
+        );
+    }
+    len += sprintf(&text[len], "]");
+    return text;
+}
+
+/** Generate an array of messages in several scripts, as raw UTF-8 and
+ * as escapes, surrogate pairs included.
+ */
+char *gen_unicode(size_t n) {
+    size_t cap = n * 512 + 16;
+    size_t len = 0;
+    char *text = malloc(cap);
+
+    assert(text);
+    len += sprintf(&text[len], "[");
+    for (size_t i = 0; i < n; i++) {
+        len += sprintf(
+            &text[len],
+            "{\"id\": %llu, \"fr\": \"Caf\xc3\xa9 cr\xc3\xa8me "
+            "br\xc3\xbbl\xc3\xa9" "e, d\xc3\xa9j\xc3\xa0 servi\", \"ru\": "
+            "\"\xd0\x9f\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82, "
+            "\xd0\xbc\xd0\xb8\xd1\x80\", \"ja\": \"\xe6\x97\xa5\xe6\x9c\xac"
+            "\xe8\xaa\x9e\xe3\x81\xae\xe3\x83\x86\xe3\x82\xad\xe3\x82\xb9"
+            "\xe3\x83\x88\", \"emoji\": \"ok \xf0\x9f\x91\x8d\", "
+            "\"escaped\": \"\\u00e9t\\u00e9 \\ud83d\\ude00\"}%s",
+            (unsigned long long) i,
+            (i + 1 < n) ? ", " : ""
+        );
+    }
+    len += sprintf(&text[len], "]");
+    return text;
+}
+
+/** Generate an array of metric samples dominated by full precision floats. */
+char *gen_numbers(size_t n) {
+    size_t cap = n * 128 + 16;
+    size_t len = 0;
+    char *text = malloc(cap);
+
+    assert(text);
+    len += sprintf(&text[len], "[");
+    for (size_t i = 0; i < n; i++) {
+        len += sprintf(
+            &text[len],
+            "[%.17g, %.17g, %llu, %.6e]%s",
+            48.8566 + i * 1e-7 / 3,
+            2.3522 - i * 1e-7 / 7,
+            (unsigned long long) (1700000000000ULL + i * 37),
+            i / 9.0,
+            (i + 1 < n) ? ", " : ""
+        );
+    }
+    len += sprintf(&text[len], "]");
+    return text;
+}
+
+/** Old pipeline up to the AST. The walk that built JsonValue is not counted. */
+void run_ast(char *text) {
+    Lexer *lexer = lexer_construct(text, strlen(text));
+    Parser *parser = parser_construct(lexer);
+    ASTNode *root = parser_parse(parser);
+
+    assert(root);
+    parser_destruct(parser);
+    lexer_destruct(lexer);
+    ast_destruct(root);
+}
+
+/** Decode and free, as a request handler would. */
+void run_decoder(char *text) {
+    bool error;
+    JsonValue jsval = json_sdecode(text, &error);
+
+    assert(!error && jsval.type == JSON_ARRAY);
+    jsonval_destruct(&jsval);
+}
+
+void run_document(char *text) {
+    bool error;
+    JsonDocument *document = json_document_decode(
+        text, strlen(text), NULL, &error
+    );
+
+    assert(!error && document->root.type == JSON_ARRAY);
+    json_document_free(document);
+}
+
+/** The same, with the elements of the root split between threads. */
+void run_document_parallel(char *text) {
+    bool error;
+    JsonDocument *document = json_document_decode_parallel(
+        text, strlen(text), NULL, 0, &error
+    );
+
+    assert(!error && document->root.type == JSON_ARRAY);
+    json_document_free(document);
+}
+
+/** Generate an array of *n* objects of 200 fields, strings and numbers. */
+char *gen_wide(size_t n) {
+    size_t cap = n * 200 * 32 + 16;
+    size_t len = 0;
+    char *text = malloc(cap);
+
+    assert(text);
+    len += sprintf(&text[len], "[\n");
+    for (size_t i = 0; i < n; i++) {
+        text[len++] = '{';
+        for (size_t j = 0; j < 200; j++) {
+            if (j % 2) {
+                len += sprintf(&text[len], "\"field%llu\": %llu.25,", (unsigned long long) j, (unsigned long long) (i + j));
+            } else {
+                len += sprintf(&text[len], "\"field%llu\": \"value %llu\",", (unsigned long long) j, (unsigned long long) j);
+            }
+        }
+        len--;
+        len += sprintf(&text[len], "}%s\n", (i + 1 < n) ? "," : "");
+    }
+    len += sprintf(&text[len], "]\n");
+    return text;
+}
+
+// The fields read out of each object of gen_wide().
+static char *WIDE_FIELDS[] = {
+    "field1", "field41", "field99", "field151", "field199"
+};
+
+/** Read 5 fields of every object of gen_wide() from a full tree. */
+void run_wide_document(char *text) {
+    bool error;
+    double sum = 0;
+    JsonDocument *document = json_document_decode(
+        text, strlen(text), NULL, &error
+    );
+    JsonArray *arr = document->root.value.as_arr;
+
+    assert(!error);
+    for (size_t i = 0; i < arr->len; i++) {
+        for (size_t j = 0; j < 5; j++) {
+            sum += jsonobj_getitem(
+                jsonarr_getitem(arr, i)->value.as_obj, WIDE_FIELDS[j]
+            )->value.as_num;
+        }
+    }
+    assert(sum > 0);
+    json_document_free(document);
+}
+
+/** Read the same fields with a cursor, leaving the rest untouched. */
+void run_wide_cursor(char *text) {
+    JsonCursor *root = json_cursor_construct(text, strlen(text));
+    JsonCursor element;
+    JsonCursor field;
+    double sum = 0;
+    double value;
+
+    while (json_cursor_next_element(root, &element)) {
+        for (size_t j = 0; j < 5; j++) {
+            assert(json_cursor_find_field(&element, WIDE_FIELDS[j], &field));
+            assert(json_cursor_get_double(&field, &value));
+            sum += value;
+        }
+    }
+    assert(sum > 0);
+    json_cursor_destruct(root);
+}
+
+/** Turn an array from gen_records() into one record per line. */
+char *gen_lines(size_t n) {
+    char *text = gen_records(n);
+    char *p;
+    size_t len;
+
+    // Drop the brackets and the commas between records.
+    memmove(text, &text[2], strlen(text) - 1);
+    len = strlen(text);
+    text[len - 2] = 0;
+    for (p = text; (p = strstr(p, "}},\n")); p += 3) {
+        p[2] = ' ';
+    }
+    return text;
+}
+
+/** What callers do without json_decode_lines(): one line at a time. */
+void run_lines_serial(char *text) {
+    char *line = malloc(strlen(text) + 1);
+    char *p = text;
+    char *end;
+    size_t len;
+    bool error;
+    JsonValue jsval;
+
+    for (; *p; p = end + (*end != 0)) {
+        if (!(end = strchr(p, '\n'))) {
+            end = &p[strlen(p)];
+        }
+        len = end - p;
+        memcpy(line, p, len);
+        line[len] = 0;
+        jsval = json_sdecode(line, &error);
+        assert(!error);
+        jsonval_destruct(&jsval);
+    }
+    free(line);
+}
+
+void run_lines_one(char *text) {
+    bool error;
+    JsonLines *lines = json_decode_lines(text, strlen(text), NULL, 1, &error);
+
+    assert(!error && lines->len == NRECORDS);
+    json_lines_free(lines);
+}
+
+void run_lines(char *text) {
+    bool error;
+    JsonLines *lines = json_decode_lines(text, strlen(text), NULL, 0, &error);
+
+    assert(!error && lines->len == NRECORDS);
+    json_lines_free(lines);
+}
+
+bool sum_number(void *ctx, double value) {
+    *(double *) ctx += value;
+    return true;
+}
+
+/** Aggregate without a tree: the sum of all numbers. */
+void run_sax(char *text) {
+    JsonHandler handler = { .on_number = sum_number };
+    double sum = 0;
+    bool error;
+
+    assert(json_sax_parse(text, strlen(text), &handler, &sum, &error));
+}
+
+/** Check the text and nothing else. */
+void run_validate(char *text) {
+    assert(json_validate(text, strlen(text), NULL));
+}
+
+/** Read the copy of *text* from disk first, as a loader would. */
+void run_read_document(char *text) {
+    size_t len = strlen(text);
+    char *buf = malloc(len);
+    FILE *stream = fopen(BENCH_PATH, "rb");
+    bool error;
+    JsonDocument *document;
+
+    assert(buf && stream && fread(buf, 1, len, stream) == len);
+    fclose(stream);
+    document = json_document_decode(buf, len, NULL, &error);
+    assert(!error && document->root.type == JSON_ARRAY);
+    json_document_free(document);
+    free(buf);
+}
+
+void run_mmap(char *text) {
+    bool error;
+    JsonDocument *document = json_mmap_decode(BENCH_PATH, NULL, &error);
+
+    (void) text;
+    assert(!error && document->root.type == JSON_ARRAY);
+    json_document_free(document);
+}
+
+// What the encoding benchmarks write, decoded from their text beforehand.
+static JsonValue encode_input;
+
+void decode_encode_input(char *text) {
+    bool error;
+
+    encode_input = json_sdecode(text, &error);
+    assert(!error);
+}
+
+void run_fencode(char *text) {
+    FILE *stream = fopen("/dev/null", "wb");
+
+    (void) text;
+    assert(stream && json_fencode(stream, &encode_input, 0));
+    fclose(stream);
+}
+
+void run_fdencode(char *text) {
+    int fd = open("/dev/null", O_WRONLY);
+
+    (void) text;
+    assert(fd >= 0 && json_fdencode(fd, &encode_input, 0));
+    close(fd);
+}
+
+void run_sencode(char *text) {
+    size_t len;
+    char *out = json_sencode(&encode_input, 0, &len);
+
+    (void) text;
+    assert(out && len > 0);
+    free(out);
+}
+
+/** Look up all 200 fields of every object of gen_wide(), 10 times, in the
+ * tree of decode_encode_input().
+ */
+void run_wide_lookup(char *text) {
+    JsonArray *arr = encode_input.value.as_arr;
+    JsonObject *obj;
+    char keys[200][16];
+    size_t found = 0;
+
+    (void) text;
+    for (size_t j = 0; j < 200; j++) {
+        sprintf(keys[j], "field%llu", (unsigned long long) j);
+    }
+    for (size_t round = 0; round < 10; round++) {
+        for (size_t i = 0; i < arr->len; i++) {
+            obj = jsonarr_getitem(arr, i)->value.as_obj;
+            for (size_t j = 0; j < 200; j++) {
+                found += jsonobj_getitem(obj, keys[j])->type != JSON_NULL;
+            }
+        }
+    }
+    assert(found == 10 * 200 * arr->len);
+}
+
+/** Set *key* of *obj* to *value*, which the object takes over. */
+void set_member(JsonObject *obj, char *key, JsonValue value) {
+    assert(jsonobj_setitem(obj, key, &value));
+}
+
+/** Build the records as a tree, only to encode it once. */
+void run_tree_report(char *text) {
+    JsonArray *records = jsonarr_construct(NRECORDS);
+    JsonValue root = { .type = JSON_ARRAY, .value.as_arr = records };
+    JsonValue item;
+    JsonObject *record;
+    JsonObject *nested;
+    JsonArray *tags;
+    char name[32];
+    char *out;
+
+    (void) text;
+    for (size_t i = 0; i < NRECORDS; i++) {
+        record = jsonobj_construct(json_default_hasher, 8);
+        nested = jsonobj_construct(json_default_hasher, 2);
+        tags = jsonarr_construct(2);
+        assert(record && nested && tags);
+        sprintf(name, "item \"%zu\"", i);
+        set_member(record, "id", (JsonValue) {
+            .type = JSON_NUMBER, .value.as_num = (double) i
+        });
+        set_member(record, "name", (JsonValue) {
+            .type = JSON_STRING, .value.as_str = strdup(name)
+        });
+        set_member(record, "score", (JsonValue) {
+            .type = JSON_NUMBER, .value.as_num = i * 0.25
+        });
+        set_member(record, "active", (JsonValue) {
+            .type = JSON_BOOL, .value.as_bool = i % 2
+        });
+        item.type = JSON_STRING;
+        item.value.as_str = strdup("alpha");
+        assert(jsonarr_append(tags, &item));
+        item.value.as_str = strdup("beta");
+        assert(jsonarr_append(tags, &item));
+        set_member(record, "tags", (JsonValue) {
+            .type = JSON_ARRAY, .value.as_arr = tags
+        });
+        set_member(nested, "x", (JsonValue) {
+            .type = JSON_NUMBER, .value.as_num = -1.5e3
+        });
+        set_member(nested, "y", (JsonValue) { .type = JSON_NULL });
+        set_member(record, "nested", (JsonValue) {
+            .type = JSON_OBJECT, .value.as_obj = nested
+        });
+        item = (JsonValue) { .type = JSON_OBJECT, .value.as_obj = record };
+        assert(jsonarr_append(records, &item));
+    }
+    out = json_sencode(&root, 0, NULL);
+    assert(out);
+    free(out);
+    jsonval_destruct(&root);
+}
+
+/** Write the same records with a JsonWriter, without a tree. */
+void run_writer_report(char *text) {
+    JsonWriter *writer = json_writer_construct(0);
+    char name[32];
+    bool ok;
+
+    (void) text;
+    assert(writer);
+    ok = json_writer_begin_array(writer);
+    for (size_t i = 0; i < NRECORDS; i++) {
+        sprintf(name, "item \"%zu\"", i);
+        ok = ok && json_writer_begin_object(writer)
+            && json_writer_key(writer, "id")
+            && json_writer_uint64(writer, i)
+            && json_writer_key(writer, "name")
+            && json_writer_string(writer, name)
+            && json_writer_key(writer, "score")
+            && json_writer_double(writer, i * 0.25)
+            && json_writer_key(writer, "active")
+            && json_writer_bool(writer, i % 2)
+            && json_writer_key(writer, "tags")
+            && json_writer_begin_array(writer)
+            && json_writer_string(writer, "alpha")
+            && json_writer_string(writer, "beta")
+            && json_writer_end_array(writer)
+            && json_writer_key(writer, "nested")
+            && json_writer_begin_object(writer)
+            && json_writer_key(writer, "x")
+            && json_writer_double(writer, -1.5e3)
+            && json_writer_key(writer, "y")
+            && json_writer_null(writer)
+            && json_writer_end_object(writer)
+            && json_writer_end_object(writer);
+    }
+    assert(ok && json_writer_end_array(writer) && json_writer_finish(writer));
+    assert(json_writer_text(writer, NULL));
+    json_writer_destruct(writer);
+}
+
+void write_bench_file(char *text) {
+    FILE *stream = fopen(BENCH_PATH, "wb");
+
+    assert(stream);
+    fwrite(text, 1, strlen(text), stream);
+    fclose(stream);
+}
+
+void bench(char *name, void (*run)(char *text), char *text) {
+    size_t len = strlen(text);
+    double best = -1;
+
+    // Wall time, since some runs use several threads.
+    for (int i = 0; i < NROUNDS; i++) {
+        struct timespec start;
+        struct timespec stop;
+        timespec_get(&start, TIME_UTC);
+        run(text);
+        timespec_get(&stop, TIME_UTC);
+        double elapsed = (stop.tv_sec - start.tv_sec)
+            + (stop.tv_nsec - start.tv_nsec) / 1e9;
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf(
+        "%-24s %8.2f ms %8.1f MB/s\n",
+        name,
+        best * 1000,
+        len / best / (1024 * 1024)
+    );
+}
+
+int main() {
+    char *records = gen_records(NRECORDS);
+    char *strings = gen_strings(NRECORDS);
+    char *unicode = gen_unicode(NRECORDS);
+    char *numbers = gen_numbers(NRECORDS * 4);
+    char *lines = gen_lines(NRECORDS);
+    char *wide = gen_wide(NRECORDS / 10);
+
+    printf("records: %llu bytes\n", (unsigned long long) strlen(records));
+    bench("lexer+parser (AST only)", run_ast, records);
+    bench("json_sdecode", run_decoder, records);
+    bench("json_document_decode", run_document, records);
+    bench("document_decode_parallel", run_document_parallel, records);
+    bench("json_sax_parse", run_sax, records);
+    bench("json_validate", run_validate, records);
+    write_bench_file(records);
+    bench("fread+document_decode", run_read_document, records);
+    bench("json_mmap_decode", run_mmap, records);
+    decode_encode_input(records);
+    bench("json_fencode", run_fencode, records);
+    bench("json_fdencode", run_fdencode, records);
+    bench("json_sencode", run_sencode, records);
+    bench("tree + json_sencode", run_tree_report, records);
+    bench("json_writer", run_writer_report, records);
+    jsonval_destruct(&encode_input);
+
+    printf("strings: %llu bytes\n", (unsigned long long) strlen(strings));
+    bench("lexer+parser (AST only)", run_ast, strings);
+    bench("json_sdecode", run_decoder, strings);
+    bench("json_document_decode", run_document, strings);
+    bench("document_decode_parallel", run_document_parallel, strings);
+    bench("json_sax_parse", run_sax, strings);
+    bench("json_validate", run_validate, strings);
+    write_bench_file(strings);
+    bench("fread+document_decode", run_read_document, strings);
+    bench("json_mmap_decode", run_mmap, strings);
+    decode_encode_input(strings);
+    bench("json_fencode", run_fencode, strings);
+    bench("json_fdencode", run_fdencode, strings);
+    bench("json_sencode", run_sencode, strings);
+    jsonval_destruct(&encode_input);
+
+    printf("unicode: %llu bytes\n", (unsigned long long) strlen(unicode));
+    bench("json_sdecode", run_decoder, unicode);
+    bench("json_document_decode", run_document, unicode);
+    bench("json_sax_parse", run_sax, unicode);
+    bench("json_validate", run_validate, unicode);
+
+    printf("numbers: %llu bytes\n", (unsigned long long) strlen(numbers));
+    bench("lexer+parser (AST only)", run_ast, numbers);
+    bench("json_sdecode", run_decoder, numbers);
+    bench("json_document_decode", run_document, numbers);
+    bench("document_decode_parallel", run_document_parallel, numbers);
+    bench("json_sax_parse", run_sax, numbers);
+    bench("json_validate", run_validate, numbers);
+    decode_encode_input(numbers);
+    bench("json_fencode", run_fencode, numbers);
+    bench("json_sencode", run_sencode, numbers);
+    jsonval_destruct(&encode_input);
+
+    printf("lines: %llu bytes\n", (unsigned long long) strlen(lines));
+    bench("json_sdecode per line", run_lines_serial, lines);
+    bench("json_decode_lines (1)", run_lines_one, lines);
+    bench("json_decode_lines", run_lines, lines);
+
+    printf("wide: %llu bytes\n", (unsigned long long) strlen(wide));
+    bench("document, 5 fields", run_wide_document, wide);
+    bench("cursor, 5 fields", run_wide_cursor, wide);
+    decode_encode_input(wide);
+    bench("object lookups", run_wide_lookup, wide);
+    jsonval_destruct(&encode_input);
+
+    remove(BENCH_PATH);
+    free(records);
+    free(strings);
+    free(unicode);
+    free(numbers);
+    free(lines);
+    free(wide);
+    return 0;
+}
@@ -0,0 +1,337 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "json.h"
+#include "jsonerror.h"
+#include "lexer.h"
+#include "number.h"
+#include "token.h"
+
+
+// Arrays whose elements have all been returned.
+#define _CURSOR_DONE                SIZE_MAX
+
+
+/** Put the lexer on the value of *cursor* and return its first character. */
+static inline char _cursor_peek(JsonCursor *cursor) {
+    lexer_seek(cursor->_lexer, cursor->_pos);
+    return lexer_peek(cursor->_lexer);
+}
+
+static inline void _cursor_set(JsonCursor *cursor, Lexer *lexer, size_t pos) {
+    cursor->_lexer = lexer;
+    cursor->_pos = pos;
+    cursor->_next = 0;
+}
+
+/** Compare the key that opens at *start* and is followed by the colon at
+ * *colon* with *key*, unescaping it only if it has to.
+ */
+static bool _cursor_key_equal(
+    Lexer *lexer, size_t start, size_t colon, const char *key, size_t key_len
+) {
+    const char *str = &lexer->text[start + 1];
+    const char *close = &lexer->text[colon];
+    Token token;
+    char *unescaped;
+    size_t len;
+    bool equal;
+
+    // Only whitespace lies between the closing quote and the colon.
+    while (*--close != '"');
+    if (close < str) {
+        return false;
+    }
+    len = close - str;
+    if (!memchr(str, '\\', len)) {
+        return len == key_len && memcmp(str, key, len) == 0;
+    }
+
+    token.kind = TOKEN_STRING;
+    token.start = start;
+    token.len = len + 2;
+    if (!(unescaped = lexer_token_string(lexer, &token, &len))) {
+        return false;
+    }
+    equal = len == key_len && memcmp(unescaped, key, len) == 0;
+    free(unescaped);
+    return equal;
+}
+
+
+/** Construct a cursor on the root value of *len* bytes of *text*.
+ *
+ * The text is borrowed, and must outlive the cursor and those made from it.
+ * Return NULL when memory is low.
+ */
+JsonCursor *json_cursor_construct(const char *text, size_t len) {
+    JsonCursor *cursor = malloc(sizeof (JsonCursor));
+    Lexer *lexer;
+
+    if (!cursor) {
+        return NULL;
+    }
+    if (!(lexer = lexer_construct(text, len))) {
+        free(cursor);
+        return NULL;
+    }
+    lexer_peek(lexer);
+    _cursor_set(cursor, lexer, lexer->pos);
+    return cursor;
+}
+
+/** Destruct a cursor from json_cursor_construct(), which invalidates every
+ * cursor made from it.
+ */
+void json_cursor_destruct(JsonCursor *cursor) {
+    lexer_destruct(cursor->_lexer);
+    free(cursor);
+}
+
+/** Tell the type of the value under the cursor from its first character.
+ *
+ * Numbers are JSON_NUMBER. Nothing is validated, and anything that starts
+ * no value is JSON_NULL.
+ */
+JsonValueType json_cursor_type(JsonCursor *cursor) {
+    switch (_cursor_peek(cursor)) {
+        case 't':
+        case 'f':
+            return JSON_BOOL;
+        case '"':
+            return JSON_STRING;
+        case '[':
+            return JSON_ARRAY;
+        case '{':
+            return JSON_OBJECT;
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return JSON_NUMBER;
+        default:
+            return JSON_NULL;
+    }
+}
+
+/** Point *field* to the value of *key* in the object under *object*.
+ *
+ * Members are looked at in order from where the previous lookup in this
+ * object stopped, wrapping around once, so fields read in document order
+ * take a single pass. Values of other members are skipped by bracket
+ * matching. Return false if there is no such key, or *object* is not an
+ * object.
+ */
+bool json_cursor_find_field(
+    JsonCursor *object, const char *key, JsonCursor *field
+) {
+    Lexer *lexer = object->_lexer;
+    size_t key_len = strlen(key);
+    bool wrapped = false;
+    size_t first;
+    size_t start;
+    size_t member;
+    bool match;
+    char chr;
+
+    if (_cursor_peek(object) != '{') {
+        return false;
+    }
+    lexer_advance(lexer);
+    if (lexer_peek(lexer) != '"') {
+        // Empty, or invalid.
+        return false;
+    }
+    first = lexer->pos;
+    start = object->_next ? object->_next : first;
+    lexer_seek(lexer, start);
+
+    while (1) {
+        // Keys are compared as they lie in the text, and neither they nor
+        // the values of other members are validated.
+        member = lexer->pos;
+        if (lexer_peek(lexer) != '"') {
+            return false;
+        }
+        lexer_skip_token(lexer);
+        if (lexer_peek(lexer) != ':') {
+            return false;
+        }
+        match = _cursor_key_equal(lexer, member, lexer->pos, key, key_len);
+        lexer_skip_token(lexer);
+        if (match) {
+            // The next lookup starts from this member.
+            object->_next = member;
+            _cursor_set(field, lexer, lexer->pos);
+            return true;
+        }
+
+        if (!lexer_skip_value(lexer)) {
+            return false;
+        }
+        chr = lexer_peek(lexer);
+        if (chr == '}') {
+            if (wrapped || start == first) {
+                return false;
+            }
+            wrapped = true;
+            lexer_seek(lexer, first);
+        } else if (chr != ',') {
+            return false;
+        } else {
+            lexer_skip_token(lexer);
+        }
+        if (wrapped && lexer->pos == start) {
+            return false;
+        }
+    }
+}
+
+/** Point *element* to the next element of the array under *array*.
+ *
+ * The first call gives the first element. On the next ones, *element* is
+ * expected to be the cursor from the previous call: the previous element is
+ * skipped by bracket matching, from as far as it has been looked into.
+ * Return false past the last element, or if *array* is not an array.
+ */
+bool json_cursor_next_element(JsonCursor *array, JsonCursor *element) {
+    Lexer *lexer = array->_lexer;
+    bool skipped;
+    char chr;
+
+    if (array->_next == _CURSOR_DONE) {
+        return false;
+    }
+    if (!array->_next) {
+        if (_cursor_peek(array) != '[') {
+            return false;
+        }
+        lexer_advance(lexer);
+        if (lexer_peek(lexer) == ']') {
+            array->_next = _CURSOR_DONE;
+            return false;
+        }
+    } else {
+        if (element->_pos == array->_next && element->_next
+                && element->_next != _CURSOR_DONE) {
+            // Resume from the last member or element looked at inside it,
+            // so the start of the element is not indexed again.
+            lexer_seek(lexer, element->_next);
+            skipped = lexer_skip_rest(lexer, 1);
+        } else {
+            lexer_seek(lexer, array->_next);
+            skipped = lexer_skip_value(lexer);
+        }
+        if (!skipped) {
+            array->_next = _CURSOR_DONE;
+            return false;
+        }
+        chr = lexer_peek(lexer);
+        lexer_advance(lexer);
+        if (chr != ',') {
+            array->_next = _CURSOR_DONE;
+            return false;
+        }
+        lexer_peek(lexer);
+    }
+    array->_next = lexer->pos;
+    _cursor_set(element, lexer, lexer->pos);
+    return true;
+}
+
+/** Convert the number under the cursor to a double and report success. */
+bool json_cursor_get_double(JsonCursor *cursor, double *value) {
+    Number number;
+    char chr = _cursor_peek(cursor);
+
+    if (chr != '-' && (chr < '0' || chr > '9')) {
+        return false;
+    }
+    if (!lexer_number(cursor->_lexer, &number)) {
+        return false;
+    }
+    *value = number_to_double(&number);
+    return true;
+}
+
+/** Store the number under the cursor in *value* and report success, which
+ * needs an integral number that fits int64_t.
+ */
+bool json_cursor_get_int64(JsonCursor *cursor, int64_t *value) {
+    Number number;
+    char chr = _cursor_peek(cursor);
+
+    if (chr != '-' && (chr < '0' || chr > '9')) {
+        return false;
+    }
+    if (!lexer_number(cursor->_lexer, &number)) {
+        return false;
+    }
+    return number_to_int64(&number, value);
+}
+
+/** Store the boolean under the cursor in *value* and report success. */
+bool json_cursor_get_bool(JsonCursor *cursor, bool *value) {
+    char chr = _cursor_peek(cursor);
+
+    if (chr != 't' && chr != 'f') {
+        return false;
+    }
+    if (!lexer_literal(cursor->_lexer, (chr == 't') ? "true" : "false")) {
+        return false;
+    }
+    *value = chr == 't';
+    return true;
+}
+
+/** Return a newly allocated, unescaped copy of the string under the cursor
+ * and store its length in *len*, or return NULL.
+ */
+char *json_cursor_get_string(JsonCursor *cursor, size_t *len) {
+    if (_cursor_peek(cursor) != '"') {
+        return NULL;
+    }
+    return lexer_string(cursor->_lexer, len);
+}
+
+/** Decode the whole value under the cursor, as json_ndecode() would.
+ *
+ * *options* may be NULL for the defaults. Set *error* value to true when
+ * parsing failed; the error is located in the whole text.
+ */
+JsonValue json_cursor_decode(
+    JsonCursor *cursor, const JsonDecodeOptions *options, bool *error
+) {
+    Lexer *lexer = cursor->_lexer;
+    JsonValue jsval = { JSON_NULL };
+    Lexer value;
+    size_t start;
+
+    _cursor_peek(cursor);
+    start = lexer->pos;
+    if (!lexer_skip_value(lexer)) {
+        *error = true;
+        jsonerror_locate(&lexer->error, lexer->text, lexer->len);
+        jsonerror_report(&lexer->error);
+        return jsval;
+    }
+    lexer_init(&value, &lexer->text[start], lexer->pos - start);
+    jsval = decoder_decode(&value, options, NULL, error);
+    if (*error) {
+        value.error.offset += start;
+        jsonerror_locate(&value.error, lexer->text, lexer->len);
+        jsonerror_report(&value.error);
+    }
+    return jsval;
+}
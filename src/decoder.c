@@ -0,0 +1,449 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "json.h"
+#include "jsonarena.h"
+#include "jsonarr.h"
+#include "jsonerror.h"
+#include "jsonobj.h"
+#include "lexer.h"
+#include "number.h"
+
+
+/** Record what went wrong under the cursor, and return false.
+ *
+ * Anything missing at the end of the text is an unexpected EOF.
+ */
+static inline bool _decoder_error(
+    Lexer *lexer, JsonErrorCode code, const char *msg
+) {
+    if (code == JSON_ERROR_SYNTAX && lexer_eof(lexer)) {
+        code = JSON_ERROR_EOF;
+    }
+    return jsonerror_set(&lexer->error, code, msg, lexer->pos);
+}
+
+static inline bool _decoder_error_memory(Decoder *decoder) {
+    return _decoder_error(
+        decoder->lexer, JSON_ERROR_MEMORY, "insufficient memory"
+    );
+}
+
+/** Free whatever has been built so far. Used to unwind on errors.
+ *
+ * An arena is freed as a whole by its owner instead.
+ */
+static void _decoder_discard(Decoder *decoder, JsonValue *jsval) {
+    if (!decoder->arena) {
+        jsonval_destruct(jsval);
+    }
+}
+
+
+static inline void _decoder_free(Decoder *decoder, void *ptr) {
+    if (!decoder->arena) {
+        free(ptr);
+    }
+}
+
+
+static bool _decoder_literal(
+    Decoder *decoder, JsonValue *jsval, char *ref, JsonValueType type
+) {
+    if (!lexer_literal(decoder->lexer, ref)) {
+        return false;
+    }
+    jsval->type = type;
+    jsval->value.as_bool = ref[0] == 't';
+    return true;
+}
+
+static bool _decoder_number(Decoder *decoder, JsonValue *jsval) {
+    Number number;
+
+    if (!lexer_number(decoder->lexer, &number)) {
+        return false;
+    }
+    if (decoder->flags & JSON_DECODE_INTEGERS) {
+        if (number_to_int64(&number, &jsval->value.as_int)) {
+            jsval->type = JSON_INTEGER;
+            return true;
+        }
+        if (number_to_uint64(&number, &jsval->value.as_uint)) {
+            jsval->type = JSON_UNSIGNED;
+            return true;
+        }
+    }
+    jsval->type = JSON_NUMBER;
+    jsval->value.as_num = number_to_double(&number);
+    return true;
+}
+
+/** Consume a string and return its unescaped content, storing its length
+ * in *len*, or return NULL on error.
+ *
+ * With an arena, strings are packed one after the other in the space
+ * reserved for them; otherwise each one is malloc()ed.
+ */
+static char *_decoder_string_value(Decoder *decoder, size_t *len) {
+    char *str = decoder->strings;
+
+    if (!decoder->arena) {
+        // The lexer only fails silently when memory is low.
+        str = lexer_string(decoder->lexer, len);
+        if (!str && decoder->lexer->error.code == JSON_ERROR_NONE) {
+            _decoder_error_memory(decoder);
+        }
+        return str;
+    }
+    if (!lexer_string_into(decoder->lexer, str, len)) {
+        return NULL;
+    }
+    decoder->strings += *len + 1;
+    return str;
+}
+
+static bool _decoder_string(Decoder *decoder, JsonValue *jsval) {
+    size_t len;
+    char *str = _decoder_string_value(decoder, &len);
+
+    if (!str) {
+        return false;
+    }
+    jsval->type = JSON_STRING;
+    jsval->value.as_str = str;
+    return true;
+}
+
+/** Make *jsval* the root, the next element of the innermost array, or the
+ * value of the pending key of the innermost object.
+ *
+ * On failure, *jsval* is discarded along with the key.
+ */
+static bool _decoder_attach(
+    Decoder *decoder, JsonValue *root, JsonValue *jsval
+) {
+    JsonValue *top;
+    bool done;
+
+    if (!decoder->depth) {
+        *root = *jsval;
+        return true;
+    }
+    top = &decoder->stack[decoder->depth - 1];
+    if (top->type == JSON_ARRAY) {
+        done = jsonarr_append(top->value.as_arr, jsval);
+    } else {
+        // The key was made for the object, which can have it as is.
+        done = jsonobj_setitem_adopt_n(
+            top->value.as_obj, decoder->key, decoder->key_len, jsval
+        );
+        if (done) {
+            decoder->key = NULL;
+        }
+    }
+    if (!done) {
+        _decoder_discard(decoder, jsval);
+        return _decoder_error_memory(decoder);
+    }
+    return true;
+}
+
+static bool _decoder_push(Decoder *decoder, JsonValue *container) {
+    JsonValue *new_stack;
+    size_t new_cap;
+
+    if (decoder->depth == decoder->cap) {
+        new_cap = decoder->cap * DECODER_GROW_FACTOR;
+        if (new_cap > decoder->max_depth) {
+            new_cap = decoder->max_depth;
+        }
+        if (!(new_stack = malloc(new_cap * sizeof (JsonValue)))) {
+            return _decoder_error_memory(decoder);
+        }
+        memcpy(new_stack, decoder->stack, decoder->depth * sizeof (JsonValue));
+        if (decoder->stack != decoder->_stack) {
+            free(decoder->stack);
+        }
+        decoder->stack = new_stack;
+        decoder->cap = new_cap;
+    }
+    decoder->stack[decoder->depth++] = *container;
+    return true;
+}
+
+/** Consume the bracket *chr*, and attach and enter a new container. */
+static bool _decoder_open(Decoder *decoder, JsonValue *root, char chr) {
+    JsonValue container;
+
+    if (decoder->depth == decoder->max_depth) {
+        return _decoder_error(
+            decoder->lexer, JSON_ERROR_DEPTH, "maximum depth exceeded"
+        );
+    }
+    if (chr == '[') {
+        container.type = JSON_ARRAY;
+        container.value.as_arr = jsonarr_construct_in(decoder->arena, SIZE_MAX);
+    } else {
+        container.type = JSON_OBJECT;
+        container.value.as_obj = jsonobj_construct_in(
+            decoder->arena, json_default_hasher, SIZE_MAX
+        );
+    }
+    if (!container.value.as_arr) {
+        return _decoder_error_memory(decoder);
+    }
+    lexer_advance(decoder->lexer);
+    return _decoder_attach(decoder, root, &container)
+        && _decoder_push(decoder, &container);
+}
+
+/** Consume a key and the colon after it, and keep the key for the value. */
+static bool _decoder_key(Decoder *decoder) {
+    Lexer *lexer = decoder->lexer;
+
+    if (lexer_peek(lexer) != '"') {
+        return _decoder_error(lexer, JSON_ERROR_SYNTAX, "expected string key");
+    }
+    if (!(decoder->key = _decoder_string_value(decoder, &decoder->key_len))) {
+        return false;
+    }
+    if (lexer_peek(lexer) != ':') {
+        return _decoder_error(lexer, JSON_ERROR_SYNTAX, "expected ':'");
+    }
+    lexer_advance(lexer);
+    return true;
+}
+
+/** Decode the scalar that starts with *chr*, already peeked. */
+static bool _decoder_scalar(Decoder *decoder, JsonValue *jsval, char chr) {
+    switch (chr) {
+        case 'n':
+            return _decoder_literal(decoder, jsval, "null", JSON_NULL);
+        case 't':
+            return _decoder_literal(decoder, jsval, "true", JSON_BOOL);
+        case 'f':
+            return _decoder_literal(decoder, jsval, "false", JSON_BOOL);
+        case '"':
+            return _decoder_string(decoder, jsval);
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return _decoder_number(decoder, jsval);
+        case 0:
+            if (lexer_eof(decoder->lexer)) {
+                return _decoder_error(
+                    decoder->lexer, JSON_ERROR_EOF, "unexpected EOF"
+                );
+            }
+            return _decoder_error(
+                decoder->lexer, JSON_ERROR_CHARACTER, "unexpected NUL character"
+            );
+        default:
+            return _decoder_error(
+                decoder->lexer, JSON_ERROR_CHARACTER, "unexpected character"
+            );
+    }
+}
+
+/** Decode one value into *root*, containers and all.
+ *
+ * Every value is attached to its parent as soon as it starts, so on failure
+ * whatever was decoded hangs from *root*, except the pending key.
+ */
+static bool _decoder_value(Decoder *decoder, JsonValue *root) {
+    Lexer *lexer = decoder->lexer;
+    JsonValue item;
+    JsonValue *top;
+    char chr;
+
+    while (1) {
+        if (decoder->depth
+                && decoder->stack[decoder->depth - 1].type == JSON_OBJECT
+                && !_decoder_key(decoder)) {
+            return false;
+        }
+
+        chr = lexer_peek(lexer);
+        if (chr == '[' || chr == '{') {
+            if (!_decoder_open(decoder, root, chr)) {
+                return false;
+            }
+            // Not empty: go on with its first member or element.
+            if (lexer_peek(lexer) != ((chr == '[') ? ']' : '}')) {
+                continue;
+            }
+            lexer_advance(lexer);
+            decoder->depth--;
+        } else if (!_decoder_scalar(decoder, &item, chr)
+                || !_decoder_attach(decoder, root, &item)) {
+            return false;
+        }
+
+        // Close every container that ends after this value.
+        while (decoder->depth) {
+            top = &decoder->stack[decoder->depth - 1];
+            chr = lexer_peek(lexer);
+            if (chr == ',') {
+                lexer_advance(lexer);
+                break;
+            } else if (top->type == JSON_ARRAY && chr != ']') {
+                return _decoder_error(
+                    lexer, JSON_ERROR_SYNTAX, "expected ',' or ']'"
+                );
+            } else if (top->type == JSON_OBJECT && chr != '}') {
+                return _decoder_error(
+                    lexer, JSON_ERROR_SYNTAX, "expected ',' or '}'"
+                );
+            }
+            lexer_advance(lexer);
+            decoder->depth--;
+        }
+        if (!decoder->depth) {
+            return true;
+        }
+    }
+}
+
+
+/** Prepare *decoder* to read from *lexer*, and report success.
+ *
+ * With an arena, room for the strings of the whole text is reserved.
+ */
+static bool _decoder_init(
+    Decoder *decoder,
+    Lexer *lexer,
+    const JsonDecodeOptions *options,
+    JsonArena *arena
+) {
+    *decoder = (Decoder) {
+        .lexer = lexer,
+        .flags = options ? options->flags : 0,
+        .arena = arena,
+        .max_depth = decoder_max_depth(options),
+        .cap = DECODER_INITIAL_DEPTH
+    };
+    decoder->stack = decoder->_stack;
+    // Unescaped strings are never longer than in the text, quotes included,
+    // so all of them fit in as many bytes as the text.
+    if (arena && !(decoder->strings = jsonarena_alloc(arena, lexer->len + 1))) {
+        return _decoder_error_memory(decoder);
+    }
+    return true;
+}
+
+/** Release the stack, and the pending key of a decoder that failed. */
+static void _decoder_finish(Decoder *decoder, bool error) {
+    if (decoder->stack != decoder->_stack) {
+        free(decoder->stack);
+    }
+    if (error) {
+        _decoder_free(decoder, decoder->key);
+    }
+}
+
+
+/** Decode a whole JSON document from *lexer*.
+ *
+ * *options* may be NULL for the defaults. With an *arena*, everything is
+ * allocated from it, otherwise from malloc().
+ * Set *error* to true when decoding failed; the returned value is then null
+ * and everything decoded so far has already been freed, unless it came from
+ * the arena. What went wrong is left in the error of the lexer, unlocated.
+ */
+JsonValue decoder_decode(
+    Lexer *lexer,
+    const JsonDecodeOptions *options,
+    JsonArena *arena,
+    bool *error
+) {
+    Decoder decoder;
+    JsonValue jsval = { JSON_NULL, .value.as_bool = false };
+
+    *error = true;
+    if (!_decoder_init(&decoder, lexer, options, arena)) {
+        return jsval;
+    }
+    if (_decoder_value(&decoder, &jsval)) {
+        lexer_peek(lexer);
+        if (lexer_eof(lexer)) {
+            *error = false;
+        } else {
+            _decoder_error(
+                lexer, JSON_ERROR_TRAILING, "trailing characters after document"
+            );
+        }
+    }
+
+    _decoder_finish(&decoder, *error);
+    if (*error) {
+        _decoder_discard(&decoder, &jsval);
+        jsval.type = JSON_NULL;
+    }
+    return jsval;
+}
+
+/** Decode exactly *count* comma-separated values from *lexer* into *values*,
+ * as found between the brackets of an array, up to the end of the text.
+ *
+ * The values are elements, so they may nest one level less than *options*
+ * allow. On failure, whatever was decoded is freed as with decoder_decode(),
+ * and false is returned.
+ */
+bool decoder_decode_elements(
+    Lexer *lexer,
+    const JsonDecodeOptions *options,
+    JsonArena *arena,
+    JsonValue *values,
+    size_t count
+) {
+    Decoder decoder;
+    bool done;
+    size_t i;
+
+    if (!_decoder_init(&decoder, lexer, options, arena)) {
+        return false;
+    }
+    decoder.max_depth--;
+    for (i = 0, done = true; i < count && done; i++) {
+        if (i && lexer_peek(lexer) != ',') {
+            done = _decoder_error(
+                lexer, JSON_ERROR_SYNTAX, "expected ',' or ']'"
+            );
+            break;
+        }
+        if (i) {
+            lexer_advance(lexer);
+        }
+        values[i].type = JSON_NULL;
+        done = _decoder_value(&decoder, &values[i]);
+    }
+    if (done) {
+        lexer_peek(lexer);
+        if (!lexer_eof(lexer)) {
+            done = _decoder_error(
+                lexer, JSON_ERROR_SYNTAX, "expected ',' or ']'"
+            );
+        }
+    }
+
+    _decoder_finish(&decoder, !done);
+    if (!done) {
+        // The value that failed is partly decoded, and hangs from its slot.
+        while (i--) {
+            _decoder_discard(&decoder, &values[i]);
+        }
+    }
+    return done;
+}
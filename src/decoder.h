@@ -0,0 +1,80 @@
+#ifndef __JSON_DECODER_H__
+#define __JSON_DECODER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "json.h"
+#include "lexer.h"
+
+
+// Containers open at once before the stack moves to the heap.
+#define DECODER_INITIAL_DEPTH       32
+#define DECODER_GROW_FACTOR         2
+
+
+/**
+ * The decoder reads characters straight from the lexer and builds JsonValue
+ * in a single pass, without going through Token or ASTNode.
+ *
+ * Nesting is kept on an explicit stack of the open containers rather than
+ * on the call stack, so deep documents cost heap memory, up to *max_depth*.
+ */
+typedef struct Decoder {
+    Lexer *lexer;
+    unsigned int flags;
+    JsonArena *arena;
+    // Where the next string goes, when there is an arena.
+    char *strings;
+    size_t max_depth;
+    // The open containers, innermost last. Each is already in the tree.
+    JsonValue *stack;
+    size_t depth;
+    size_t cap;
+    // Key of the pending member of the innermost object, and its length.
+    char *key;
+    size_t key_len;
+    JsonValue _stack[DECODER_INITIAL_DEPTH];
+} Decoder;
+
+
+/** The depth limit set by *options*, which may be NULL. */
+static inline size_t decoder_max_depth(const JsonDecodeOptions *options) {
+    return (options && options->max_depth)
+        ? options->max_depth
+        : JSON_DEFAULT_MAX_DEPTH;
+}
+
+
+/** Decode a whole JSON document from *lexer*.
+ *
+ * *options* may be NULL for the defaults. With an *arena*, everything is
+ * allocated from it, otherwise from malloc().
+ * Set *error* to true when decoding failed; the returned value is then null
+ * and everything decoded so far has already been freed, unless it came from
+ * the arena. What went wrong is left in the error of the lexer, unlocated.
+ */
+JsonValue decoder_decode(
+    Lexer *lexer,
+    const JsonDecodeOptions *options,
+    JsonArena *arena,
+    bool *error
+);
+
+/** Decode exactly *count* comma-separated values from *lexer* into *values*,
+ * as found between the brackets of an array, up to the end of the text.
+ *
+ * The values are elements, so they may nest one level less than *options*
+ * allow. On failure, whatever was decoded is freed as with decoder_decode(),
+ * and false is returned.
+ */
+bool decoder_decode_elements(
+    Lexer *lexer,
+    const JsonDecodeOptions *options,
+    JsonArena *arena,
+    JsonValue *values,
+    size_t count
+);
+
+
+#endif
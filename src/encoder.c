@@ -0,0 +1,372 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "encoder.h"
+#include "json.h"
+#include "number.h"
+#include "simd.h"
+
+
+// Indentation is copied from here, a level at a time.
+static const char _encoder_indent[] = "    ";
+
+
+/** Prepare an encoder into a buffer of its own, allocated on first write. */
+void encoder_init(Encoder *encoder, unsigned int flags) {
+    *encoder = (Encoder) { .flags = flags };
+}
+
+/** Prepare an encoder into the *size* bytes at *buf*, which never grow. */
+void encoder_init_fixed(
+    Encoder *encoder, char *buf, size_t size, unsigned int flags
+) {
+    *encoder = (Encoder) {
+        .buf = buf, .cap = size, .flags = flags, .fixed = true
+    };
+}
+
+/** Prepare an encoder that hands its output to *sink*, which must outlive
+ * it, through a buffer of its own.
+ *
+ * With *refs*, long strings are handed over as they are, uncopied: only
+ * for strings that do not change until encoding is over, as in a tree.
+ */
+void encoder_init_sink(
+    Encoder *encoder, const JsonSink *sink, unsigned int flags, bool refs
+) {
+    *encoder = (Encoder) { .flags = flags, .sink = sink, .refs = refs };
+}
+
+/** Release the buffer of a sink encoder. */
+void encoder_release(Encoder *encoder) {
+    free(encoder->buf);
+    encoder->buf = NULL;
+    encoder->len = encoder->cap = encoder->mark = 0;
+    encoder->npieces = 0;
+}
+
+/** Close the piece of the buffer written since the last one, if any. */
+static void _encoder_close_piece(Encoder *encoder) {
+    if (encoder->len > encoder->mark) {
+        encoder->pieces[encoder->npieces++] = (_EncoderPiece) {
+            NULL, encoder->mark, encoder->len - encoder->mark
+        };
+        encoder->mark = encoder->len;
+    }
+}
+
+/** Drop the first *taken* bytes of the pieces, and move what is left of
+ * the buffer to its start.
+ */
+static void _encoder_consume(Encoder *encoder, size_t taken) {
+    _EncoderPiece *pieces = encoder->pieces;
+    size_t done = 0;
+    size_t shift;
+
+    while (done < encoder->npieces && taken >= pieces[done].len) {
+        taken -= pieces[done++].len;
+    }
+    encoder->npieces -= done;
+    memmove(pieces, &pieces[done], encoder->npieces * sizeof *pieces);
+    if (encoder->npieces) {
+        pieces[0].offset += taken;
+        pieces[0].len -= taken;
+        if (pieces[0].ref) {
+            pieces[0].ref += taken;
+        }
+    }
+
+    // The buffer is only needed from its first piece left on.
+    shift = encoder->len;
+    for (size_t i = 0; i < encoder->npieces; i++) {
+        if (!pieces[i].ref) {
+            shift = pieces[i].offset;
+            break;
+        }
+    }
+    for (size_t i = 0; i < encoder->npieces; i++) {
+        if (!pieces[i].ref) {
+            pieces[i].offset -= shift;
+        }
+    }
+    memmove(encoder->buf, &encoder->buf[shift], encoder->len - shift);
+    encoder->len -= shift;
+    encoder->mark -= shift;
+}
+
+/** Hand what is held to the sink of a sink encoder, and report whether it
+ * took all of it, which resumes a paused encoder.
+ */
+bool encoder_flush(Encoder *encoder) {
+    JsonChunk chunks[ENCODER_MAX_PIECES];
+    _EncoderPiece *piece;
+    size_t taken;
+
+    if (!encoder->sink || encoder->error) {
+        return !encoder->error;
+    }
+    _encoder_close_piece(encoder);
+    if (!encoder->npieces) {
+        encoder->paused = false;
+        return true;
+    }
+    for (size_t i = 0; i < encoder->npieces; i++) {
+        piece = &encoder->pieces[i];
+        chunks[i].data = piece->ref ? piece->ref : &encoder->buf[piece->offset];
+        chunks[i].len = piece->len;
+    }
+    taken = encoder->sink->write(encoder->sink->ctx, chunks, encoder->npieces);
+    if (taken == SIZE_MAX) {
+        encoder->error = JSON_ERROR_IO;
+        return false;
+    }
+    _encoder_consume(encoder, taken);
+    encoder->paused = encoder->npieces != 0;
+    return !encoder->paused;
+}
+
+/** Write the *n* bytes at *src* to a sink encoder by reference, or copy
+ * them when it holds too many pieces already.
+ */
+static void _encoder_write_ref(Encoder *encoder, const char *src, size_t n) {
+    // The piece of the buffer before, this one, and room for one after.
+    if (encoder->npieces + 3 > ENCODER_MAX_PIECES && !encoder->paused) {
+        encoder_flush(encoder);
+    }
+    if (encoder->npieces + 3 > ENCODER_MAX_PIECES || encoder->error) {
+        encoder_write(encoder, src, n);
+        return;
+    }
+    _encoder_close_piece(encoder);
+    encoder->pieces[encoder->npieces++] = (_EncoderPiece) { src, 0, n };
+}
+
+/** Make room for *n* more bytes, or hand the buffer over, or count them. */
+void encoder_write_slow(Encoder *encoder, const char *src, size_t n) {
+    size_t room = encoder->cap - encoder->len;
+    size_t new_cap;
+    char *new_buf;
+
+    if (encoder->error) {
+        return;
+    }
+    if (encoder->fixed) {
+        // Fill the buffer up, and only count the rest.
+        if (room > n) {
+            room = n;
+        }
+        if (room) {
+            memcpy(&encoder->buf[encoder->len], src, room);
+            encoder->len += room;
+        }
+        encoder->dropped += n - room;
+        return;
+    }
+    if (encoder->sink && encoder->cap && !encoder->paused) {
+        encoder_flush(encoder);
+        if (encoder->error) {
+            return;
+        }
+    }
+    // A paused sink encoder grows like the others.
+    if (encoder->cap - encoder->len < n) {
+        new_cap = encoder->cap ? encoder->cap
+            : encoder->sink ? ENCODER_SINK_CAP
+            : ENCODER_INITIAL_CAP;
+        while (new_cap - encoder->len < n) {
+            new_cap *= ENCODER_GROW_FACTOR;
+        }
+        if (!(new_buf = realloc(encoder->buf, new_cap))) {
+            encoder->error = JSON_ERROR_MEMORY;
+            return;
+        }
+        encoder->buf = new_buf;
+        encoder->cap = new_cap;
+    }
+    memcpy(&encoder->buf[encoder->len], src, n);
+    encoder->len += n;
+}
+
+
+/** Decode the UTF-8 sequence at *s* into *cp*, and return its length, or
+ * zero if it is invalid or cut short by the terminator.
+ */
+static size_t _encoder_utf8_decode(const unsigned char *s, unsigned int *cp) {
+    size_t n;
+
+    if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+        n = 1;
+        *cp = s[0] & 0x1f;
+    } else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+        n = 2;
+        *cp = s[0] & 0x0f;
+    } else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+        n = 3;
+        *cp = s[0] & 0x07;
+    } else {
+        return 0;
+    }
+    for (size_t i = 1; i <= n; i++) {
+        // The terminator is no continuation, so this stops there.
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *cp = (*cp << 6) | (s[i] & 0x3f);
+    }
+    // Overlong forms, surrogates, and beyond U+10FFFF.
+    if (*cp < ((n == 1) ? 0x80 : (n == 2) ? 0x800 : 0x10000)
+            || (*cp >= 0xd800 && *cp <= 0xdfff) || *cp > 0x10ffff) {
+        return 0;
+    }
+    return n + 1;
+}
+
+/** Write the UTF-16 code unit *unit* as a "\u" escape. */
+static void _encoder_unit(Encoder *encoder, unsigned int unit) {
+    static const char hex[] = "0123456789abcdef";
+    char esc[6] = {
+        '\\', 'u', hex[unit >> 12], hex[(unit >> 8) & 0xf],
+        hex[(unit >> 4) & 0xf], hex[unit & 0xf]
+    };
+
+    encoder_write(encoder, esc, sizeof esc);
+}
+
+/** Write the non-ASCII character at *chr* as "\u" escapes, and return
+ * its length. Invalid bytes become U+FFFD, one at a time.
+ */
+static size_t _encoder_unicode(Encoder *encoder, const unsigned char *chr) {
+    unsigned int cp;
+    size_t n = _encoder_utf8_decode(chr, &cp);
+
+    if (!n) {
+        cp = 0xfffd;
+        n = 1;
+    }
+    if (cp >= 0x10000) {
+        // Beyond the BMP, as a surrogate pair.
+        cp -= 0x10000;
+        _encoder_unit(encoder, 0xd800 + (cp >> 10));
+        _encoder_unit(encoder, 0xdc00 + (cp & 0x3ff));
+    } else {
+        _encoder_unit(encoder, cp);
+    }
+    return n;
+}
+
+/** Write *str* as a JSON string, quotes included.
+ *
+ * Runs of bytes that need no escape are found 16 or 32 at a time, and
+ * copied as a block, or handed to the sink as they are when long enough
+ * and the encoder allows it.
+ */
+void encoder_string(Encoder *encoder, const char *str) {
+    bool ascii = encoder->flags & JSON_ENCODE_ASCII;
+    const char *end = str + strlen(str);
+    const char *chr = str;
+    const char *run;
+    char esc[2] = { '\\', 0 };
+
+    encoder_putc(encoder, '"');
+    for (;;) {
+        run = chr;
+        chr = simd_find_escape(chr, end, ascii);
+        if (encoder->refs && chr - run >= ENCODER_REF_MIN) {
+            _encoder_write_ref(encoder, run, (size_t) (chr - run));
+        } else {
+            encoder_write(encoder, run, (size_t) (chr - run));
+        }
+        if (chr == end) {
+            break;
+        }
+        switch (*chr) {
+            case '"':
+            case '\\':
+                esc[1] = *chr;
+                break;
+            case '\n':
+                esc[1] = 'n';
+                break;
+            case '\r':
+                esc[1] = 'r';
+                break;
+            case '\t':
+                esc[1] = 't';
+                break;
+            case '\b':
+                esc[1] = 'b';
+                break;
+            case '\f':
+                esc[1] = 'f';
+                break;
+            default:
+                if ((unsigned char) *chr >= 0x80) {
+                    chr += _encoder_unicode(
+                        encoder, (const unsigned char *) chr
+                    );
+                } else {
+                    // The other control characters have no short form.
+                    _encoder_unit(encoder, (unsigned char) *chr++);
+                }
+                continue;
+        }
+        encoder_write(encoder, esc, sizeof esc);
+        chr++;
+    }
+    encoder_putc(encoder, '"');
+}
+
+/** Write *item*, which must not be an array or an object. */
+void encoder_scalar(Encoder *encoder, JsonValue *item) {
+    char num[NUMBER_FORMAT_BUFSIZE];
+    size_t len;
+
+    switch (item->type) {
+        case JSON_NULL:
+            encoder_write(encoder, "null", 4);
+            break;
+        case JSON_BOOL:
+            if (item->value.as_bool) {
+                encoder_write(encoder, "true", 4);
+            } else {
+                encoder_write(encoder, "false", 5);
+            }
+            break;
+        case JSON_NUMBER:
+            if (!isfinite(item->value.as_num)) {
+                // JSON has no way to write these.
+                encoder_write(encoder, "null", 4);
+                break;
+            }
+            len = number_format_double(item->value.as_num, num);
+            encoder_write(encoder, num, len);
+            break;
+        case JSON_INTEGER:
+            len = number_format_int64(item->value.as_int, num);
+            encoder_write(encoder, num, len);
+            break;
+        case JSON_UNSIGNED:
+            len = number_format_uint64(item->value.as_uint, num);
+            encoder_write(encoder, num, len);
+            break;
+        case JSON_STRING:
+            encoder_string(encoder, item->value.as_str);
+            break;
+        default:
+            break;
+    }
+}
+
+/** Start a new line indented for *depth*, when pretty printing. */
+void encoder_newline(Encoder *encoder, size_t depth) {
+    if (!(encoder->flags & JSON_ENCODE_PRETTY)) {
+        return;
+    }
+    encoder_putc(encoder, '\n');
+    while (depth--) {
+        encoder_write(encoder, _encoder_indent, sizeof _encoder_indent - 1);
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef __JSON_ENCODER_H__
+#define __JSON_ENCODER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "json.h"
+
+
+#define ENCODER_INITIAL_CAP         256
+#define ENCODER_GROW_FACTOR         2
+// Buffered output that makes a sink encoder hand it over.
+#define ENCODER_SINK_CAP            (64 * 1024)
+// Clean runs of strings this long go to a sink by reference, uncopied,
+// when the encoder allows it.
+#define ENCODER_REF_MIN             4096
+// Pieces of output held for a sink at once.
+#define ENCODER_MAX_PIECES          16
+
+
+/** Output held for a sink: *len* bytes at *ref*, or in the buffer from
+ * *offset* when *ref* is NULL.
+ */
+typedef struct _EncoderPiece {
+    const char *ref;
+    size_t offset;
+    size_t len;
+} _EncoderPiece;
+
+/**
+ * The encoder writes JSON text into an output buffer, which is one of:
+ * - grown with realloc() as needed, to be handed over to the caller;
+ * - the caller's, of a fixed size: what does not fit is only counted;
+ * - handed over to a sink whenever it is full.
+ *
+ * Writing never fails on the spot: *error* is set instead, and whatever
+ * comes after is dropped.
+ *
+ * A sink may take less than it is given. The encoder is then *paused*: it
+ * keeps the rest, grows its buffer for whatever else it is written, and
+ * tries again on encoder_flush(). Callers are expected to stop writing
+ * soon after.
+ */
+typedef struct Encoder {
+    char *buf;
+    size_t len;
+    size_t cap;
+    // What did not fit in a fixed buffer, and was only counted.
+    size_t dropped;
+    unsigned int flags;
+    // Where full buffers go, if anywhere.
+    const JsonSink *sink;
+    // Output yet to be taken by the sink, in order, before the buffer from
+    // *mark* on.
+    _EncoderPiece pieces[ENCODER_MAX_PIECES];
+    size_t npieces;
+    size_t mark;
+    // Whether long strings may go to the sink by reference, which takes
+    // them to stay as they are until the next flush at least.
+    bool refs;
+    bool fixed;
+    bool paused;
+    // JSON_ERROR_MEMORY, or JSON_ERROR_IO when the sink failed.
+    JsonErrorCode error;
+} Encoder;
+
+
+/** Prepare an encoder into a buffer of its own, allocated on first write. */
+void encoder_init(Encoder *encoder, unsigned int flags);
+
+/** Prepare an encoder into the *size* bytes at *buf*, which never grow. */
+void encoder_init_fixed(
+    Encoder *encoder, char *buf, size_t size, unsigned int flags
+);
+
+/** Prepare an encoder that hands its output to *sink*, which must outlive
+ * it, through a buffer of its own.
+ *
+ * With *refs*, long strings are handed over as they are, uncopied: only
+ * for strings that do not change until encoding is over, as in a tree.
+ */
+void encoder_init_sink(
+    Encoder *encoder, const JsonSink *sink, unsigned int flags, bool refs
+);
+
+/** Release the buffer of a sink encoder. */
+void encoder_release(Encoder *encoder);
+
+/** Hand what is held to the sink of a sink encoder, and report whether it
+ * took all of it, which resumes a paused encoder.
+ */
+bool encoder_flush(Encoder *encoder);
+
+/** Make room for *n* more bytes, or hand the buffer over, or count them. */
+void encoder_write_slow(Encoder *encoder, const char *src, size_t n);
+
+/** Write *n* bytes from *src*. */
+static inline void encoder_write(Encoder *encoder, const char *src, size_t n) {
+    if (n <= encoder->cap - encoder->len) {
+        memcpy(&encoder->buf[encoder->len], src, n);
+        encoder->len += n;
+    } else {
+        encoder_write_slow(encoder, src, n);
+    }
+}
+
+/** Write a single character. */
+static inline void encoder_putc(Encoder *encoder, char chr) {
+    if (encoder->len < encoder->cap) {
+        encoder->buf[encoder->len++] = chr;
+    } else {
+        encoder_write_slow(encoder, &chr, 1);
+    }
+}
+
+/** Write *str* as a JSON string, quotes included. */
+void encoder_string(Encoder *encoder, const char *str);
+
+/** Write *item*, which must not be an array or an object. */
+void encoder_scalar(Encoder *encoder, JsonValue *item);
+
+/** Start a new line indented for *depth*, when pretty printing. */
+void encoder_newline(Encoder *encoder, size_t depth);
+
+
+#endif
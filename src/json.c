@@ -1,335 +1,858 @@
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include "ast.h"
-#include "token.h"
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "decoder.h"
+#include "encoder.h"
 #include "json.h"
+#include "jsonarena.h"
 #include "jsonarr.h"
+#include "jsonerror.h"
 #include "jsonobj.h"
 #include "lexer.h"
-#include "parser.h"
 
 
-static JsonValue _json_visit(ASTNode *node);
+#define JSON_FDECODE_BUFSIZE        (64 * 1024)
+// Chunks handed to writev() at once by the fd sink.
+#define JSON_FD_SINK_IOV            16
+// Containers walked at once before the stack moves to the heap.
+#define JSON_STACK_INITIAL_DEPTH    32
+#define JSON_STACK_GROW_FACTOR      2
 
 
-static JsonValue _json_visit_nullnode(ASTNode *node) {
-    JsonValue jsval = { JSON_NULL, .value.as_bool = false };
-    return jsval;
-}
+/** A container being walked, and its counterpart in comparisons. */
+typedef struct _JsonFrame {
+    JsonValue *value;
+    JsonValue *other;
+    // How many elements or members have been returned.
+    size_t index;
+    // For objects, until it runs out.
+    JsonObjectIterator *iter;
+} _JsonFrame;
 
-static JsonValue _json_visit_boolnode(ASTNode *node) {
-    JsonValue jsval = { JSON_BOOL };
-    jsval.value.as_bool = node->value[0] == 't';
-    return jsval;
-}
+/**
+ * Trees are walked on an explicit stack of the containers being visited,
+ * innermost last, so their depth is only bounded by memory.
+ */
+typedef struct _JsonStack {
+    _JsonFrame *frames;
+    size_t depth;
+    size_t cap;
+    _JsonFrame initial[JSON_STACK_INITIAL_DEPTH];
+} _JsonStack;
 
-static JsonValue _json_visit_numbernode(ASTNode *node) {
-    JsonValue jsval = { JSON_NUMBER };
-    jsval.value.as_num = atof(node->value);
-    return jsval;
-}
 
-static JsonValue _json_visit_stringnode(ASTNode *node) {
-    JsonValue jsval = { JSON_STRING };
-    jsval.value.as_str = node->value;
-    return jsval;
+/**
+ * An encoding under way: the containers being written, and the value to
+ * write next, or NULL once the whole tree is written.
+ */
+struct JsonEncoder {
+    Encoder encoder;
+    JsonSink sink;
+    _JsonStack stack;
+    JsonValue *item;
+    JsonEncoderStatus status;
+};
+
+
+static void _json_stack_init(_JsonStack *stack) {
+    stack->frames = stack->initial;
+    stack->depth = 0;
+    stack->cap = JSON_STACK_INITIAL_DEPTH;
 }
 
-static JsonValue _json_visit_arraynode(ASTNode *node) {
-    JsonValue jsval = { JSON_ARRAY };
-    JsonValue val;
-    JsonArray *arr;
-    size_t i;
-
-    jsval.value.as_arr = jsonarr_construct(node->len);
-    arr = jsval.value.as_arr;
-    for (i = 0; i < node->len; i++) {
-        val = _json_visit(node->children[i]);
-        jsonarr_append(arr, &val);
+/** Release the stack, and the iterators of the frames left on it. */
+static void _json_stack_free(_JsonStack *stack) {
+    while (stack->depth) {
+        free(stack->frames[--stack->depth].iter);
+    }
+    if (stack->frames != stack->initial) {
+        free(stack->frames);
     }
-    return jsval;
 }
 
-static JsonValue _json_visit_keynode(ASTNode *node, char **key) {
-    JsonValue jsval = _json_visit(node->children[0]);
-    *key = node->value;
-    return jsval;
+/** Enter the array or object *value*, paired with *other*, and report
+ * success.
+ */
+static bool _json_stack_push(
+    _JsonStack *stack, JsonValue *value, JsonValue *other
+) {
+    _JsonFrame *frame;
+    _JsonFrame *new_frames;
+    size_t new_cap;
+
+    if (stack->depth == stack->cap) {
+        new_cap = stack->cap * JSON_STACK_GROW_FACTOR;
+        if (!(new_frames = malloc(new_cap * sizeof (_JsonFrame)))) {
+            return false;
+        }
+        memcpy(new_frames, stack->frames, stack->depth * sizeof (_JsonFrame));
+        if (stack->frames != stack->initial) {
+            free(stack->frames);
+        }
+        stack->frames = new_frames;
+        stack->cap = new_cap;
+    }
+
+    frame = &stack->frames[stack->depth];
+    frame->value = value;
+    frame->other = other;
+    frame->index = 0;
+    frame->iter = NULL;
+    if (value->type == JSON_OBJECT
+            && !(frame->iter = jsonobj_iter(value->value.as_obj))) {
+        return false;
+    }
+    stack->depth++;
+    return true;
 }
 
-static JsonValue _json_visit_objectnode(ASTNode *node) {
-    JsonValue jsval = { JSON_OBJECT };
-    JsonValue val;
+/** Point *value* to the next element or member value of the container of
+ * *frame*, and report whether there was one.
+ *
+ * With *other*, point it to the counterpart of *value* in the container the
+ * frame is paired with, or to NULL if it has no such key.
+ */
+static bool _json_frame_next(
+    _JsonFrame *frame, JsonValue **value, JsonValue **other
+) {
+    JsonArray *arr;
     JsonObject *obj;
-    size_t i;
     char *key;
 
-    jsval.value.as_obj = jsonobj_construct(json_default_hasher, node->len);
-    obj = jsval.value.as_obj;
-    for (i = 0; i < node->len; i++) {
-        val = _json_visit_keynode(node->children[i], &key);
-        jsonobj_setitem(obj, key, &val);
+    if (frame->value->type == JSON_ARRAY) {
+        arr = frame->value->value.as_arr;
+        if (frame->index == arr->len) {
+            return false;
+        }
+        *value = jsonarr_getitem(arr, frame->index);
+        if (other) {
+            *other = jsonarr_getitem(frame->other->value.as_arr, frame->index);
+        }
+    } else {
+        if (!jsonobj_next(frame->iter)) {
+            // The iterator frees itself at the end.
+            frame->iter = NULL;
+            return false;
+        }
+        *value = frame->iter->value;
+        if (other) {
+            obj = frame->other->value.as_obj;
+            key = frame->iter->key;
+            *other = jsonobj_contains(obj, key)
+                ? jsonobj_getitem(obj, key)
+                : NULL;
+        }
     }
-    return jsval;
+    frame->index++;
+    return true;
 }
 
-static JsonValue _json_visit(ASTNode *node) {
-    JsonValue jsval;
 
-    switch (node->kind) {
-        case AST_NULL:
-            return _json_visit_nullnode(node);
-        case AST_BOOL:
-            return _json_visit_boolnode(node);
-        case AST_NUMBER:
-            return _json_visit_numbernode(node);
-        case AST_STRING:
-            return _json_visit_stringnode(node);
-        case AST_ARRAY:
-            return _json_visit_arraynode(node);
-        case AST_OBJECT:
-            return _json_visit_objectnode(node);
-        default:
-            assert(0);
+/** Write the values of the tree from *next* on through *encoder*, until
+ * the tree is over, or the encoder pauses or fails, and leave in *next*
+ * the value to write when resumed, or NULL when the tree is over.
+ *
+ * Return false when there is no memory left for the stack, which is
+ * reported. Errors of the encoder itself are left to the caller.
+ */
+static bool _json_encode_walk(
+    Encoder *encoder, _JsonStack *stack, JsonValue **next
+) {
+    bool pretty = encoder->flags & JSON_ENCODE_PRETTY;
+    bool done = true;
+    JsonValue *item = *next;
+    JsonError error;
+    _JsonFrame *top;
+    char closing;
+
+    while (item) {
+        if (item->type == JSON_ARRAY || item->type == JSON_OBJECT) {
+            encoder_putc(encoder, (item->type == JSON_ARRAY) ? '[' : '{');
+            if (!_json_stack_push(stack, item, NULL)) {
+                jsonerror_set(
+                    &error, JSON_ERROR_MEMORY, "insufficient memory", 0
+                );
+                jsonerror_report(&error);
+                done = false;
+                break;
+            }
+        } else {
+            encoder_scalar(encoder, item);
+        }
+
+        // Close the containers that are done, up to the next value.
+        item = NULL;
+        while (stack->depth) {
+            top = &stack->frames[stack->depth - 1];
+            if (_json_frame_next(top, &item, NULL)) {
+                if (top->index > 1) {
+                    encoder_putc(encoder, ',');
+                }
+                encoder_newline(encoder, stack->depth);
+                if (top->value->type == JSON_OBJECT) {
+                    encoder_string(encoder, top->iter->key);
+                    encoder_putc(encoder, ':');
+                    if (pretty) {
+                        encoder_putc(encoder, ' ');
+                    }
+                }
+                break;
+            }
+            closing = (top->value->type == JSON_ARRAY) ? ']' : '}';
+            stack->depth--;
+            encoder_newline(encoder, stack->depth);
+            encoder_putc(encoder, closing);
+        }
+        if (encoder->error || encoder->paused) {
             break;
+        }
     }
+    *next = item;
+    return done;
 }
 
+/** Write *item* through *encoder*, which must not pause.
+ *
+ * Return false when there is no memory left for the stack, which is
+ * reported. Errors of the encoder itself are left to the caller.
+ */
+static bool _json_encode(Encoder *encoder, JsonValue *item) {
+    _JsonStack stack;
+    bool done;
+
+    _json_stack_init(&stack);
+    done = _json_encode_walk(encoder, &stack, &item);
+    _json_stack_free(&stack);
+    return done;
+}
 
-static void _json_fencode_string(FILE *stream, char *string) {
-    char *chr = string;
+/** Report the error of *encoder*, with *message* if the sink failed. */
+static void _json_encoder_report(Encoder *encoder, const char *message) {
+    JsonError error;
+
+    jsonerror_set(
+        &error,
+        encoder->error,
+        (encoder->error == JSON_ERROR_IO) ? message : "insufficient memory",
+        0
+    );
+    jsonerror_report(&error);
+}
 
-    fputc('"', stream);
-    while (*chr) {
-        switch (*chr) {
-            case '"':
-                fputc('\\', stream);
-                fputc('"', stream);
-                break;
-            case '\\':
-                fputc('\\', stream);
-                if (!(*(chr + 1) == 'u')) {
-                    fputc('\\', stream);
-                }
-                break;
-            case '\n':
-                fputc('\\', stream);
-                fputc('n', stream);
-                break;
-            case '\r':
-                fputc('\\', stream);
-                fputc('r', stream);
-                break;
-            case '\t':
-                fputc('\\', stream);
-                fputc('t', stream);
-                break;
-            case '\b':
-                fputc('\\', stream);
-                fputc('b', stream);
-                break;
-            case '\f':
-                fputc('\\', stream);
-                fputc('f', stream);
-                break;
-            default:
-                fputc(*chr, stream);
-                break;
+/** The sink of json_fencode(): *ctx* is the stream. */
+static size_t _json_file_write(
+    void *ctx, const JsonChunk *chunks, size_t count
+) {
+    size_t total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (fwrite(chunks[i].data, 1, chunks[i].len, ctx) != chunks[i].len) {
+            return SIZE_MAX;
         }
-        chr++;
+        total += chunks[i].len;
     }
-    fputc('"', stream);
+    return total;
 }
 
-static inline void _json_fencode_newline(
-    FILE *stream, bool pretty, unsigned int depth
-) {
-    if (pretty) {
-        fputc('\n', stream);
+#if defined(_WIN32)
 
-        depth *= 4;
-        while (depth--) {
-            fputc(' ', stream);
+/** Without writev(), write the chunks one at a time. */
+static size_t _json_fd_write(
+    void *ctx, const JsonChunk *chunks, size_t count
+) {
+    int fd = (int) (intptr_t) ctx;
+    size_t total = 0;
+    size_t done;
+    int written;
+
+    for (size_t i = 0; i < count; i++) {
+        for (done = 0; done < chunks[i].len; done += written) {
+            written = _write(
+                fd, &chunks[i].data[done],
+                (unsigned int) (chunks[i].len - done)
+            );
+            if (written < 0) {
+                return (errno == EAGAIN) ? total + done : SIZE_MAX;
+            }
         }
+        total += done;
     }
+    return total;
+}
+
+static void _json_wait_writable(int fd) {
+    (void) fd;
 }
 
-static void _json_fencode(
-    FILE *stream, JsonValue *item, bool pretty, unsigned int depth
+#else
+
+/** The sink of json_fd_sink(): *ctx* is the file descriptor.
+ *
+ * Short writes are retried from where they stopped, until the descriptor
+ * would block.
+ */
+static size_t _json_fd_write(
+    void *ctx, const JsonChunk *chunks, size_t count
 ) {
-    size_t i;
-    size_t len;
+    int fd = (int) (intptr_t) ctx;
+    struct iovec iov[JSON_FD_SINK_IOV];
+    size_t total = 0;
+    size_t i = 0;
+    // What was already taken of chunks[i].
+    size_t skip = 0;
+    size_t left;
+    int n;
+    ssize_t written;
+
+    while (i < count) {
+        for (n = 0; n < JSON_FD_SINK_IOV && i + n < count; n++) {
+            iov[n].iov_base = (char *) chunks[i + n].data + (n ? 0 : skip);
+            iov[n].iov_len = chunks[i + n].len - (n ? 0 : skip);
+        }
+        written = writev(fd, iov, n);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK)
+                ? total
+                : SIZE_MAX;
+        }
+        if (written == 0) {
+            return total;
+        }
+        total += (size_t) written;
+        left = (size_t) written;
+        while (i < count && left >= chunks[i].len - skip) {
+            left -= chunks[i++].len - skip;
+            skip = 0;
+        }
+        skip += left;
+    }
+    return total;
+}
+
+/** Wait until *fd* can be written again, once it would have blocked. */
+static void _json_wait_writable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+    while (poll(&pfd, 1, -1) < 0 && errno == EINTR) {
+    }
+}
+
+#endif
 
-    switch (item->type) {
+/** Compare *a* and *b* alone: scalars by value, containers by length. */
+static bool _json_shallow_equal(JsonValue *a, JsonValue *b) {
+    if (a->type != b->type) {
+        return false;
+    }
+
+    switch (a->type) {
         case JSON_NULL:
-            fprintf(stream, "null");
-            break;
+            return true;
         case JSON_BOOL:
-            fprintf(stream, "%s", (item->value.as_bool) ? "true" : "false");
-            break;
+            return !!a->value.as_bool == !!b->value.as_bool;
         case JSON_NUMBER:
-            fprintf(stream, "%g", item->value.as_num);
-            break;
+            return a->value.as_num == b->value.as_num;
+        case JSON_INTEGER:
+            return a->value.as_int == b->value.as_int;
+        case JSON_UNSIGNED:
+            return a->value.as_uint == b->value.as_uint;
         case JSON_STRING:
-            _json_fencode_string(stream, item->value.as_str);
-            break;
+            return strcmp(a->value.as_str, b->value.as_str) == 0;
         case JSON_ARRAY:
-            JsonArray *arr = item->value.as_arr;
+            return a->value.as_arr->len == b->value.as_arr->len;
+        case JSON_OBJECT:
+            return a->value.as_obj->len == b->value.as_obj->len;
+        default:
+            return false;
+    }
+}
 
-            fputc('[', stream);
-            len = arr->len;
-            for (i = 0; i < len; i++) {
-                if (i) {
-                    fputc(',', stream);
-                }
-                _json_fencode_newline(stream, pretty, depth + 1);
-                _json_fencode(stream, jsonarr_getitem(arr, i), pretty, depth + 1);
-            }
-            _json_fencode_newline(stream, pretty, depth);
-            fputc(']', stream);
+/** Destruct the array or object *value*, but not what it holds. */
+static void _json_container_destruct(JsonValue *value) {
+    if (value->type == JSON_ARRAY) {
+        jsonarr_destruct(value->value.as_arr);
+    } else {
+        jsonobj_destruct(value->value.as_obj);
+    }
+    value->type = JSON_NULL;
+}
+
+
+bool jsonval_equal(JsonValue *a, JsonValue *b) {
+    _JsonStack stack;
+    bool equal = true;
+
+    _json_stack_init(&stack);
+    while (1) {
+        if (!_json_shallow_equal(a, b)) {
+            equal = false;
             break;
-        case JSON_OBJECT:
-            JsonObject *obj = item->value.as_obj;
-            JsonObjectIterator *iter = jsonobj_iter(obj);
+        }
+        if ((a->type == JSON_ARRAY || a->type == JSON_OBJECT)
+                && !_json_stack_push(&stack, a, b)) {
+            // Cannot tell without memory.
+            equal = false;
+            break;
+        }
 
-            fputc('{', stream);
-            while (jsonobj_next(iter)) {
-                if (iter->index) {
-                    fputc(',', stream);
-                }
-                _json_fencode_newline(stream, pretty, depth + 1);
-                _json_fencode_string(stream, iter->key);
-                fputc(':', stream);
-                if (pretty) {
-                        fputc(' ', stream);
-                }
-                _json_fencode(stream, iter->value, pretty, depth + 1);
+        // Leave the containers that are done, up to the next pair.
+        while (stack.depth
+                && !_json_frame_next(&stack.frames[stack.depth - 1], &a, &b)) {
+            stack.depth--;
+        }
+        if (!stack.depth) {
+            break;
+        }
+        if (!b) {
+            // The key is missing from the other object.
+            equal = false;
+            break;
+        }
+    }
+    _json_stack_free(&stack);
+    return equal;
+}
+
+void jsonval_destruct(JsonValue *value) {
+    _JsonStack stack;
+
+    _json_stack_init(&stack);
+    while (1) {
+        if (value->type == JSON_STRING) {
+            free(value->value.as_str);
+            value->type = JSON_NULL;
+        } else if (value->type == JSON_ARRAY || value->type == JSON_OBJECT) {
+            if (!_json_stack_push(&stack, value, NULL)) {
+                // Without memory to walk it, only its children are lost.
+                _json_container_destruct(value);
             }
-            _json_fencode_newline(stream, pretty, depth);
-            fputc('}', stream);
+        } else {
+            value->type = JSON_NULL;
+        }
+
+        // Destruct the containers that are done, up to the next child.
+        while (stack.depth
+                && !_json_frame_next(
+                    &stack.frames[stack.depth - 1], &value, NULL
+                )) {
+            _json_container_destruct(stack.frames[--stack.depth].value);
+        }
+        if (!stack.depth) {
             break;
+        }
     }
+    _json_stack_free(&stack);
 }
 
+JsonValue json_sdecode(char *text, bool *error) {
+    return json_ndecode(text, strlen(text), NULL, error);
+}
 
-static JsonValue _json_decode(Lexer *lexer, bool *error) {
-    Parser *parser = parser_construct(lexer);
-    ASTNode *root = parser_parse(parser);
+/** Decode *len* bytes of JSON text in place, without copying it.
+ *
+ * *text* needs not be NUL-terminated, so a slice of a larger buffer is fine.
+ * *options* may be NULL for the defaults.
+ * Set *error* value to true when parsing failed.
+ */
+JsonValue json_ndecode(
+    const char *text, size_t len, const JsonDecodeOptions *options, bool *error
+) {
+    Lexer lexer;
     JsonValue jsval;
-    *error = true;
 
-    if (!root) {
-        parser_destruct(parser);
-        return jsval;
+    lexer_init(&lexer, text, len);
+    jsval = decoder_decode(&lexer, options, NULL, error);
+    if (*error) {
+        jsonerror_locate(&lexer.error, text, len);
+        jsonerror_report(&lexer.error);
     }
-
-    *error = false;
-    jsval = _json_visit(root);
-    // On successful parsing, EOF token still remains.
-    token_destruct(parser->token);
-    parser_destruct(parser);
-    ast_destruct(root);
     return jsval;
 }
 
+/** Decode *len* bytes of JSON text into a new document.
+ *
+ * Arrays, objects, keys and strings of the tree all come from the arena of
+ * the document, so json_document_free() releases them at once. The tree can
+ * still be modified; memory dropped meanwhile is reclaimed with the document.
+ * *options* may be NULL for the defaults.
+ * Return NULL and set *error* value to true when parsing failed.
+ */
+JsonDocument *json_document_decode(
+    const char *text, size_t len, const JsonDecodeOptions *options, bool *error
+) {
+    JsonArena arena;
+    JsonDocument *document;
+    Lexer lexer;
+
+    // The tree usually takes about as much as the text, and the strings
+    // take at most that much again: small documents need a single chunk.
+    jsonarena_init(&arena, sizeof (JsonDocument) + 3 * len);
+    if (!(document = jsonarena_alloc(&arena, sizeof (JsonDocument)))) {
+        jsonerror_set(
+            &lexer.error, JSON_ERROR_MEMORY, "insufficient memory", 0
+        );
+        jsonerror_report(&lexer.error);
+        *error = true;
+        return NULL;
+    }
+    // The document lives in its own arena, and containers keep a pointer to
+    // it to grow later, so the tree has to be decoded into that copy.
+    document->_arena = arena;
+    lexer_init(&lexer, text, len);
+    document->root = decoder_decode(&lexer, options, &document->_arena, error);
+    if (*error) {
+        arena = document->_arena;
+        jsonarena_free(&arena);
+        jsonerror_locate(&lexer.error, text, len);
+        jsonerror_report(&lexer.error);
+        return NULL;
+    }
+    document->_arenas = NULL;
+    document->_narenas = 0;
+    document->_text = NULL;
+    document->_text_len = 0;
+    return document;
+}
+
+// What an empty file maps to, there being nothing to map.
+static char _json_empty_file[1];
+
+#if defined(_WIN32)
+
+/** Without mmap(), read the file into a buffer of the same lifetime. */
+static void *_json_map_file(const char *path, size_t *len) {
+    FILE *stream = fopen(path, "rb");
+    char *text = NULL;
+    long size = -1;
+
+    if (!stream) {
+        return NULL;
+    }
+    if (fseek(stream, 0, SEEK_END) == 0 && (size = ftell(stream)) == 0) {
+        // Empty text, for the decoder to report as such.
+        text = _json_empty_file;
+        *len = 0;
+    } else if (size > 0 && fseek(stream, 0, SEEK_SET) == 0
+            && (text = malloc(size))) {
+        if (fread(text, 1, size, stream) != (size_t) size) {
+            free(text);
+            text = NULL;
+        }
+        *len = size;
+    }
+    fclose(stream);
+    return text;
+}
+
+static void _json_unmap_file(void *text, size_t len) {
+    if (len) {
+        free(text);
+    }
+}
+
+#else
+
+/** Map the file read-only; pages come straight from the page cache. */
+static void *_json_map_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    void *text = NULL;
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0) {
+        st.st_size = -1;
+    }
+    if (st.st_size == 0) {
+        // mmap() takes no empty range: the decoder sees empty text instead.
+        text = _json_empty_file;
+        *len = 0;
+    } else if (st.st_size > 0) {
+        text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            text = NULL;
+        } else {
+            // The parser goes through it once, front to back.
+            madvise(text, st.st_size, MADV_SEQUENTIAL);
+            *len = st.st_size;
+        }
+    }
+    // The mapping holds its own reference to the file.
+    close(fd);
+    return text;
+}
+
+static void _json_unmap_file(void *text, size_t len) {
+    if (len) {
+        munmap(text, len);
+    }
+}
 
-/** Test equqlity between JsonValue.
- * Arrays and Objects are recursively tested.
+#endif
+
+/** Decode the JSON file at *path* into a new document, without reading it.
+ *
+ * The file is mapped and parsed where it lies, instead of being read into
+ * a buffer first. The mapping is released along with the document.
+ * *options* may be NULL for the defaults.
+ * Return NULL and set *error* value to true when mapping or parsing failed.
  */
-bool jsonval_equal(JsonValue *a, JsonValue *b) {
-    bool equal;
-    int numeric = 0;
-    JsonValueType type_a = a->type;
-    JsonValueType type_b = b->type;
-    JsonValue *val_a;
-    JsonValue *val_b;
-
-    if (type_a != type_b) {
-        return false;
+JsonDocument *json_mmap_decode(
+    const char *path, const JsonDecodeOptions *options, bool *error
+) {
+    JsonDocument *document;
+    JsonError map_error;
+    size_t len = 0;
+    char *text;
+
+    if (!(text = _json_map_file(path, &len))) {
+        jsonerror_set(&map_error, JSON_ERROR_IO, "cannot map file", 0);
+        jsonerror_report(&map_error);
+        *error = true;
+        return NULL;
+    }
+    if (!(document = json_document_decode(text, len, options, error))) {
+        _json_unmap_file(text, len);
+        return NULL;
     }
+    document->_text = text;
+    document->_text_len = len;
+    return document;
+}
 
-    switch (type_a) {
-        case JSON_NULL:
-            equal = true;
-            break;
-        case JSON_BOOL:
-            equal = !!a->value.as_bool == !!b->value.as_bool;
-            break;
-        case JSON_NUMBER:
-            equal = a->value.as_num == b->value.as_num;
-            break;
-        case JSON_STRING:
-            equal = strcmp(a->value.as_str, b->value.as_str) == 0;
-            break;
-        case JSON_ARRAY:
-            JsonArray *arr_a = a->value.as_arr;
-            JsonArray *arr_b = b->value.as_arr;
-            if (arr_a->len != arr_b->len) {
-                equal = false;
-            } else {
-                // Need to check each element.
-                equal = true;
-                size_t len = arr_a->len;
-                for (size_t i = 0; i < len; i++) {
-                    val_a = jsonarr_getitem(arr_a, i);
-                    val_b = jsonarr_getitem(arr_b, i);
-                    if (!jsonval_equal(val_a, val_b)) {
-                        equal = false;
-                        break;
-                    }
-                }
-            }
-            break;
-        case JSON_OBJECT:
-            JsonObject *obj_a = a->value.as_obj;
-            JsonObject *obj_b = b->value.as_obj;
-            JsonObjectIterator *iter;
-            if (obj_a->len != obj_b->len) {
-                equal = false;
-            } else {
-                if (!(iter = jsonobj_iter(obj_a))) {
-                    equal = false;
-                } else {
-                    equal = true;
-                    while (jsonobj_next(iter)) {
-                        val_a = iter->value;
-                        if (!jsonobj_contains(obj_b, iter->key)) {
-                            equal = false;
-                            break;
-                        }
-                        val_b = jsonobj_getitem(obj_b, iter->key);
-                        if (!jsonval_equal(val_a, val_b)) {
-                            equal = false;
-                            break;
-                        }
-                    }
-                }
-            }
+/** Release a document and its whole tree. */
+void json_document_free(JsonDocument *document) {
+    // Copy the arena out first, since it frees the document with the rest.
+    JsonArena arena = document->_arena;
+
+    if (document->_text) {
+        _json_unmap_file(document->_text, document->_text_len);
+    }
+    for (size_t i = 0; i < document->_narenas; i++) {
+        jsonarena_free(&document->_arenas[i]);
+    }
+    jsonarena_free(&arena);
+}
+
+/** Decode JSON text read from *stream* until EOF.
+ *
+ * The stream is read in fixed-size chunks fed to a JsonParser, so memory
+ * does not depend on the size of the text, only on the tree.
+ * Set *error* value to true when reading or parsing failed.
+ */
+JsonValue json_fdecode(FILE *stream, bool *error) {
+    char buf[JSON_FDECODE_BUFSIZE];
+    JsonValue value = { JSON_NULL };
+    JsonParser *parser = json_parser_construct(NULL);
+    JsonError read_error;
+    size_t len;
+
+    if (!parser) {
+        jsonerror_set(
+            &read_error, JSON_ERROR_MEMORY, "insufficient memory", 0
+        );
+        jsonerror_report(&read_error);
+        *error = true;
+        return value;
+    }
+    while ((len = fread(buf, 1, sizeof buf, stream))) {
+        if (json_parser_feed(parser, buf, len) == JSON_PARSER_ERROR) {
             break;
+        }
     }
-    return equal;
+    if (ferror(stream)) {
+        jsonerror_set(&read_error, JSON_ERROR_IO, "cannot read stream", 0);
+        jsonerror_report(&read_error);
+        *error = true;
+    } else {
+        // The parser reports its own errors.
+        *error = !json_parser_finish(parser, &value);
+    }
+    json_parser_destruct(parser);
+    return value;
 }
 
 
-/** Decode JSON string and return as a pointer to JsonValue.
+/** Encode *item* into a new string, as JSON_ENCODE_* *flags* say, and
+ * store its length in *len* unless it is NULL.
  *
- * Set *error* value to true when parsing failed.
- * *text* is not destroyed after decoding.
+ * Return NULL when memory is low. The string is to be released with free().
  */
-JsonValue json_sdecode(char *text, bool *error) {
-    bool _error;
-    Lexer *lexer = lexer_construct(text);
-    JsonValue jsval = _json_decode(lexer, &_error);
-    *error = _error;
-    return jsval;
+char *json_sencode(JsonValue *item, unsigned int flags, size_t *len) {
+    Encoder encoder;
+
+    encoder_init(&encoder, flags);
+    if (_json_encode(&encoder, item)) {
+        encoder_putc(&encoder, 0);
+    } else {
+        encoder.error = JSON_ERROR_MEMORY;
+    }
+    if (encoder.error) {
+        free(encoder.buf);
+        _json_encoder_report(&encoder, NULL);
+        return NULL;
+    }
+    if (len) {
+        *len = encoder.len - 1;
+    }
+    return encoder.buf;
+}
+
+/** Encode *item* into the *size* bytes at *buf*, terminated, as snprintf()
+ * would, and as JSON_ENCODE_* *flags* say.
+ *
+ * Return the length of the whole text, terminator excluded: if that is
+ * *size* or more, the text was cut short, and a NULL *buf* with a zero
+ * *size* only measures it. Return SIZE_MAX when memory is low, which only
+ * happens to documents nested deeper than a few dozen levels.
+ */
+size_t json_sencode_into(
+    char *buf, size_t size, JsonValue *item, unsigned int flags
+) {
+    Encoder encoder;
+
+    encoder_init_fixed(&encoder, buf, size ? size - 1 : 0, flags);
+    if (!_json_encode(&encoder, item)) {
+        return SIZE_MAX;
+    }
+    if (size) {
+        buf[encoder.len] = 0;
+    }
+    return encoder.len + encoder.dropped;
+}
+
+/** Output JsonValue object to file, as JSON_ENCODE_* *flags* say.
+ *
+ * Strings are written as raw UTF-8 by default. Passing true is the same as
+ * JSON_ENCODE_PRETTY. The text goes through a buffer, and is written out
+ * in large blocks. Return false if the stream could not be written.
+ */
+bool json_fencode(FILE *stream, JsonValue *item, unsigned int flags) {
+    JsonSink sink = { _json_file_write, stream };
+    Encoder encoder;
+    bool done;
+
+    encoder_init_sink(&encoder, &sink, flags, true);
+    done = _json_encode(&encoder, item);
+    if (done && !encoder_flush(&encoder)) {
+        _json_encoder_report(&encoder, "cannot write stream");
+        done = false;
+    }
+    encoder_release(&encoder);
+    return done;
+}
+
+/** Construct an encoder of *item* into *sink*, as JSON_ENCODE_* *flags*
+ * say, or return NULL.
+ *
+ * Nothing is written until json_encoder_resume(). *item* must not change
+ * until encoding is over.
+ */
+JsonEncoder *json_encoder_construct(
+    JsonValue *item, unsigned int flags, JsonSink sink
+) {
+    JsonEncoder *encoder = malloc(sizeof (JsonEncoder));
+    JsonError error;
+
+    if (!encoder) {
+        jsonerror_set(&error, JSON_ERROR_MEMORY, "insufficient memory", 0);
+        jsonerror_report(&error);
+        return NULL;
+    }
+    encoder->sink = sink;
+    encoder_init_sink(&encoder->encoder, &encoder->sink, flags, true);
+    _json_stack_init(&encoder->stack);
+    encoder->item = item;
+    encoder->status = JSON_ENCODER_MORE;
+    return encoder;
+}
+
+/** Encode until the text is over or the sink is full.
+ *
+ * Return JSON_ENCODER_DONE once the sink has taken the whole text,
+ * JSON_ENCODER_MORE when it is full, to be called again once the sink can
+ * take more, or JSON_ENCODER_ERROR, which sticks. While paused, the encoder
+ * only holds what the sink did not take, and the value it was writing.
+ */
+JsonEncoderStatus json_encoder_resume(JsonEncoder *encoder) {
+    Encoder *output = &encoder->encoder;
+
+    if (encoder->status != JSON_ENCODER_MORE) {
+        return encoder->status;
+    }
+    // What the sink did not take last time goes first.
+    if (encoder_flush(output) && encoder->item) {
+        if (!_json_encode_walk(output, &encoder->stack, &encoder->item)) {
+            encoder->status = JSON_ENCODER_ERROR;
+            return encoder->status;
+        }
+        if (!encoder->item) {
+            encoder_flush(output);
+        }
+    }
+    if (output->error) {
+        _json_encoder_report(output, "cannot write to sink");
+        encoder->status = JSON_ENCODER_ERROR;
+    } else if (!output->paused && !encoder->item) {
+        encoder->status = JSON_ENCODER_DONE;
+    }
+    return encoder->status;
 }
 
-JsonValue *json_fdecode(FILE *json_r) {}
+/** Destruct the encoder, whether it is done or not. */
+void json_encoder_destruct(JsonEncoder *encoder) {
+    _json_stack_free(&encoder->stack);
+    encoder_release(&encoder->encoder);
+    free(encoder);
+}
 
+/** A sink that writes to the file descriptor *fd* with writev().
+ *
+ * The sink is full when a non-blocking *fd* would block.
+ */
+JsonSink json_fd_sink(int fd) {
+    JsonSink sink = { _json_fd_write, (void *) (intptr_t) fd };
 
-/** Output JsonValue object to file, with optional formatting. */
-void json_fencode(FILE *stream, JsonValue *item, bool pretty) {
-    _json_fencode(stream, item, pretty, 0);
+    return sink;
+}
+
+/** Write *item* to the file descriptor *fd*, as JSON_ENCODE_* *flags* say,
+ * and report success.
+ *
+ * Long strings go out from the tree, uncopied. A non-blocking *fd* is
+ * waited for whenever it is full.
+ */
+bool json_fdencode(int fd, JsonValue *item, unsigned int flags) {
+    JsonEncoder *encoder = json_encoder_construct(
+        item, flags, json_fd_sink(fd)
+    );
+    JsonEncoderStatus status;
+
+    if (!encoder) {
+        return false;
+    }
+    while ((status = json_encoder_resume(encoder)) == JSON_ENCODER_MORE) {
+        _json_wait_writable(fd);
+    }
+    json_encoder_destruct(encoder);
+    return status == JSON_ENCODER_DONE;
 }
@@ -13,7 +13,10 @@ typedef enum JsonValueType {
     JSON_NUMBER,
     JSON_STRING,
     JSON_ARRAY,
-    JSON_OBJECT
+    JSON_OBJECT,
+    // Only produced with JSON_DECODE_INTEGERS.
+    JSON_INTEGER,
+    JSON_UNSIGNED
 } JsonValueType;
 
 
@@ -21,6 +24,8 @@ typedef struct JsonValue JsonValue;
 typedef struct JsonArray JsonArray;
 typedef struct JsonObjectEntry JsonObjectEntry;
 typedef struct JsonObject JsonObject;
+typedef struct JsonArena JsonArena;
+typedef struct _JsonArenaChunk _JsonArenaChunk;
 
 
 struct JsonValue {
@@ -28,6 +33,9 @@ struct JsonValue {
     union _JsonValue {
         bool as_bool;
         double as_num;
+        int64_t as_int;
+        // Only for integers above INT64_MAX.
+        uint64_t as_uint;
         char *as_str;
         JsonArray *as_arr;
         JsonObject *as_obj;
@@ -35,10 +43,26 @@ struct JsonValue {
 };
 
 
+/**
+ * A bump allocator. Containers constructed in an arena take all of their
+ * memory from it, and never free anything themselves.
+ */
+struct JsonArena {
+    char *_ptr;
+    char *_end;
+    // The most recent allocation, which can be resized in place.
+    char *_last;
+    bool _last_is_chunk;
+    size_t _next_size;
+    _JsonArenaChunk *_chunks;
+};
+
+
 struct JsonArray {
     size_t len;
     size_t _cap;
     JsonValue *_data;
+    JsonArena *_arena;
 };
 
 typedef struct JsonArrayIterator {
@@ -48,43 +72,256 @@ typedef struct JsonArrayIterator {
 } JsonArrayIterator;
 
 
-// 64-bit modulo is known to be slow yet.
 typedef uint_fast64_t JsonObjectKeyHash;
-typedef JsonObjectKeyHash (*JsonObjectHashFunction)(void *data);
+// Hash the *len* bytes at *data*, which may not be terminated.
+typedef JsonObjectKeyHash (*JsonObjectHashFunction)(
+    const void *data, size_t len
+);
 
 struct JsonObjectEntry {
     char *key;
+    // The length of *key*, which lookups compare before the bytes.
+    size_t key_len;
     JsonObjectKeyHash _hash;
     JsonValue value;
 };
 
-typedef struct _JsonObjectBucket {
-    JsonObjectEntry entry;
-    struct _JsonObjectBucket *next;
-} _JsonObjectBucket;
-
+/**
+ * Objects keep their entries in *_entries*, in the order they were added,
+ * and find them through an open-addressed index of *_cap* slots, a power
+ * of two.
+ *
+ * Each slot of the index has a control byte in *_ctrl*: 7 bits of the
+ * hash of its key, or a mark for a slot that is empty or was deleted from.
+ * Lookups compare 16 control bytes at once, and only look at entries whose
+ * bits match. The first control bytes are repeated after the last, so that
+ * 16 can be loaded from any slot.
+ *
+ * The slots that are taken hold the position of their entry in *_index*,
+ * as 8, 16 or 32 bits depending on *_cap*. There is room for 2/3 as many
+ * entries as slots. Deleting an entry leaves a hole, with a NULL key, until
+ * the entries are packed again.
+ */
 struct JsonObject {
     size_t len;
     size_t _cap;
+    // Entries added, holes included.
+    size_t _nentries;
     JsonObjectHashFunction _hasher;
-    _JsonObjectBucket **_data;
+    JsonObjectEntry *_entries;
+    void *_index;
+    unsigned char *_ctrl;
+    JsonArena *_arena;
 };
 
 typedef struct JsonObjectIterator {
     char *key;
+    size_t key_len;
     JsonValue *value;
     size_t index;
     size_t _index;
     JsonObject *_obj;
-    _JsonObjectBucket *_bucket;
 } JsonObjectIterator;
 
 
+/** Decode integral numbers that fit 64 bits as JSON_INTEGER or
+ * JSON_UNSIGNED instead of doubles, so identifiers above 2^53 survive.
+ */
+#define JSON_DECODE_INTEGERS        0x1
+
+/** Indent the output, one member or element per line. */
+#define JSON_ENCODE_PRETTY          0x1
+
+/** Write everything outside ASCII as "\u" escapes, surrogate pairs beyond
+ * the BMP, instead of raw UTF-8.
+ */
+#define JSON_ENCODE_ASCII           0x2
+
+/** How many arrays and objects may be open at once, unless told otherwise. */
+#define JSON_DEFAULT_MAX_DEPTH      1024
+
+typedef struct JsonDecodeOptions {
+    unsigned int flags;
+    // Deeper documents are rejected. Zero is JSON_DEFAULT_MAX_DEPTH.
+    size_t max_depth;
+} JsonDecodeOptions;
+
+
+/** Why decoding or validation failed. */
+typedef enum JsonErrorCode {
+    JSON_ERROR_NONE,
+    // The text ends before the value does.
+    JSON_ERROR_EOF,
+    // A character that starts no value, NUL included.
+    JSON_ERROR_CHARACTER,
+    // A bad escape, a control character or invalid UTF-8 in a string.
+    JSON_ERROR_STRING,
+    JSON_ERROR_NUMBER,
+    JSON_ERROR_LITERAL,
+    // A missing or misplaced ',', ':', key or bracket.
+    JSON_ERROR_SYNTAX,
+    JSON_ERROR_DEPTH,
+    // Something else than whitespace after the document.
+    JSON_ERROR_TRAILING,
+    JSON_ERROR_MEMORY,
+    // The file could not be read.
+    JSON_ERROR_IO
+} JsonErrorCode;
+
+/** What went wrong, and where. */
+typedef struct JsonError {
+    JsonErrorCode code;
+    // A short description, statically allocated.
+    const char *message;
+    // Bytes from the start of the text.
+    size_t offset;
+    // Both count from 1, columns in bytes. Zero when the text is not at
+    // hand to find them, like for the push parser.
+    size_t line;
+    size_t column;
+} JsonError;
+
+
+/** A decoded tree along with the arena that holds all of it. */
+typedef struct JsonDocument {
+    JsonValue root;
+    JsonArena _arena;
+    // Those of the threads of json_document_decode_parallel(), if any.
+    JsonArena *_arenas;
+    size_t _narenas;
+    // The mapped text, for json_mmap_decode().
+    void *_text;
+    size_t _text_len;
+} JsonDocument;
+
+
+/**
+ * A position on a value of some JSON text, which is only parsed when asked.
+ * Cursors made from the same root share its lexer, so they are not to be
+ * used from several threads.
+ */
+typedef struct JsonCursor {
+    struct Lexer *_lexer;
+    size_t _pos;
+    // Arrays: the element last returned. Objects: where the next lookup
+    // starts. Zero before the first.
+    size_t _next;
+} JsonCursor;
+
+
+/**
+ * Callbacks for json_sax_parse(), all optional. Each one returns false to
+ * stop parsing right away.
+ *
+ * Strings and keys are unescaped but not NUL-terminated, and only valid
+ * during the call.
+ */
+typedef struct JsonHandler {
+    bool (*on_null)(void *ctx);
+    bool (*on_bool)(void *ctx, bool value);
+    bool (*on_number)(void *ctx, double value);
+    bool (*on_string)(void *ctx, const char *str, size_t len);
+    bool (*on_start_object)(void *ctx);
+    bool (*on_key)(void *ctx, const char *key, size_t len);
+    bool (*on_end_object)(void *ctx);
+    bool (*on_start_array)(void *ctx);
+    bool (*on_end_array)(void *ctx);
+} JsonHandler;
+
+
+/** Records decoded from newline-delimited JSON, in input order.
+ *
+ * Each decoding thread has an arena of its own, holding the trees of the
+ * records it decoded.
+ */
+typedef struct JsonLines {
+    size_t len;
+    JsonValue *values;
+    JsonArena *_arenas;
+    size_t _narenas;
+} JsonLines;
+
+
+/** Progress of a JsonParser after a chunk. */
+typedef enum JsonParserStatus {
+    // The document is not complete yet.
+    JSON_PARSER_MORE,
+    // The document is complete; only whitespace may follow.
+    JSON_PARSER_DONE,
+    JSON_PARSER_ERROR
+} JsonParserStatus;
+
+/** A push parser, fed the text in chunks of any size. See pushparser.h. */
+typedef struct JsonParser JsonParser;
+
+
+/** A run of encoded text handed to a JsonSink. */
+typedef struct JsonChunk {
+    const char *data;
+    size_t len;
+} JsonChunk;
+
+/** Where a JsonEncoder sends the text, through *write*, given *ctx*.
+ *
+ * *write* is handed *count* chunks to take in order, as writev() would,
+ * and returns how many bytes it took. Taking fewer, none included, means
+ * it is full for now: encoding pauses until it is resumed, and the rest is
+ * handed again then. SIZE_MAX means it failed for good.
+ * Long strings of a tree are handed as they are, so the tree must not
+ * change until encoding is over. A JsonWriter copies them all.
+ */
+typedef struct JsonSink {
+    size_t (*write)(void *ctx, const JsonChunk *chunks, size_t count);
+    void *ctx;
+} JsonSink;
+
+/** Progress of a JsonEncoder. */
+typedef enum JsonEncoderStatus {
+    // The sink is full: resume once it can take more.
+    JSON_ENCODER_MORE,
+    // The whole text has been taken by the sink.
+    JSON_ENCODER_DONE,
+    JSON_ENCODER_ERROR
+} JsonEncoderStatus;
+
+/** An encoder that writes to a JsonSink, and pauses when the sink is full.
+ */
+typedef struct JsonEncoder JsonEncoder;
+
+/** A writer that encodes a document call by call, without a tree. See
+ * writer.h.
+ */
+typedef struct JsonWriter JsonWriter;
+
+
+/** Check that *len* bytes of *text* are one well-formed JSON document.
+ *
+ * Nothing is allocated and no tree is built. Nesting deeper than
+ * JSON_DEFAULT_MAX_DEPTH is an error.
+ * Return true if the text is valid. Otherwise, fill *error* unless it is
+ * NULL, and return false.
+ */
+bool json_validate(const char *text, size_t len, JsonError *error);
+
+/** Return the last error of this thread, from a function that set its
+ * *error* value to true.
+ *
+ * Nothing in the library prints errors; this is where they go.
+ */
+const JsonError *json_last_error(void);
+
 /** Test equqlity between JsonValue.
  * Arrays and Objects are recursively tested.
  */
 bool jsonval_equal(JsonValue *a, JsonValue *b);
 
+/** Free everything *value* holds, recursively.
+ *
+ * This is for trees decoded with json_sdecode() or json_ndecode(). Documents
+ * are released with json_document_free() instead.
+ */
+void jsonval_destruct(JsonValue *value);
+
 /** Decode JSON string and return as a pointer to JsonValue.
  *
  * Set *error* value to true when parsing failed.
@@ -92,11 +329,328 @@ bool jsonval_equal(JsonValue *a, JsonValue *b);
  */
 JsonValue json_sdecode(char *text, bool *error);
 
-/** Output JsonValue object to file, with optional formatting. */
-void json_fencode(FILE *stream, JsonValue *item, bool pretty);
+/** Decode *len* bytes of JSON text in place, without copying it.
+ *
+ * *text* needs not be NUL-terminated, so a slice of a larger buffer is fine.
+ * *options* may be NULL for the defaults.
+ * Set *error* value to true when parsing failed.
+ */
+JsonValue json_ndecode(
+    const char *text, size_t len, const JsonDecodeOptions *options, bool *error
+);
+
+/** Decode *len* bytes of JSON text into a new document.
+ *
+ * Arrays, objects, keys and strings of the tree all come from the arena of
+ * the document, so json_document_free() releases them at once. The tree can
+ * still be modified; memory dropped meanwhile is reclaimed with the document.
+ * *options* may be NULL for the defaults.
+ * Return NULL and set *error* value to true when parsing failed.
+ */
+JsonDocument *json_document_decode(
+    const char *text, size_t len, const JsonDecodeOptions *options, bool *error
+);
+
+/** Decode the JSON file at *path* into a new document, without reading it.
+ *
+ * The file is mapped and parsed where it lies, instead of being read into
+ * a buffer first. The mapping is released along with the document.
+ * *options* may be NULL for the defaults.
+ * Return NULL and set *error* value to true when mapping or parsing failed.
+ */
+JsonDocument *json_mmap_decode(
+    const char *path, const JsonDecodeOptions *options, bool *error
+);
+
+/** Decode *len* bytes of JSON text into a new document, splitting the
+ * elements of an array at the root between up to *workers* threads.
+ *
+ * Zero picks the number of processors. The elements are found with the
+ * structural index first, then each thread decodes a range of them into an
+ * arena of its own, straight into their slots of the root array. Other
+ * documents, and small ones, are decoded as with json_document_decode().
+ * *options* may be NULL for the defaults.
+ * Return NULL and set *error* value to true when parsing failed.
+ */
+JsonDocument *json_document_decode_parallel(
+    const char *text,
+    size_t len,
+    const JsonDecodeOptions *options,
+    size_t workers,
+    bool *error
+);
+
+/** Release a document and its whole tree. */
+void json_document_free(JsonDocument *document);
+
+/** Construct a parser waiting for its first chunk, or return NULL.
+ *
+ * *options* may be NULL for the defaults.
+ */
+JsonParser *json_parser_construct(const JsonDecodeOptions *options);
+
+/** Parse the next *len* bytes of text, which may cut tokens anywhere.
+ *
+ * Return JSON_PARSER_DONE once the document is complete, after which only
+ * whitespace may follow, JSON_PARSER_MORE while it is not, or
+ * JSON_PARSER_ERROR, which sticks.
+ */
+JsonParserStatus json_parser_feed(
+    JsonParser *parser, const char *buf, size_t len
+);
+
+/** Tell the parser the text is over, and hand over the document.
+ *
+ * Return false if the document is incomplete or invalid. Otherwise, *value*
+ * belongs to the caller, to be freed with jsonval_destruct().
+ */
+bool json_parser_finish(JsonParser *parser, JsonValue *value);
+
+/** Destruct the parser along with whatever it has decoded and not handed
+ * over yet.
+ */
+void json_parser_destruct(JsonParser *parser);
+
+/** Decode JSON text read from *stream* until EOF.
+ *
+ * The stream is read in fixed-size chunks fed to a JsonParser, so memory
+ * does not depend on the size of the text, only on the tree.
+ * Set *error* value to true when reading or parsing failed.
+ */
+JsonValue json_fdecode(FILE *stream, bool *error);
+
+/** Decode *len* bytes of newline-delimited JSON, one record per line.
+ *
+ * The text is split into ranges of whole lines, decoded in parallel by up
+ * to *workers* threads, each into an arena of its own. Zero picks the number
+ * of processors. Blank lines are skipped.
+ * *options* may be NULL for the defaults.
+ * Return the records in input order, or NULL and set *error* value to true
+ * when any of them failed to decode.
+ */
+JsonLines *json_decode_lines(
+    const char *text,
+    size_t len,
+    const JsonDecodeOptions *options,
+    size_t workers,
+    bool *error
+);
+
+/** Release the records and all of their trees. */
+void json_lines_free(JsonLines *lines);
+
+/** Parse *len* bytes of JSON text, calling *handler* for every event.
+ *
+ * No tree is built. Return true once the whole document has gone through
+ * the handler. Return false if the text is invalid, setting *error* value
+ * to true, or if a callback returned false, leaving *error* false.
+ */
+bool json_sax_parse(
+    const char *text,
+    size_t len,
+    const JsonHandler *handler,
+    void *ctx,
+    bool *error
+);
+
+/** Construct a cursor on the root value of *len* bytes of *text*.
+ *
+ * The text is borrowed, and must outlive the cursor and those made from it.
+ * Return NULL when memory is low.
+ */
+JsonCursor *json_cursor_construct(const char *text, size_t len);
+
+/** Destruct a cursor from json_cursor_construct(), which invalidates every
+ * cursor made from it.
+ */
+void json_cursor_destruct(JsonCursor *cursor);
+
+/** Tell the type of the value under the cursor from its first character.
+ *
+ * Numbers are JSON_NUMBER. Nothing is validated, and anything that starts
+ * no value is JSON_NULL.
+ */
+JsonValueType json_cursor_type(JsonCursor *cursor);
+
+/** Point *field* to the value of *key* in the object under *object*.
+ *
+ * Members are looked at in order from where the previous lookup in this
+ * object stopped, wrapping around once, so fields read in document order
+ * take a single pass. Values of other members are skipped by bracket
+ * matching. Return false if there is no such key, or *object* is not an
+ * object.
+ */
+bool json_cursor_find_field(
+    JsonCursor *object, const char *key, JsonCursor *field
+);
+
+/** Point *element* to the next element of the array under *array*.
+ *
+ * The first call gives the first element. On the next ones, *element* is
+ * expected to be the cursor from the previous call: the previous element is
+ * skipped by bracket matching, from as far as it has been looked into.
+ * Return false past the last element, or if *array* is not an array.
+ */
+bool json_cursor_next_element(JsonCursor *array, JsonCursor *element);
+
+/** Convert the number under the cursor to a double and report success. */
+bool json_cursor_get_double(JsonCursor *cursor, double *value);
+
+/** Store the number under the cursor in *value* and report success, which
+ * needs an integral number that fits int64_t.
+ */
+bool json_cursor_get_int64(JsonCursor *cursor, int64_t *value);
+
+/** Store the boolean under the cursor in *value* and report success. */
+bool json_cursor_get_bool(JsonCursor *cursor, bool *value);
+
+/** Return a newly allocated, unescaped copy of the string under the cursor
+ * and store its length in *len*, or return NULL.
+ */
+char *json_cursor_get_string(JsonCursor *cursor, size_t *len);
+
+/** Decode the whole value under the cursor, as json_ndecode() would.
+ *
+ * *options* may be NULL for the defaults. Set *error* value to true when
+ * parsing failed; the error is located in the whole text.
+ */
+JsonValue json_cursor_decode(
+    JsonCursor *cursor, const JsonDecodeOptions *options, bool *error
+);
+
+/** Encode *item* into a new string, as JSON_ENCODE_* *flags* say, and
+ * store its length in *len* unless it is NULL.
+ *
+ * Return NULL when memory is low. The string is to be released with free().
+ */
+char *json_sencode(JsonValue *item, unsigned int flags, size_t *len);
+
+/** Encode *item* into the *size* bytes at *buf*, terminated, as snprintf()
+ * would, and as JSON_ENCODE_* *flags* say.
+ *
+ * Return the length of the whole text, terminator excluded: if that is
+ * *size* or more, the text was cut short, and a NULL *buf* with a zero
+ * *size* only measures it. Return SIZE_MAX when memory is low, which only
+ * happens to documents nested deeper than a few dozen levels.
+ */
+size_t json_sencode_into(
+    char *buf, size_t size, JsonValue *item, unsigned int flags
+);
+
+/** Output JsonValue object to file, as JSON_ENCODE_* *flags* say.
+ *
+ * Strings are written as raw UTF-8 by default. Passing true is the same as
+ * JSON_ENCODE_PRETTY. The text goes through a buffer, and is written out
+ * in large blocks. Return false if the stream could not be written.
+ */
+bool json_fencode(FILE *stream, JsonValue *item, unsigned int flags);
+
+/** Construct an encoder of *item* into *sink*, as JSON_ENCODE_* *flags*
+ * say, or return NULL.
+ *
+ * Nothing is written until json_encoder_resume(). *item* must not change
+ * until encoding is over.
+ */
+JsonEncoder *json_encoder_construct(
+    JsonValue *item, unsigned int flags, JsonSink sink
+);
+
+/** Encode until the text is over or the sink is full.
+ *
+ * Return JSON_ENCODER_DONE once the sink has taken the whole text,
+ * JSON_ENCODER_MORE when it is full, to be called again once the sink can
+ * take more, or JSON_ENCODER_ERROR, which sticks. While paused, the encoder
+ * only holds what the sink did not take, and the value it was writing.
+ */
+JsonEncoderStatus json_encoder_resume(JsonEncoder *encoder);
+
+/** Destruct the encoder, whether it is done or not. */
+void json_encoder_destruct(JsonEncoder *encoder);
+
+/** A sink that writes to the file descriptor *fd* with writev().
+ *
+ * The sink is full when a non-blocking *fd* would block.
+ */
+JsonSink json_fd_sink(int fd);
+
+/** Write *item* to the file descriptor *fd*, as JSON_ENCODE_* *flags* say,
+ * and report success.
+ *
+ * Long strings go out from the tree, uncopied. A non-blocking *fd* is
+ * waited for whenever it is full.
+ */
+bool json_fdencode(int fd, JsonValue *item, unsigned int flags);
+
+/** Construct a writer into a buffer of its own, as JSON_ENCODE_* *flags*
+ * say, or return NULL.
+ *
+ * A document is written as a sequence of calls: json_writer_begin_object(),
+ * then json_writer_key() and a value for each member, then
+ * json_writer_end_object(), and the same without keys for arrays. Each call
+ * returns false when it would not make valid JSON, or something failed,
+ * which sticks; json_last_error() tells why.
+ */
+JsonWriter *json_writer_construct(unsigned int flags);
+
+/** Construct a writer into *sink*, as JSON_ENCODE_* *flags* say, or return
+ * NULL.
+ *
+ * The text goes to the sink as the buffer fills up. While the sink is full,
+ * the writer keeps what it is written. Strings are copied, however long,
+ * so they can change as soon as the call returns.
+ */
+JsonWriter *json_writer_construct_sink(JsonSink sink, unsigned int flags);
+
+/** Destruct the writer, and whatever text it still holds. */
+void json_writer_destruct(JsonWriter *writer);
+
+bool json_writer_begin_object(JsonWriter *writer);
+bool json_writer_end_object(JsonWriter *writer);
+bool json_writer_begin_array(JsonWriter *writer);
+bool json_writer_end_array(JsonWriter *writer);
+
+/** Write the key of the next member of the innermost object. */
+bool json_writer_key(JsonWriter *writer, const char *key);
+
+bool json_writer_null(JsonWriter *writer);
+bool json_writer_bool(JsonWriter *writer, bool value);
+
+/** Write *value* as its shortest round-trip digits, or null if it is not
+ * finite.
+ */
+bool json_writer_double(JsonWriter *writer, double value);
+
+bool json_writer_int64(JsonWriter *writer, int64_t value);
+bool json_writer_uint64(JsonWriter *writer, uint64_t value);
+
+/** Write the UTF-8 string *str*, escaped. */
+bool json_writer_string(JsonWriter *writer, const char *str);
+
+/** Hand what the writer holds to its sink, and report whether the sink took
+ * all of it.
+ */
+bool json_writer_flush(JsonWriter *writer);
+
+/** Check that the document is complete, and hand the rest of it to the
+ * sink, if any.
+ *
+ * Return false if the document is incomplete, something failed, or the sink
+ * did not take all of the text. A sink that is full still holds back part
+ * of it: json_writer_flush() is to be called again once it can take more,
+ * until it returns true.
+ */
+bool json_writer_finish(JsonWriter *writer);
+
+/** The text written so far into the buffer of the writer, terminated, and
+ * its length in *len* unless it is NULL.
+ *
+ * It belongs to the writer, and is valid until the next call. Return NULL
+ * for a writer into a sink, or when memory is low.
+ */
+const char *json_writer_text(JsonWriter *writer, size_t *len);
 
-/** Implements 32-bit FNV-1a hash algorithm. Expects string as input.*/
-JsonObjectKeyHash json_default_hasher(void *data);
+/** Hash the *len* bytes at *data* 8 bytes at a time, after wyhash. */
+JsonObjectKeyHash json_default_hasher(const void *data, size_t len);
 
 
 #endif
@@ -0,0 +1,157 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "jsonarena.h"
+
+
+#define JSONARENA_ALIGN             16
+#define JSONARENA_MIN_CHUNK         4096
+#define JSONARENA_MAX_CHUNK         (64 * 1024 * 1024)
+#define JSONARENA_GROW_FACTOR       2
+
+
+/** Chunks are linked so they can all be freed; data follows the header. */
+struct _JsonArenaChunk {
+    _JsonArenaChunk *next;
+};
+
+#define _JSONARENA_ROUND(size)      \
+    (((size) + JSONARENA_ALIGN - 1) & ~(size_t) (JSONARENA_ALIGN - 1))
+
+#define _JSONARENA_HEADER           _JSONARENA_ROUND(sizeof (_JsonArenaChunk))
+
+
+static inline char *_jsonarena_data(_JsonArenaChunk *chunk) {
+    return (char *) chunk + _JSONARENA_HEADER;
+}
+
+/** Allocate *size* bytes, which do not fit in the current chunk. */
+static void *_jsonarena_alloc_slow(JsonArena *arena, size_t size) {
+    size_t chunk_size = arena->_next_size;
+    _JsonArenaChunk *chunk;
+
+    if (size > chunk_size / 2) {
+        // Big blocks get a chunk of their own, so the current one is not
+        // wasted, and they can be resized with realloc() later.
+        if (!(chunk = malloc(_JSONARENA_HEADER + size))) {
+            return NULL;
+        }
+        chunk->next = arena->_chunks;
+        arena->_chunks = chunk;
+        arena->_last = _jsonarena_data(chunk);
+        arena->_last_is_chunk = true;
+        return arena->_last;
+    }
+
+    if (!(chunk = malloc(_JSONARENA_HEADER + chunk_size))) {
+        return NULL;
+    }
+    chunk->next = arena->_chunks;
+    arena->_chunks = chunk;
+    arena->_ptr = _jsonarena_data(chunk);
+    arena->_end = arena->_ptr + chunk_size;
+    if (chunk_size < JSONARENA_MAX_CHUNK) {
+        arena->_next_size = chunk_size * JSONARENA_GROW_FACTOR;
+    }
+
+    arena->_last = arena->_ptr;
+    arena->_last_is_chunk = false;
+    arena->_ptr += size;
+    return arena->_last;
+}
+
+
+/** Prepare an empty arena. Nothing is allocated until the first request.
+ *
+ * *size_hint* is the size of the first chunk, for callers that know roughly
+ * how much they will need. Zero picks the default.
+ */
+void jsonarena_init(JsonArena *arena, size_t size_hint) {
+    arena->_ptr = NULL;
+    arena->_end = NULL;
+    arena->_last = NULL;
+    arena->_last_is_chunk = false;
+    if (size_hint < JSONARENA_MIN_CHUNK) {
+        size_hint = JSONARENA_MIN_CHUNK;
+    } else if (size_hint > JSONARENA_MAX_CHUNK) {
+        size_hint = JSONARENA_MAX_CHUNK;
+    }
+    arena->_next_size = _JSONARENA_ROUND(size_hint);
+    arena->_chunks = NULL;
+}
+
+/** Allocate *size* bytes, suitably aligned for any type, or return NULL.
+ *
+ * The memory is not zeroed, and cannot be freed except with the whole arena.
+ */
+void *jsonarena_alloc(JsonArena *arena, size_t size) {
+    // Zero-sized requests still get a distinct pointer.
+    size = _JSONARENA_ROUND(size ? size : 1);
+    if (size > (size_t) (arena->_end - arena->_ptr)) {
+        return _jsonarena_alloc_slow(arena, size);
+    }
+    arena->_last = arena->_ptr;
+    arena->_last_is_chunk = false;
+    arena->_ptr += size;
+    return arena->_last;
+}
+
+/** Grow or shrink the block at *ptr* from *old_size* to *size* bytes.
+ *
+ * The most recent allocation is resized in place when possible. Otherwise
+ * the content moves to a new block and the old one is left unused until the
+ * arena is freed. A NULL *ptr* is a plain allocation. Return NULL on failure,
+ * in which case the block is left alone.
+ */
+void *jsonarena_realloc(
+    JsonArena *arena, void *ptr, size_t old_size, size_t size
+) {
+    _JsonArenaChunk *chunk;
+    size_t rounded = _JSONARENA_ROUND(size ? size : 1);
+    void *new_ptr;
+
+    if (ptr && ptr == arena->_last) {
+        if (arena->_last_is_chunk) {
+            // A chunk of its own, necessarily the first of the list.
+            chunk = realloc(arena->_chunks, _JSONARENA_HEADER + rounded);
+            if (!chunk) {
+                return NULL;
+            }
+            arena->_chunks = chunk;
+            arena->_last = _jsonarena_data(chunk);
+            return arena->_last;
+        }
+        if (rounded <= (size_t) (arena->_end - arena->_last)) {
+            arena->_ptr = arena->_last + rounded;
+            return ptr;
+        }
+    }
+
+    if (!(new_ptr = jsonarena_alloc(arena, size))) {
+        return NULL;
+    }
+    if (ptr) {
+        memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+    }
+    return new_ptr;
+}
+
+/** Free every block of the arena at once. The arena is then empty again. */
+void jsonarena_free(JsonArena *arena) {
+    _JsonArenaChunk *chunk = arena->_chunks;
+    _JsonArenaChunk *next;
+
+    while (chunk) {
+        next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->_ptr = NULL;
+    arena->_end = NULL;
+    arena->_last = NULL;
+    arena->_last_is_chunk = false;
+    arena->_chunks = NULL;
+}
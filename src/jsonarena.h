@@ -0,0 +1,34 @@
+#ifndef __JSONARENA_H__
+#define __JSONARENA_H__
+#include <stddef.h>
+
+
+/** Prepare an empty arena. Nothing is allocated until the first request.
+ *
+ * *size_hint* is the size of the first chunk, for callers that know roughly
+ * how much they will need. Zero picks the default.
+ */
+void jsonarena_init(JsonArena *arena, size_t size_hint);
+
+/** Allocate *size* bytes, suitably aligned for any type, or return NULL.
+ *
+ * The memory is not zeroed, and cannot be freed except with the whole arena.
+ */
+void *jsonarena_alloc(JsonArena *arena, size_t size);
+
+/** Grow or shrink the block at *ptr* from *old_size* to *size* bytes.
+ *
+ * The most recent allocation is resized in place when possible. Otherwise
+ * the content moves to a new block and the old one is left unused until the
+ * arena is freed. A NULL *ptr* is a plain allocation. Return NULL on failure,
+ * in which case the block is left alone.
+ */
+void *jsonarena_realloc(
+    JsonArena *arena, void *ptr, size_t old_size, size_t size
+);
+
+/** Free every block of the arena at once. The arena is then empty again. */
+void jsonarena_free(JsonArena *arena);
+
+
+#endif
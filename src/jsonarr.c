@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "json.h"
+#include "jsonarena.h"
 #include "jsonarr.h"
 
 
@@ -24,7 +25,24 @@ static inline void _jsonarr_test_index(size_t len, size_t idx) {
 }
 
 static bool _jsonarr_resize(JsonArray *array, size_t new_cap) {
-    JsonValue *new_data = calloc(new_cap, sizeof (JsonValue));
+    JsonValue *new_data;
+
+    if (array->_arena) {
+        new_data = jsonarena_realloc(
+            array->_arena,
+            array->_data,
+            array->_cap * sizeof (JsonValue),
+            new_cap * sizeof (JsonValue)
+        );
+        if (!new_data) {
+            return false;
+        }
+        array->_data = new_data;
+        array->_cap = new_cap;
+        return true;
+    }
+
+    new_data = calloc(new_cap, sizeof (JsonValue));
     if (!new_data) {
         return false;
     }
@@ -58,10 +76,33 @@ static inline bool _jsonarr_shrink(JsonArray *array) {
 
 /** Construct a new JsonArray and return its pointer, or NULL. */
 JsonArray *jsonarr_construct(size_t capacity) {
+    return jsonarr_construct_in(NULL, capacity);
+}
+
+/** Construct a new JsonArray that takes all its memory from *arena*.
+ *
+ * A NULL *arena* means malloc(), as with jsonarr_construct().
+ */
+JsonArray *jsonarr_construct_in(JsonArena *arena, size_t capacity) {
     if (capacity == SIZE_MAX) {
         capacity = JSONARRAY_INITIAL_CAPACITY;
     }
 
+    if (arena) {
+        JsonArray *array = jsonarena_alloc(arena, sizeof (JsonArray));
+        if (!array) {
+            return NULL;
+        }
+        array->_data = jsonarena_alloc(arena, capacity * sizeof (JsonValue));
+        if (!array->_data) {
+            return NULL;
+        }
+        array->len = 0;
+        array->_cap = capacity;
+        array->_arena = arena;
+        return array;
+    }
+
     JsonArray *array = malloc(sizeof(JsonArray));
     if (!array) {
         return NULL;
@@ -75,6 +116,7 @@ JsonArray *jsonarr_construct(size_t capacity) {
 
     array->len = 0;
     array->_cap = capacity;
+    array->_arena = NULL;
     return array;
 }
 
@@ -107,8 +149,11 @@ JsonArray *jsonarr_slice(JsonArray *array, size_t start, size_t end) {
     return copy;
 }
 
-/** Destruct the array. */
+/** Destruct the array. Arrays of an arena are left to the arena. */
 void jsonarr_destruct(JsonArray *array) {
+    if (array->_arena) {
+        return;
+    }
     free(array->_data);
     free(array);
 }
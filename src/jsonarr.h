@@ -6,6 +6,12 @@
 /** Construct a new JsonArray and return its pointer, or NULL. */
 JsonArray *jsonarr_construct(size_t capacity);
 
+/** Construct a new JsonArray that takes all its memory from *arena*.
+ *
+ * A NULL *arena* means malloc(), as with jsonarr_construct().
+ */
+JsonArray *jsonarr_construct_in(JsonArena *arena, size_t capacity);
+
 /** Make a shallow copy of array, with inclusive *start* and exclusive *end*.
  *
  * The copy's initial capacity will be set to the source's current length.
@@ -15,7 +21,7 @@ JsonArray *jsonarr_construct(size_t capacity);
  */
 JsonArray *jsonarr_slice(JsonArray *array, size_t start, size_t end);
 
-/** Destruct the array. */
+/** Destruct the array. Arrays of an arena are left to the arena. */
 void jsonarr_destruct();
 
 /** Resize the array to fit its current length. */
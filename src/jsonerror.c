@@ -0,0 +1,49 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "json.h"
+#include "jsonerror.h"
+
+
+#if defined(_MSC_VER)
+#define _JSON_THREAD_LOCAL          __declspec(thread)
+#else
+#define _JSON_THREAD_LOCAL          _Thread_local
+#endif
+
+
+static _JSON_THREAD_LOCAL JsonError _jsonerror_last = { JSON_ERROR_NONE };
+
+
+/** Find the line and column of *error* in the *len* bytes of *text* it
+ * comes from.
+ *
+ * This walks the text from the start, so it is only done on failure.
+ */
+void jsonerror_locate(JsonError *error, const char *text, size_t len) {
+    const char *p = text;
+    const char *end = &text[(error->offset < len) ? error->offset : len];
+    const char *line_start = text;
+
+    error->line = 1;
+    while ((p = memchr(p, '\n', end - p))) {
+        error->line++;
+        line_start = ++p;
+    }
+    error->column = error->offset - (line_start - text) + 1;
+}
+
+/** Keep a copy of *error* for json_last_error() on this thread. */
+void jsonerror_report(const JsonError *error) {
+    _jsonerror_last = *error;
+}
+
+
+/** Return the last error of this thread, from a function that set its
+ * *error* value to true.
+ *
+ * Nothing in the library prints errors; this is where they go.
+ */
+const JsonError *json_last_error(void) {
+    return &_jsonerror_last;
+}
@@ -0,0 +1,35 @@
+#ifndef __JSON_JSONERROR_H__
+#define __JSON_JSONERROR_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "json.h"
+
+
+/** Fill *error* with what went wrong at *offset*, leaving its line and
+ * column to jsonerror_locate(). Return false, for callers to pass along.
+ */
+static inline bool jsonerror_set(
+    JsonError *error, JsonErrorCode code, const char *message, size_t offset
+) {
+    error->code = code;
+    error->message = message;
+    error->offset = offset;
+    error->line = 0;
+    error->column = 0;
+    return false;
+}
+
+/** Find the line and column of *error* in the *len* bytes of *text* it
+ * comes from.
+ *
+ * This walks the text from the start, so it is only done on failure.
+ */
+void jsonerror_locate(JsonError *error, const char *text, size_t len);
+
+/** Keep a copy of *error* for json_last_error() on this thread. */
+void jsonerror_report(const JsonError *error);
+
+
+#endif
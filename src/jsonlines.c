@@ -0,0 +1,496 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "decoder.h"
+#include "json.h"
+#include "jsonarena.h"
+#include "jsonarr.h"
+#include "jsonerror.h"
+#include "lexer.h"
+
+
+#define JSON_LINES_INITIAL_CAP      64
+#define JSON_LINES_GROW_FACTOR      2
+// Below this, a worker costs more to start than it saves.
+#define JSON_WORKER_MIN_WORK        (64 * 1024)
+
+
+/** Ignore ' ', '\t', '\n', '\r' */
+#define _ISSPACE(c)         \
+    ((c) == 0x20 || (c) == 0x09 || (c) == 0x0a || (c) == 0x0d)
+
+
+/** The records of one contiguous range of lines, decoded by one thread. */
+typedef struct _JsonLinesWorker {
+    const char *text;
+    size_t len;
+    // Offset of *text* in the whole input, for error reporting.
+    size_t offset;
+    const JsonDecodeOptions *options;
+    JsonArena *arena;
+    JsonValue *values;
+    size_t count;
+    size_t cap;
+    bool error;
+    // What went wrong, with the offset in the whole input.
+    JsonError error_info;
+} _JsonLinesWorker;
+
+/** Some consecutive elements of the array at the root, decoded by one
+ * thread straight into their slots of the array.
+ */
+typedef struct _JsonArrayWorker {
+    // From the first element up to the comma or bracket after the last one.
+    const char *text;
+    size_t len;
+    // Offset of *text* in the whole input, for error reporting.
+    size_t offset;
+    const JsonDecodeOptions *options;
+    JsonArena *arena;
+    // Index of the first element in the array, and how many there are.
+    size_t first;
+    size_t count;
+    JsonValue *values;
+    bool error;
+    // What went wrong, with the offset in the whole input.
+    JsonError error_info;
+} _JsonArrayWorker;
+
+
+static size_t _json_cpus() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n > 0) ? (size_t) n : 1;
+#endif
+}
+
+/** The number of threads to run for *len* bytes, given what was asked. */
+static size_t _json_workers(size_t workers, size_t len) {
+    size_t n = workers ? workers : _json_cpus();
+
+    if (n > len / JSON_WORKER_MIN_WORK) {
+        n = len / JSON_WORKER_MIN_WORK;
+    }
+    return n ? n : 1;
+}
+
+/** Call *work* on each of the *n* workers of *pool*, *size* bytes apart,
+ * and return once all of them are done.
+ *
+ * The first one runs on the calling thread, and so does whatever could not
+ * get a thread of its own.
+ */
+static void _json_run_workers(
+    void *pool, size_t size, size_t n, void *(*work)(void *)
+) {
+    pthread_t *threads = (n > 1) ? malloc((n - 1) * sizeof (pthread_t)) : NULL;
+    char *worker = pool;
+    size_t started = 0;
+
+    if (threads) {
+        for (; started < n - 1; started++) {
+            if (pthread_create(
+                    &threads[started], NULL, work, &worker[(started + 1) * size]
+                )) {
+                break;
+            }
+        }
+    }
+    work(pool);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (size_t i = started + 1; i < n; i++) {
+        work(&worker[i * size]);
+    }
+    free(threads);
+}
+
+static bool _json_lines_append(_JsonLinesWorker *worker, JsonValue *value) {
+    JsonValue *new_values;
+    size_t new_cap;
+
+    if (worker->count == worker->cap) {
+        new_cap = worker->cap
+            ? worker->cap * JSON_LINES_GROW_FACTOR
+            : JSON_LINES_INITIAL_CAP;
+        new_values = realloc(worker->values, new_cap * sizeof (JsonValue));
+        if (!new_values) {
+            return false;
+        }
+        worker->values = new_values;
+        worker->cap = new_cap;
+    }
+    worker->values[worker->count++] = *value;
+    return true;
+}
+
+/** Decode every record of the range of the worker, in order. */
+static void *_json_lines_work(void *arg) {
+    _JsonLinesWorker *worker = arg;
+    const char *p = worker->text;
+    const char *end = &worker->text[worker->len];
+    const char *line_end;
+    const char *q;
+    JsonValue value;
+    Lexer lexer;
+    bool error;
+
+    for (; p < end; p = line_end + 1) {
+        if (!(line_end = memchr(p, '\n', end - p))) {
+            line_end = end;
+        }
+        // Blank lines are not records.
+        for (q = p; q < line_end && _ISSPACE(*q); q++);
+        if (q == line_end) {
+            continue;
+        }
+
+        lexer_init(&lexer, p, line_end - p);
+        value = decoder_decode(&lexer, worker->options, worker->arena, &error);
+        if (error) {
+            worker->error_info = lexer.error;
+            worker->error_info.offset += worker->offset + (p - worker->text);
+            worker->error = true;
+            return NULL;
+        }
+        if (!_json_lines_append(worker, &value)) {
+            jsonerror_set(
+                &worker->error_info,
+                JSON_ERROR_MEMORY,
+                "insufficient memory",
+                worker->offset + (p - worker->text)
+            );
+            worker->error = true;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/** Split *len* bytes of *text* into *n* ranges of whole lines. */
+static void _json_lines_split(
+    _JsonLinesWorker *workers, size_t n, const char *text, size_t len
+) {
+    const char *end = &text[len];
+    const char *p = text;
+    const char *next;
+
+    for (size_t i = 0; i < n; i++) {
+        if (i == n - 1) {
+            next = end;
+        } else if ((next = &text[len / n * (i + 1)]) < p) {
+            // The previous range took this one with its last line.
+            next = p;
+        } else if ((next = memchr(next, '\n', end - next))) {
+            next++;
+        } else {
+            next = end;
+        }
+        workers[i].text = p;
+        workers[i].len = next - p;
+        workers[i].offset = p - text;
+        p = next;
+    }
+}
+
+
+/** Decode *len* bytes of newline-delimited JSON, one record per line.
+ *
+ * The text is split into ranges of whole lines, decoded in parallel by up
+ * to *workers* threads, each into an arena of its own. Zero picks the number
+ * of processors. Blank lines are skipped.
+ * *options* may be NULL for the defaults.
+ * Return the records in input order, or NULL and set *error* value to true
+ * when any of them failed to decode.
+ */
+JsonLines *json_decode_lines(
+    const char *text,
+    size_t len,
+    const JsonDecodeOptions *options,
+    size_t workers,
+    bool *error
+) {
+    JsonLines *lines;
+    JsonError memory_error;
+    _JsonLinesWorker *pool;
+    size_t n = _json_workers(workers, len);
+    size_t count = 0;
+
+    *error = true;
+    jsonerror_set(&memory_error, JSON_ERROR_MEMORY, "insufficient memory", 0);
+
+    if (!(lines = malloc(sizeof (JsonLines)))) {
+        jsonerror_report(&memory_error);
+        return NULL;
+    }
+    lines->len = 0;
+    lines->values = NULL;
+    lines->_arenas = malloc(n * sizeof (JsonArena));
+    lines->_narenas = n;
+    if (!lines->_arenas || !(pool = calloc(n, sizeof (_JsonLinesWorker)))) {
+        free(lines->_arenas);
+        free(lines);
+        jsonerror_report(&memory_error);
+        return NULL;
+    }
+
+    _json_lines_split(pool, n, text, len);
+    for (size_t i = 0; i < n; i++) {
+        // Containers keep a pointer to their arena, so it must not move.
+        jsonarena_init(&lines->_arenas[i], 2 * pool[i].len);
+        pool[i].options = options;
+        pool[i].arena = &lines->_arenas[i];
+    }
+
+    _json_run_workers(pool, sizeof (_JsonLinesWorker), n, _json_lines_work);
+
+    *error = false;
+    for (size_t i = 0; i < n; i++) {
+        if (pool[i].error && !*error) {
+            // The first invalid record is the one reported.
+            jsonerror_locate(&pool[i].error_info, text, len);
+            jsonerror_report(&pool[i].error_info);
+        }
+        *error |= pool[i].error;
+        count += pool[i].count;
+    }
+    if (!*error && n == 1) {
+        lines->values = pool[0].values;
+        pool[0].values = NULL;
+        lines->len = count;
+    } else if (!*error) {
+        // Only the values are copied; their trees stay in the arenas.
+        if ((lines->values = malloc(count * sizeof (JsonValue) + 1))) {
+            for (size_t i = 0; i < n; i++) {
+                if (pool[i].count) {
+                    memcpy(
+                        &lines->values[lines->len],
+                        pool[i].values,
+                        pool[i].count * sizeof (JsonValue)
+                    );
+                    lines->len += pool[i].count;
+                }
+            }
+        } else {
+            jsonerror_report(&memory_error);
+            *error = true;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        free(pool[i].values);
+    }
+    free(pool);
+    if (*error) {
+        json_lines_free(lines);
+        return NULL;
+    }
+    return lines;
+}
+
+/** Release the records and all of their trees. */
+void json_lines_free(JsonLines *lines) {
+    for (size_t i = 0; i < lines->_narenas; i++) {
+        jsonarena_free(&lines->_arenas[i]);
+    }
+    free(lines->_arenas);
+    free(lines->values);
+    free(lines);
+}
+
+
+/** Decode the elements of the range of the worker into their slots. */
+static void *_json_array_work(void *arg) {
+    _JsonArrayWorker *worker = arg;
+    Lexer lexer;
+
+    lexer_init(&lexer, worker->text, worker->len);
+    if (!decoder_decode_elements(
+            &lexer, worker->options, worker->arena, worker->values,
+            worker->count
+        )) {
+        worker->error_info = lexer.error;
+        worker->error_info.offset += worker->offset;
+        worker->error = true;
+    }
+    return NULL;
+}
+
+/** Find the elements of the array at the root of *text* with the
+ * structural index alone, and split them into at most *n* ranges of
+ * consecutive elements and about as many bytes.
+ *
+ * Store the number of elements in *count*, and return the number of ranges,
+ * or zero if the root is not an array or its brackets do not match. Nothing
+ * but the brackets is checked: the elements are validated when decoded.
+ */
+static size_t _json_array_split(
+    _JsonArrayWorker *workers,
+    size_t n,
+    const char *text,
+    size_t len,
+    size_t *count
+) {
+    Lexer lexer;
+    size_t ranges = 0;
+    size_t start;
+    size_t comma = 0;
+    char chr;
+
+    *count = 0;
+    lexer_init(&lexer, text, len);
+    if (lexer_peek(&lexer) != '[') {
+        return 0;
+    }
+    lexer_advance(&lexer);
+    if (lexer_peek(&lexer) == ']') {
+        return 0;
+    }
+    while (1) {
+        start = lexer.pos;
+        if (ranges < n && start >= len / n * ranges) {
+            if (ranges) {
+                workers[ranges - 1].len = comma - workers[ranges - 1].offset;
+            }
+            workers[ranges].text = &text[start];
+            workers[ranges].offset = start;
+            workers[ranges].first = *count;
+            ranges++;
+        }
+        (*count)++;
+        if (!lexer_skip_value(&lexer)) {
+            return 0;
+        }
+        chr = lexer_peek(&lexer);
+        if (chr == ']') {
+            break;
+        } else if (chr != ',') {
+            return 0;
+        }
+        comma = lexer.pos;
+        lexer_advance(&lexer);
+    }
+    workers[ranges - 1].len = lexer.pos - workers[ranges - 1].offset;
+    lexer_advance(&lexer);
+    lexer_peek(&lexer);
+    if (!lexer_eof(&lexer)) {
+        return 0;
+    }
+    for (size_t i = 0; i < ranges; i++) {
+        workers[i].count = ((i + 1 < ranges) ? workers[i + 1].first : *count)
+            - workers[i].first;
+    }
+    return ranges;
+}
+
+/** Decode *len* bytes of JSON text into a new document, splitting the
+ * elements of an array at the root between up to *workers* threads.
+ *
+ * Zero picks the number of processors. The elements are found with the
+ * structural index first, then each thread decodes a range of them into an
+ * arena of its own, straight into their slots of the root array. Other
+ * documents, and small ones, are decoded as with json_document_decode().
+ * *options* may be NULL for the defaults.
+ * Return NULL and set *error* value to true when parsing failed.
+ */
+JsonDocument *json_document_decode_parallel(
+    const char *text,
+    size_t len,
+    const JsonDecodeOptions *options,
+    size_t workers,
+    bool *error
+) {
+    JsonArena arena;
+    JsonDocument *document;
+    JsonArray *root;
+    JsonError memory_error;
+    _JsonArrayWorker *pool;
+    size_t n = _json_workers(workers, len);
+    size_t count;
+
+    if (n == 1) {
+        return json_document_decode(text, len, options, error);
+    }
+    jsonerror_set(&memory_error, JSON_ERROR_MEMORY, "insufficient memory", 0);
+    if (!(pool = calloc(n, sizeof (_JsonArrayWorker)))) {
+        jsonerror_report(&memory_error);
+        *error = true;
+        return NULL;
+    }
+    // Anything that cannot be split is left to the serial decoder, which
+    // also tells precisely what is wrong with it.
+    if ((n = _json_array_split(pool, n, text, len, &count)) < 2) {
+        free(pool);
+        return json_document_decode(text, len, options, error);
+    }
+
+    // Only the root array itself is in the arena of the document, along
+    // with those of the threads, which must not move.
+    jsonarena_init(&arena, 0);
+    if (!(document = jsonarena_alloc(&arena, sizeof (JsonDocument)))) {
+        free(pool);
+        jsonerror_report(&memory_error);
+        *error = true;
+        return NULL;
+    }
+    document->_arena = arena;
+    document->_text = NULL;
+    document->_text_len = 0;
+    document->_narenas = 0;
+    document->_arenas = jsonarena_alloc(
+        &document->_arena, n * sizeof (JsonArena)
+    );
+    root = jsonarr_construct_in(&document->_arena, count);
+    if (!document->_arenas || !root) {
+        free(pool);
+        json_document_free(document);
+        jsonerror_report(&memory_error);
+        *error = true;
+        return NULL;
+    }
+    document->_narenas = n;
+    document->root.type = JSON_ARRAY;
+    document->root.value.as_arr = root;
+
+    for (size_t i = 0; i < n; i++) {
+        // As with json_document_decode(): the tree, then the strings.
+        jsonarena_init(&document->_arenas[i], 3 * pool[i].len);
+        pool[i].options = options;
+        pool[i].arena = &document->_arenas[i];
+        pool[i].values = &root->_data[pool[i].first];
+    }
+    _json_run_workers(pool, sizeof (_JsonArrayWorker), n, _json_array_work);
+
+    *error = false;
+    for (size_t i = 0; i < n && !*error; i++) {
+        if (pool[i].error) {
+            // The first invalid element is the one reported.
+            jsonerror_locate(&pool[i].error_info, text, len);
+            jsonerror_report(&pool[i].error_info);
+            *error = true;
+        }
+    }
+    free(pool);
+    if (*error) {
+        json_document_free(document);
+        return NULL;
+    }
+    root->len = count;
+    return document;
+}
@@ -6,62 +6,122 @@
 #include <string.h>
 
 #include "json.h"
+#include "jsonarena.h"
 #include "jsonobj.h"
+#include "simd.h"
 
 
-#define JSONOBJ_FNV_PRIME_32        0x01000193
-#define JSONOBJ_FNV_OFFSET_BASIS_32 0x811c9dc5
-#define JSONOBJ_FNV_PRIME_64        0x00000100000001b3
-#define JSONOBJ_FNV_OFFSET_BASIS_64 0xcbf29ce484222325
-#define JSONOBJ_CAPACITY_STEPS      29
+// The secret of wyhash.
+#define JSONOBJ_WY_SECRET_0         0x2d358dccaa6c78a5
+#define JSONOBJ_WY_SECRET_1         0x8bb84b93962eacc9
+// Capacities are powers of two in between.
+#define JSONOBJ_MIN_CAP             8
+#define JSONOBJ_MAX_CAP             ((size_t) 1 << 31)
 #define JSONOBJ_GROW_THRESHOLD      2 / 3
 #define JSONOBJ_SHRINK_THRESHOLD    4
+// Control bytes compared at once.
+#define JSONOBJ_GROUP_WIDTH         16
+// Control bytes of slots without an entry. Those of entries are 7 bits of
+// their hash, so only these have the top bit set.
+#define JSONOBJ_CTRL_EMPTY          0x80
+#define JSONOBJ_CTRL_DELETED        0xfe
+// 2^64 divided by the golden ratio.
+#define JSONOBJ_MIX_64              0x9e3779b97f4a7c15
+
+
+/** Multiply *a* and *b* into 128 bits, and leave the low half in *a* and
+ * the high half in *b*.
+ */
+static inline void _jsonobj_mul128(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t) *a * *b;
+
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    uint64_t ha = *a >> 32;
+    uint64_t la = (uint32_t) *a;
+    uint64_t hb = *b >> 32;
+    uint64_t lb = (uint32_t) *b;
+    uint64_t high = ha * hb;
+    uint64_t mid0 = ha * lb;
+    uint64_t mid1 = hb * la;
+    uint64_t low = la * lb;
+    uint64_t t = low + (mid0 << 32);
+    uint64_t carry = t < low;
+
+    *a = t + (mid1 << 32);
+    carry += *a < t;
+    *b = high + (mid0 >> 32) + (mid1 >> 32) + carry;
+#endif
+}
+
+/** Multiply *a* and *b* into 128 bits, and fold the halves together. */
+static inline uint64_t _jsonobj_fold(uint64_t a, uint64_t b) {
+    _jsonobj_mul128(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t _jsonobj_read64(const unsigned char *p) {
+    uint64_t v;
 
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint64_t _jsonobj_read32(const unsigned char *p) {
+    uint32_t v;
 
-static const size_t _JSONOBJ_CAPS[JSONOBJ_CAPACITY_STEPS] = {
-    7,
-    13,
-    29,
-    53,
-    97,
-    193,
-    389,
-    769,
-    1543,
-    3079,
-    6151,
-    12289,
-    24593,
-    49157,
-    98317,
-    196613,
-    393241,
-    786433,
-    1572869,
-    3145739,
-    6291469,
-    12582917,
-    25165843,
-    50331653,
-    100663319,
-    201326611,
-    402653189,
-    805306457,
-    1610612741
-};
-
-
-/** Implements 32-bit FNV-1a hash algorithm. Expects string as input.*/
-JsonObjectKeyHash json_default_hasher(void *data) {
-    unsigned char *bytes = data;
-    JsonObjectKeyHash b;
-    // JsonObjectKeyHash hash = JSONOBJ_FNV_OFFSET_BASIS_32;
-    JsonObjectKeyHash hash = JSONOBJ_FNV_OFFSET_BASIS_64;
-    while ((b = *bytes++) != 0) {
-        // hash = (hash ^ b) * JSONOBJ_FNV_PRIME_32;
-        hash = (hash ^ b) * JSONOBJ_FNV_PRIME_64;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+/** Hash the *len* bytes at *data* 8 bytes at a time, after wyhash.
+ *
+ * Keys up to 16 bytes, the most common, take two to four overlapping
+ * reads and two multiplies, without a loop. Longer keys take a multiply
+ * per 16 bytes. Nothing past *len* is read.
+ */
+JsonObjectKeyHash json_default_hasher(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t seed = JSONOBJ_WY_SECRET_0;
+    uint64_t a;
+    uint64_t b;
+    size_t i = len;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            // Both ends, and the middle from 8 bytes on.
+            a = (_jsonobj_read32(p) << 32)
+                | _jsonobj_read32(p + ((len >> 3) << 2));
+            b = (_jsonobj_read32(p + len - 4) << 32)
+                | _jsonobj_read32(p + len - 4 - ((len >> 3) << 2));
+        } else if (len > 0) {
+            a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8)
+                | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        for (; i > 16; i -= 16, p += 16) {
+            seed = _jsonobj_fold(
+                _jsonobj_read64(p) ^ JSONOBJ_WY_SECRET_1,
+                _jsonobj_read64(p + 8) ^ seed
+            );
+        }
+        // The last 16 bytes, which may overlap those before.
+        a = _jsonobj_read64(p + i - 16);
+        b = _jsonobj_read64(p + i - 8);
     }
-    return hash;
+    a ^= JSONOBJ_WY_SECRET_1;
+    b ^= seed;
+    _jsonobj_mul128(&a, &b);
+    return _jsonobj_fold(
+        a ^ JSONOBJ_WY_SECRET_0 ^ len, b ^ JSONOBJ_WY_SECRET_1
+    );
 }
 
 
@@ -69,11 +129,11 @@ static void _jsonobj_print_obj(JsonObject *object) {
     JsonObjectIterator *iter = jsonobj_iter(object);
 
     printf(
-        "JsonObject<%p>(len=%llu, _cap=%llu, _data<%p>=",
+        "JsonObject<%p>(len=%llu, _cap=%llu, _entries<%p>=",
         object,
         object->len,
         object->_cap,
-        object->_data
+        object->_entries
     );
 
     printf("{");
@@ -88,9 +148,11 @@ static void _jsonobj_print_obj(JsonObject *object) {
 
 static void _jsonobj_print_entry(JsonObjectEntry *entry) {
     printf(
-        "JsonObjectEntry<%p>(key=%s, _hash=%llu, &value=%p)\n",
+        "JsonObjectEntry<%p>(key=%s, key_len=%llu, _hash=%llu, "
+        "&value=%p)\n",
         entry,
         entry->key,
+        entry->key_len,
         entry->_hash,
         &entry->value
     );
@@ -102,98 +164,257 @@ static void _jsonobj_error_key(char *key) {
     abort();
 }
 
-static bool _jsonobj_resize(JsonObject *object, unsigned int index) {
-    size_t new_cap = _JSONOBJ_CAPS[index];
-    size_t old_idx;
-    size_t new_idx;
-    _JsonObjectBucket **new_data;
-    _JsonObjectBucket *bucket;
-    _JsonObjectBucket *prev;
-    _JsonObjectBucket *new_place;
+static inline void *_jsonobj_alloc(JsonObject *object, size_t size) {
+    return object->_arena ? jsonarena_alloc(object->_arena, size) : malloc(size);
+}
 
-    new_data = calloc(new_cap, sizeof (_JsonObjectBucket *));
-    if (!new_data) {
+/** Free a block of the object, unless it belongs to an arena. */
+static inline void _jsonobj_free(JsonObject *object, void *ptr) {
+    if (!object->_arena) {
+        free(ptr);
+    }
+}
+
+/** Spread *hash* over the top bits, Fibonacci hashing: multiply it by 2^64
+ * divided by the golden ratio. The top bits of the product depend on all
+ * the bits of the hash, unlike a mask, so that hashes that only differ in
+ * a few bits, as those of a weak hasher can, still spread out. It takes a
+ * multiply where a modulo takes a division.
+ */
+static inline uint64_t _jsonobj_mix(JsonObjectKeyHash hash) {
+    return (uint64_t) hash * JSONOBJ_MIX_64;
+}
+
+/** The slot to start looking from for a key that hashes to *hash*: the
+ * top bits of the mix, as many as it takes to count the slots.
+ */
+static inline size_t _jsonobj_h1(JsonObject *object, JsonObjectKeyHash hash) {
+    return (size_t) (_jsonobj_mix(hash) >> (64 - simd_ctz64(object->_cap)));
+}
+
+/** The control byte of an entry whose key hashes to *hash*: the 7 bits of
+ * the mix below those of its first slot, which neighbours do not share.
+ */
+static inline unsigned char _jsonobj_h2(
+    JsonObject *object, JsonObjectKeyHash hash
+) {
+    return (unsigned char) (
+        (_jsonobj_mix(hash) >> (57 - simd_ctz64(object->_cap))) & 0x7f
+    );
+}
+
+/** The number of entries there is room for with *cap* slots. */
+static inline size_t _jsonobj_usable(size_t cap) {
+    // One more than what makes _jsonobj_grow() grow, as it used to be.
+    return cap * JSONOBJ_GROW_THRESHOLD + 1;
+}
+
+/** The size of each position in the index of *cap* slots. */
+static inline size_t _jsonobj_index_size(size_t cap) {
+    return (cap <= UINT8_MAX + 1) ? 1 : (cap <= UINT16_MAX + 1) ? 2 : 4;
+}
+
+/** The position of the entry of *slot*, which must be taken. */
+static inline size_t _jsonobj_get_index(JsonObject *object, size_t slot) {
+    switch (_jsonobj_index_size(object->_cap)) {
+        case 1:
+            return ((uint8_t *) object->_index)[slot];
+        case 2:
+            return ((uint16_t *) object->_index)[slot];
+        default:
+            return ((uint32_t *) object->_index)[slot];
+    }
+}
+
+static inline void _jsonobj_set_index(
+    JsonObject *object, size_t slot, size_t index
+) {
+    switch (_jsonobj_index_size(object->_cap)) {
+        case 1:
+            ((uint8_t *) object->_index)[slot] = (uint8_t) index;
+            break;
+        case 2:
+            ((uint16_t *) object->_index)[slot] = (uint16_t) index;
+            break;
+        default:
+            ((uint32_t *) object->_index)[slot] = (uint32_t) index;
+            break;
+    }
+}
+
+/** Allocate room for the entries and an empty index of *cap* slots, from
+ * the arena if the object has one, and set them up, without any entries.
+ *
+ * The object is left as it is on failure.
+ */
+static bool _jsonobj_alloc_table(JsonObject *object, size_t cap) {
+    size_t nctrl = cap + JSONOBJ_GROUP_WIDTH - 1;
+    size_t entries_size = _jsonobj_usable(cap) * sizeof (JsonObjectEntry);
+    size_t index_size = cap * _jsonobj_index_size(cap);
+    char *block;
+
+    // One block: the entries, the positions, then the control bytes.
+    block = _jsonobj_alloc(object, entries_size + index_size + nctrl);
+    if (!block) {
         return false;
     }
+    object->_cap = cap;
+    object->_nentries = 0;
+    object->_entries = (JsonObjectEntry *) block;
+    object->_index = &block[entries_size];
+    object->_ctrl = (unsigned char *) &block[entries_size + index_size];
+    memset(object->_ctrl, JSONOBJ_CTRL_EMPTY, nctrl);
+    return true;
+}
+
+/** Set the control byte of *slot*, and its copies past the last slot. */
+static inline void _jsonobj_set_ctrl(
+    JsonObject *object, size_t slot, unsigned char ctrl
+) {
+    size_t end = object->_cap + JSONOBJ_GROUP_WIDTH - 1;
+
+    for (size_t i = slot; i < end; i += object->_cap) {
+        object->_ctrl[i] = ctrl;
+    }
+}
 
-    for (old_idx = 0; old_idx < object->_cap; old_idx++) {
-        bucket = object->_data[old_idx];
-        while (bucket) {
-            prev = bucket;
-            bucket = bucket->next;
-            prev->next = NULL;
-
-            new_idx = prev->entry._hash % new_cap;
-
-            new_place = new_data[new_idx];
-            if (!new_place) {
-                new_data[new_idx] = prev;
-            } else {
-                while (new_place->next) {
-                    new_place = new_place->next;
-                }
-                new_place->next = prev;
-            }
+/** The slot *offset* slots after *pos*, wrapping around. */
+static inline size_t _jsonobj_wrap(
+    JsonObject *object, size_t pos, size_t offset
+) {
+    return (pos + offset) & (object->_cap - 1);
+}
+
+/** Find the first slot without an entry for a key that hashes to *hash*. */
+static size_t _jsonobj_find_free(JsonObject *object, JsonObjectKeyHash hash) {
+    size_t pos = _jsonobj_h1(object, hash);
+    uint32_t unused;
+
+    // There is always an empty slot, so this ends.
+    while (!(unused = simd_top_bits16(&object->_ctrl[pos]))) {
+        pos = _jsonobj_wrap(object, pos, JSONOBJ_GROUP_WIDTH);
+    }
+    return _jsonobj_wrap(object, pos, simd_ctz32(unused));
+}
+
+/** Append an entry for *key*, of *len* bytes, which hashes to *hash*, and
+ * index it. There must be room for it.
+ */
+static inline JsonObjectEntry *_jsonobj_append(
+    JsonObject *object, char *key, size_t len, JsonObjectKeyHash hash
+) {
+    size_t slot = _jsonobj_find_free(object, hash);
+    JsonObjectEntry *entry = &object->_entries[object->_nentries];
+
+    entry->key = key;
+    entry->key_len = len;
+    entry->_hash = hash;
+    _jsonobj_set_index(object, slot, object->_nentries++);
+    _jsonobj_set_ctrl(object, slot, _jsonobj_h2(object, hash));
+    return entry;
+}
+
+/** Move the entries to a table of *new_cap* slots, in the same order,
+ * without the holes.
+ */
+static bool _jsonobj_resize(JsonObject *object, size_t new_cap) {
+    JsonObjectEntry *old_entries = object->_entries;
+    size_t old_nentries = object->_nentries;
+    JsonObjectEntry *entry;
+
+    if (!_jsonobj_alloc_table(object, new_cap)) {
+        return false;
+    }
+    for (size_t i = 0; i < old_nentries; i++) {
+        if (old_entries[i].key) {
+            entry = _jsonobj_append(
+                object, old_entries[i].key, old_entries[i].key_len,
+                old_entries[i]._hash
+            );
+            entry->value = old_entries[i].value;
         }
     }
 
-    free(object->_data);
-    object->_cap = new_cap;
-    object->_data = new_data;
+    _jsonobj_free(object, old_entries);
     return true;
 }
 
+/** Make sure there is room for one more entry. */
 static inline bool _jsonobj_grow(JsonObject *object) {
-    if (object->len <= object->_cap * JSONOBJ_GROW_THRESHOLD) {
+    if (object->_nentries < _jsonobj_usable(object->_cap)) {
         return true;
     }
+    if (object->len <= object->_cap / 2) {
+        // Mostly holes: pack the entries at the same size.
+        return _jsonobj_resize(object, object->_cap);
+    }
 
-    // The step array is small enough that bsearch is probably not worth it.
-    for (unsigned int i = 0; i < JSONOBJ_CAPACITY_STEPS; i++) {
-        if (_JSONOBJ_CAPS[i] > object->_cap) {
-            return _jsonobj_resize(object, i);
-        }
+    if (object->_cap == JSONOBJ_MAX_CAP) {
+        return false;
     }
-    return false;
+    return _jsonobj_resize(object, object->_cap * 2);
 }
 
 static inline bool _jsonobj_shrink(JsonObject *object) {
-    if (object->len >= object->_cap / JSONOBJ_SHRINK_THRESHOLD) {
+    if (object->len >= object->_cap / JSONOBJ_SHRINK_THRESHOLD
+            || object->_cap == JSONOBJ_MIN_CAP) {
         return true;
     }
+    return _jsonobj_resize(object, object->_cap / 2);
+}
 
-    for (unsigned int i = JSONOBJ_CAPACITY_STEPS - 1; i-- > 0; ) {
-        if (_JSONOBJ_CAPS[i] < object->_cap) {
-            return _jsonobj_resize(object, i);
+/** Find the slot of *key*, of *len* bytes, which hashes to *hash*, or
+ * return SIZE_MAX.
+ *
+ * The control bytes of a group of slots are compared to the hash at once,
+ * and only the entries that match are compared to the key: hash, length,
+ * then bytes. An empty slot among them means the key is nowhere further.
+ */
+static inline size_t _jsonobj_find(
+    JsonObject *object, const char *key, size_t len, JsonObjectKeyHash hash
+) {
+    unsigned char h2 = _jsonobj_h2(object, hash);
+    size_t pos = _jsonobj_h1(object, hash);
+    JsonObjectEntry *entry;
+    uint32_t match;
+    size_t slot;
+
+    for (;;) {
+        match = simd_match_byte16(&object->_ctrl[pos], h2);
+        while (match) {
+            slot = _jsonobj_wrap(object, pos, simd_ctz32(match));
+            entry = &object->_entries[_jsonobj_get_index(object, slot)];
+            if (entry->_hash == hash && entry->key_len == len
+                    && memcmp(entry->key, key, len) == 0) {
+                return slot;
+            }
+            match &= match - 1;
+        }
+        if (simd_match_byte16(&object->_ctrl[pos], JSONOBJ_CTRL_EMPTY)) {
+            return SIZE_MAX;
         }
+        pos = _jsonobj_wrap(object, pos, JSONOBJ_GROUP_WIDTH);
     }
-    return false;
 }
 
-static void _jsonobj_destruct_bucket(_JsonObjectBucket *bucket) {
-    if (bucket->next) {
-        _jsonobj_destruct_bucket(bucket->next);
+/** Find the entry of *key*, of *len* bytes, which hashes to *hash*, or
+ * return NULL.
+ */
+static inline JsonObjectEntry *_jsonobj_find_entry(
+    JsonObject *object, const char *key, size_t len, JsonObjectKeyHash hash
+) {
+    size_t slot = _jsonobj_find(object, key, len, hash);
+
+    if (slot == SIZE_MAX) {
+        return NULL;
     }
-    free(bucket->entry.key);
-    free(bucket);
+    return &object->_entries[_jsonobj_get_index(object, slot)];
 }
 
-static inline _JsonObjectBucket *_jsonobj_contains(JsonObject *object, char *key) {
-    JsonObjectKeyHash hash = object->_hasher(key);
-    size_t index = hash % object->_cap;
-    _JsonObjectBucket *bucket = object->_data[index];
+static inline JsonObjectEntry *_jsonobj_contains(JsonObject *object, char *key) {
+    size_t len = strlen(key);
 
-    if (!bucket) {
-        return NULL;
-    } else {
-        do {
-            if (bucket->entry._hash == hash
-                    && strcmp(bucket->entry.key, key) == 0) {
-                return bucket;
-            }
-        } while (bucket = bucket->next);
-    }
-    return NULL;
+    return _jsonobj_find_entry(object, key, len, object->_hasher(key, len));
 }
 
 
@@ -206,147 +427,150 @@ static inline _JsonObjectBucket *_jsonobj_contains(JsonObject *object, char *key
 JsonObject *jsonobj_construct(
     JsonObjectHashFunction hasher, size_t min_capacity
 ) {
-    JsonObject *object = malloc(sizeof(JsonObject));
+    return jsonobj_construct_in(NULL, hasher, min_capacity);
+}
+
+/** Construct a JsonObject that takes all its memory from *arena*.
+ *
+ * A NULL *arena* means malloc(), as with jsonobj_construct().
+ */
+JsonObject *jsonobj_construct_in(
+    JsonArena *arena, JsonObjectHashFunction hasher, size_t min_capacity
+) {
+    JsonObject *object = arena
+        ? jsonarena_alloc(arena, sizeof (JsonObject))
+        : malloc(sizeof(JsonObject));
     if (!object) {
         return NULL;
     }
+    object->_arena = arena;
 
-    size_t cap = 0;
+    size_t cap = JSONOBJ_MIN_CAP;
 
-    if (min_capacity == SIZE_MAX) {
-        cap = _JSONOBJ_CAPS[0];
-    } else {
-        for (unsigned int i = 0; i < JSONOBJ_CAPACITY_STEPS; i++) {
-            if (_JSONOBJ_CAPS[i] >= min_capacity) {
-                cap = _JSONOBJ_CAPS[i];
-                break;
+    if (min_capacity != SIZE_MAX) {
+        // Capacity counts entries, which take 2/3 of the slots at most.
+        while (_jsonobj_usable(cap) < min_capacity) {
+            if (cap == JSONOBJ_MAX_CAP) {
+                // We never imagined tables this big. Let us run like hell.
+                _jsonobj_free(object, object);
+                return NULL;
             }
-        }
-        if (cap == 0) {
-            // We never imagined tables this big. Let us run like hell.
-            free(object);
-            return NULL;
+            cap *= 2;
         }
     }
     object->len = 0;
     object->_hasher = hasher;
-    object->_cap = cap;
-    object->_data = calloc(object->_cap, sizeof (_JsonObjectBucket *));
-    if (!object->_data) {
-        free(object);
+    if (!_jsonobj_alloc_table(object, cap)) {
+        _jsonobj_free(object, object);
         return NULL;
     }
     return object;
 }
 
-/** Destruct object. */
+/** Destruct object. Objects of an arena are left to the arena. */
 void jsonobj_destruct(JsonObject *object) {
+    if (object->_arena) {
+        return;
+    }
     jsonobj_clear(object);
-    free(object->_data);
+    free(object->_entries);
     free(object);
 }
 
 /** Get the item associated with *key*. Querying non-existent key is error. */
 JsonValue *jsonobj_getitem(JsonObject *object, char *key) {
-    _JsonObjectBucket *bucket = _jsonobj_contains(object, key);
-    if (!bucket) {
+    JsonObjectEntry *entry = _jsonobj_contains(object, key);
+    if (!entry) {
         _jsonobj_error_key(key);
     }
-    return &bucket->entry.value;
+    return &entry->value;
 }
 
-/** Associate *key* with *value*. It can fail and return false. */
-bool jsonobj_setitem(JsonObject *object, char *key, JsonValue *value) {
-    _JsonObjectBucket *bucket = _jsonobj_contains(object, key);
-    if (bucket) {
-        bucket->entry.value = *value;
-        return true;
-    }
-
+/** Insert a new entry for *key*, of *len* bytes, which hashes to *hash*
+ * and which the object now owns.
+ */
+static bool _jsonobj_insert(
+    JsonObject *object, char *key, size_t len, JsonObjectKeyHash hash,
+    JsonValue *value
+) {
     if (!_jsonobj_grow(object)) {
         return false;
     }
+    _jsonobj_append(object, key, len, hash)->value = *value;
+    object->len++;
+    return true;
+}
 
-    bucket = calloc(1, sizeof(_JsonObjectBucket));
-    if (!bucket) {
-        return false;
+/** Associate *key* with *value*. It can fail and return false. */
+bool jsonobj_setitem(JsonObject *object, char *key, JsonValue *value) {
+    size_t len = strlen(key);
+    JsonObjectKeyHash hash = object->_hasher(key, len);
+    JsonObjectEntry *entry = _jsonobj_find_entry(object, key, len, hash);
+    char *copy;
+
+    if (entry) {
+        entry->value = *value;
+        return true;
     }
 
     // Keep a copy because key should not change.
-    JsonObjectEntry *entry = &bucket->entry;
-    entry->key = malloc((strlen(key) + 1) * sizeof (char));
-    if (!entry->key) {
-        free(bucket);
+    copy = _jsonobj_alloc(object, (len + 1) * sizeof (char));
+    if (!copy) {
+        return false;
+    }
+    memcpy(copy, key, len + 1);
+    if (!_jsonobj_insert(object, copy, len, hash, value)) {
+        _jsonobj_free(object, copy);
         return false;
     }
-    strcpy(entry->key, key);
+    return true;
+}
 
-    JsonObjectKeyHash hash = object->_hasher(key);
-    size_t index = hash % object->_cap;
-    entry->_hash = hash;
+/** Associate *key* with *value*, taking ownership of *key* without a copy.
+ *
+ * *key* must come from malloc(), or from the arena of the object if it has
+ * one. If the key is already there, *key* is released right away. On
+ * failure, *key* is left to the caller.
+ */
+bool jsonobj_setitem_adopt(JsonObject *object, char *key, JsonValue *value) {
+    return jsonobj_setitem_adopt_n(object, key, strlen(key), value);
+}
 
-    entry->value = *value;
+/** Same as jsonobj_setitem_adopt(), with *len* the length of *key*, as the
+ * decoders already know it.
+ */
+bool jsonobj_setitem_adopt_n(
+    JsonObject *object, char *key, size_t len, JsonValue *value
+) {
+    JsonObjectKeyHash hash = object->_hasher(key, len);
+    JsonObjectEntry *entry = _jsonobj_find_entry(object, key, len, hash);
 
-    // Find a place for this entry to sit.
-    _JsonObjectBucket *place = object->_data[index];
-    if (!place) {
-        object->_data[index] = bucket;
-    } else {
-        while (place->next) {
-            place = place->next;
-        }
-        place->next = bucket;
+    if (entry) {
+        entry->value = *value;
+        _jsonobj_free(object, key);
+        return true;
     }
-
-    object->len++;
-    return true;
+    return _jsonobj_insert(object, key, len, hash, value);
 }
 
 /** Delete *key* and associated *value*. It can fail and return false. */
 bool jsonobj_delitem(JsonObject *object, char *key) {
-    JsonObjectKeyHash hash = object->_hasher(key);
-    size_t index = hash % object->_cap;
-    _JsonObjectBucket *bucket = object->_data[index];
-    _JsonObjectBucket *prev;
+    size_t len = strlen(key);
+    size_t slot = _jsonobj_find(object, key, len, object->_hasher(key, len));
+    JsonObjectEntry *entry;
 
-    if (!bucket) {
+    if (slot == SIZE_MAX) {
         _jsonobj_error_key(key);
     }
-    if (!_jsonobj_shrink(object)) {
-        return false;
-    }
 
-    // Need to recalculate index in case it actually shrank.
-    index = hash % object->_cap;
-    bucket = object->_data[index];
-    prev = bucket;
-    if (!bucket->next) {
-        if (bucket->entry._hash == hash
-                && strcmp(bucket->entry.key, key) == 0) {
-            object->_data[index] = NULL;
-            object->len--;
-            // Free the copy of key we previously had.
-            free(bucket->entry.key);
-            free(bucket);
-            return true;
-        } else {
-            _jsonobj_error_key(key);
-        }
-    } else {
-        do {
-            if (bucket->entry._hash == hash
-                    && strcmp(bucket->entry.key, key) == 0) {
-                prev->next = bucket->next;
-                object->len--;
-                free(bucket->entry.key);
-                free(bucket);
-                return true;
-            }
-            prev = bucket;
-            bucket = bucket->next;
-        } while (bucket);
-    }
-    return false;
+    // Free the copy of key we previously had, and leave a hole. The slot
+    // stays in use, for the lookups that went past it.
+    entry = &object->_entries[_jsonobj_get_index(object, slot)];
+    _jsonobj_free(object, entry->key);
+    entry->key = NULL;
+    _jsonobj_set_ctrl(object, slot, JSONOBJ_CTRL_DELETED);
+    object->len--;
+    return _jsonobj_shrink(object);
 }
 
 /** Report if the object has item associated with *key*. */
@@ -356,15 +580,17 @@ bool jsonobj_contains(JsonObject *object, char *key) {
 
 /** Clear object and free all of its resources. */
 void jsonobj_clear(JsonObject *object) {
-    size_t idx;
-    _JsonObjectBucket *bucket;
-
-    for (idx = 0; idx < object->_cap; idx++) {
-        bucket = object->_data[idx];
-        if (bucket) {
-            _jsonobj_destruct_bucket(bucket);
+    for (size_t i = 0; i < object->_nentries; i++) {
+        if (object->_entries[i].key) {
+            _jsonobj_free(object, object->_entries[i].key);
         }
     }
+    memset(
+        object->_ctrl, JSONOBJ_CTRL_EMPTY,
+        object->_cap + JSONOBJ_GROUP_WIDTH - 1
+    );
+    object->len = 0;
+    object->_nentries = 0;
 }
 
 /** Return an iterator to the object. Return NULL if allocation fails. */
@@ -375,37 +601,31 @@ JsonObjectIterator *jsonobj_iter(JsonObject *object) {
     }
 
     iter->key = NULL;
+    iter->key_len = 0;
     iter->value = NULL;
     iter->index = SIZE_MAX;
     iter->_index = SIZE_MAX;
     iter->_obj = object;
-    iter->_bucket = NULL;
     return iter;
 }
 
-/** Advance the iterator and report existence of next entry. */
+/** Advance the iterator and report existence of next entry.
+ *
+ * Entries come in the order they were first added.
+ */
 bool jsonobj_next(JsonObjectIterator *iter) {
     JsonObject *object = iter->_obj;
-    _JsonObjectBucket *bucket;
+    JsonObjectEntry *entry;
 
     iter->index++;
 
-    bucket = iter->_bucket;
-    if (bucket && bucket->next) {
-        bucket = bucket->next;
-        iter->_bucket = bucket;
-        iter->key = bucket->entry.key;
-        iter->value = &bucket->entry.value;
-        return true;
-    }
-
-    // Find whatever outermost bucket.
-    while (++iter->_index < object->_cap) {
-        bucket = object->_data[iter->_index];
-        if (bucket) {
-            iter->_bucket = bucket;
-            iter->key = bucket->entry.key;
-            iter->value = &bucket->entry.value;
+    // Skip the holes left by deleted entries.
+    while (++iter->_index < object->_nentries) {
+        entry = &object->_entries[iter->_index];
+        if (entry->key) {
+            iter->key = entry->key;
+            iter->key_len = entry->key_len;
+            iter->value = &entry->value;
             return true;
         }
     }
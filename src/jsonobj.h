@@ -12,7 +12,15 @@ JsonObject *jsonobj_construct(
     JsonObjectHashFunction hasher, size_t min_capacity
 );
 
-/** Destruct object. */
+/** Construct a JsonObject that takes all its memory from *arena*.
+ *
+ * A NULL *arena* means malloc(), as with jsonobj_construct().
+ */
+JsonObject *jsonobj_construct_in(
+    JsonArena *arena, JsonObjectHashFunction hasher, size_t min_capacity
+);
+
+/** Destruct object. Objects of an arena are left to the arena. */
 void jsonobj_destruct(JsonObject *object);
 
 /** Get the item associated with *key*. Querying non-existent key is error. */
@@ -21,6 +29,21 @@ JsonValue *jsonobj_getitem(JsonObject *object, char *key);
 /** Associate *key* with *value*. It can fail and return false. */
 bool jsonobj_setitem(JsonObject *object, char *key, JsonValue *value);
 
+/** Associate *key* with *value*, taking ownership of *key* without a copy.
+ *
+ * *key* must come from malloc(), or from the arena of the object if it has
+ * one. If the key is already there, *key* is released right away. On
+ * failure, *key* is left to the caller.
+ */
+bool jsonobj_setitem_adopt(JsonObject *object, char *key, JsonValue *value);
+
+/** Same as jsonobj_setitem_adopt(), with *len* the length of *key*, as the
+ * decoders already know it.
+ */
+bool jsonobj_setitem_adopt_n(
+    JsonObject *object, char *key, size_t len, JsonValue *value
+);
+
 /** Delete *key* and associated *value*. It can fail and return false. */
 bool jsonobj_delitem(JsonObject *object, char *key);
 
@@ -33,7 +56,10 @@ void jsonobj_clear(JsonObject *object);
 /** Return an iterator to the object. Return NULL if allocation fails. */
 JsonObjectIterator *jsonobj_iter(JsonObject *object);
 
-/** Advance the iterator and report existence of next entry. */
+/** Advance the iterator and report existence of next entry.
+ *
+ * Entries come in the order they were first added.
+ */
 bool jsonobj_next(JsonObjectIterator *iter);
 
 
@@ -2,383 +2,716 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <stddef.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "jsonerror.h"
 #include "lexer.h"
+#include "number.h"
+#include "simd.h"
+#include "structidx.h"
 #include "token.h"
 
 
+#define LEXER_STRING_GROW_FACTOR    2
+
+
 /** Ignore ' ', '\t', '\n', '\r' */
 #define _ISSPACE(c)         \
     ((c) == 0x20 || (c) == 0x09 || (c) == 0x0a || (c) == 0x0d)
 
 
-enum NumberPhase {
-    PHASE_INTEGER,
-    PHASE_FRACTION,
-    PHASE_EXPONENT
-};
+/** Record what went wrong under the cursor, and return false. */
+static inline bool _lexer_error(
+    Lexer *lexer, JsonErrorCode code, const char *msg
+) {
+    return jsonerror_set(&lexer->error, code, msg, lexer->pos);
+}
 
 
-Token *_lexer_error(Lexer *lexer, char *msg) {
-    char *p = &lexer->text[lexer->line_start];
-    size_t len = lexer->pos - lexer->line_start;
-    size_t pos;
-    size_t pos_oneth;
+void _lexer_advance(Lexer *lexer) {
+    lexer->chr = (++lexer->pos < lexer->len) ? lexer->text[lexer->pos] : 0;
+}
 
-    fprintf(stderr, "\nLexer: error: ");
-    fprintf(
-        stderr,
-        "%s (line %llu, pos %llu)\n",
-        msg,
-        lexer->line,
-        len
-    );
+/** Find the first index entry at or after the cursor, or the end of text. */
+static size_t _lexer_next_entry(Lexer *lexer) {
+    StructIndex *index = &lexer->index;
+    size_t entry;
 
-    do {
-        fprintf(stderr, "%c", *p++);
-    } while (*p != '\n' && *p);
-    fprintf(stderr, "\n");
-    // Super helpful error indicator!
-    for (pos = 0; pos < len; pos++) {
-        if (pos % 10) {
-            fprintf(stderr, "_");
-        } else {
-            pos_oneth = pos / 10;
-            while (pos_oneth >= 10) {
-                pos_oneth /= 10;
+    while (1) {
+        while (index->next < index->len) {
+            entry = index->base + index->pos[index->next];
+            if (entry >= lexer->pos) {
+                return entry;
             }
-            fprintf(stderr, "%llu", pos_oneth);
+            index->next++;
+        }
+        if (index->end >= lexer->len) {
+            return lexer->len;
         }
+        structidx_next_chunk(index, lexer->text, lexer->len);
     }
-    fprintf(stderr, "^\n");
+}
 
-    return NULL;
+void _lexer_skip_ws(Lexer *lexer) {
+    if (!_ISSPACE(lexer->chr)) {
+        return;
+    }
+    // Whatever lies between here and the next token is whitespace.
+    lexer->pos = _lexer_next_entry(lexer);
+    lexer->chr = (lexer->pos < lexer->len) ? lexer->text[lexer->pos] : 0;
 }
 
+/** Put the cursor at *pos*, which may be the end of text. */
+static inline void _lexer_seek(Lexer *lexer, size_t pos) {
+    lexer->pos = pos;
+    lexer->chr = (pos < lexer->len) ? lexer->text[pos] : 0;
+}
 
-void _lexer_advance(Lexer *lexer) {
-    if (lexer->chr == '\n') {
-        lexer->line++;
-        lexer->line_start = lexer->pos + 1;
-    }
-    lexer->chr = lexer->text[++lexer->pos];
+/** Fill *token* with the span from *start* up to the cursor. */
+static inline bool _lexer_token(
+    Lexer *lexer, Token *token, TokenKind kind, size_t start
+) {
+    token->kind = kind;
+    token->start = start;
+    token->len = lexer->pos - start;
+    return true;
 }
 
-void _lexer_skip_ws(Lexer *lexer) {
-    char *chr = &lexer->chr;
-    while (_ISSPACE(*chr) && *chr != 0) {
-        _lexer_advance(lexer);
+static bool _lexer_const(
+    Lexer *lexer, Token *token, TokenKind expected, char *ref
+) {
+    size_t start = lexer->pos;
+
+    if (!lexer_literal(lexer, ref)) {
+        return false;
     }
+    return _lexer_token(lexer, token, expected, start);
 }
 
-Token *_lexer_const(Lexer *lexer, TokenKind expected, char* ref) {
-    char *chr = &lexer->chr;
-    size_t start = lexer->pos;
-    size_t n = 0;
-    while (isalpha(*chr)) {
-        _lexer_advance(lexer);
-        n++;
+/** Make room for *need* bytes in a string buffer, growing geometrically. */
+static bool _lexer_string_reserve(char **buf, size_t *cap, size_t need) {
+    char *new_buf;
+    size_t new_cap;
+
+    if (need <= *cap) {
+        return true;
     }
-    if (strncmp(&(lexer->text[start]), ref, n)) {
-        return _lexer_error(lexer, "invalid literal");
-    } else {
-        return token_construct(expected, lexer->text, start, lexer->pos);
+    new_cap = *cap * LEXER_STRING_GROW_FACTOR;
+    if (new_cap < need) {
+        new_cap = need;
     }
+    if (!(new_buf = realloc(*buf, new_cap))) {
+        return false;
+    }
+    *buf = new_buf;
+    *cap = new_cap;
+    return true;
 }
 
-/** Look ahead far away to estimate needed buffer size. */
-size_t _lexer_string_recon(Lexer *lexer) {
-    size_t bufsize = 1;
-    bool esc = false;
-    char *chr = &lexer->text[lexer->pos];
-
-    while (*chr && (*chr != '"' || esc)) {
-        if (esc) {
-            esc = false;
-            if (*chr == 'u') {
-                bufsize++;
-            }
+/** Read the 4 hex digits of the "\u" escape at *esc* into *unit*. */
+static bool _lexer_hex4(Lexer *lexer, const char *esc, unsigned int *unit) {
+    const char *end = &lexer->text[lexer->len];
+    unsigned int digit;
+    char chr;
+
+    *unit = 0;
+    for (size_t i = 2; i < 6; i++) {
+        chr = (esc + i < end) ? esc[i] : 0;
+        if (chr >= '0' && chr <= '9') {
+            digit = chr - '0';
+        } else if ((chr | 0x20) >= 'a' && (chr | 0x20) <= 'f') {
+            digit = (chr | 0x20) - 'a' + 10;
         } else {
-            esc = (*chr == '\\');
-            bufsize++;
+            _lexer_seek(lexer, esc + i - lexer->text);
+            return _lexer_error(
+                lexer, JSON_ERROR_STRING, "illegal unicode sequence"
+            );
         }
-        chr++;
+        *unit = (*unit << 4) | digit;
     }
+    return true;
+}
 
-    return bufsize;
+/** Write the code point *cp* as UTF-8 into *out*, and return its length. */
+static size_t _lexer_utf8(unsigned int cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char) cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = (char) (0xc0 | (cp >> 6));
+        out[1] = (char) (0x80 | (cp & 0x3f));
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = (char) (0xe0 | (cp >> 12));
+        out[1] = (char) (0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char) (0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char) (0xf0 | (cp >> 18));
+    out[1] = (char) (0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char) (0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char) (0x80 | (cp & 0x3f));
+    return 4;
 }
 
-bool _lexer_hex(Lexer *lexer, char *buf, size_t *index) {
-    size_t i;
-    char *chr = &lexer->chr;
-    for (i = 0; i < 4; i++) {
-        if (isxdigit(*chr)) {
-            buf[(*index)++] = *chr;
-            _lexer_advance(lexer);
-        } else {
-            return false;
+/** Decode the "\u" escape at *esc* to UTF-8 into *out*, along with the
+ * low surrogate that must follow a high one.
+ *
+ * Return what follows the escape and store the number of bytes written in
+ * *written*, or report the error and return NULL. Strings are terminated,
+ * so "\u0000" is rejected.
+ */
+static const char *_lexer_unescape_unicode(
+    Lexer *lexer, const char *esc, char *out, size_t *written
+) {
+    const char *end = &lexer->text[lexer->len];
+    unsigned int cp;
+    unsigned int low;
+
+    if (!_lexer_hex4(lexer, esc, &cp)) {
+        return NULL;
+    }
+    if (cp >= 0xd800 && cp <= 0xdbff) {
+        low = 0;
+        if (esc + 7 < end && esc[6] == '\\' && esc[7] == 'u'
+                && !_lexer_hex4(lexer, esc + 6, &low)) {
+            return NULL;
         }
+        if (low < 0xdc00 || low > 0xdfff) {
+            _lexer_seek(lexer, esc - lexer->text);
+            _lexer_error(lexer, JSON_ERROR_STRING, "unpaired surrogate");
+            return NULL;
+        }
+        cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+        esc += 6;
+    } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+        _lexer_seek(lexer, esc - lexer->text);
+        _lexer_error(lexer, JSON_ERROR_STRING, "unpaired surrogate");
+        return NULL;
+    } else if (!cp) {
+        _lexer_seek(lexer, esc - lexer->text);
+        _lexer_error(lexer, JSON_ERROR_STRING, "NUL character in string");
+        return NULL;
     }
-    return true;
+    *written = _lexer_utf8(cp, out);
+    return esc + 6;
 }
 
-Token *_lexer_string(Lexer *lexer) {
-    size_t start = lexer->pos;
-    size_t start_local;
-    size_t i = 0;
-    bool esc = false;
-    char *chr = &lexer->chr;
-    char *buf = calloc(_lexer_string_recon(lexer), sizeof (char));
-    Token *token;
-
-    if (!buf) {
+/** Unescape the sequence after the backslash at *esc*, writing into *out*.
+ *
+ * Return what follows the sequence and store the number of bytes written
+ * in *written*, which is never more than the sequence takes in the text.
+ * Otherwise report the error and return NULL.
+ */
+static const char *_lexer_unescape(
+    Lexer *lexer, const char *esc, char *out, size_t *written
+) {
+    const char *end = &lexer->text[lexer->len];
+
+    if (esc + 1 >= end) {
+        _lexer_seek(lexer, lexer->len);
+        _lexer_error(lexer, JSON_ERROR_EOF, "EOF reached while parsing string");
         return NULL;
     }
+    *written = 1;
+    switch (esc[1]) {
+        case '"':
+        case '\\':
+        case '/':
+            *out = esc[1];
+            break;
+        case 'b':
+            *out = '\b';
+            break;
+        case 'f':
+            *out = '\f';
+            break;
+        case 'n':
+            *out = '\n';
+            break;
+        case 'r':
+            *out = '\r';
+            break;
+        case 't':
+            *out = '\t';
+            break;
+        case 'u':
+            return _lexer_unescape_unicode(lexer, esc, out, written);
+        default:
+            // Unrecognized escape.
+            _lexer_seek(lexer, esc + 1 - lexer->text);
+            _lexer_error(lexer, JSON_ERROR_STRING, "illegal escape");
+            return NULL;
+    }
+    return esc + 2;
+}
+
+/** Check that the run [*p*, *q*) of a string is valid UTF-8, unless it is
+ * known to be ASCII.
+ */
+static inline bool _lexer_utf8_run(
+    Lexer *lexer, const char *p, const char *q, bool non_ascii
+) {
+    const char *error;
 
-    while (*chr >= 0x20 && (*chr != '"' || esc)) {
-        if (esc) {
-            esc = false;
-            switch (*chr) {
-                case '"':
-                case '\\':
-                case '/':
-                    buf[i++] = *chr;
-                    _lexer_advance(lexer);
-                    break;
-                case 'b':
-                    buf[i++] = '\b';
-                    _lexer_advance(lexer);
-                    break;
-                case 'f':
-                    buf[i++] = '\f';
-                    _lexer_advance(lexer);
-                    break;
-                case 'n':
-                    buf[i++] = '\n';
-                    _lexer_advance(lexer);
-                    break;
-                case 'r':
-                    buf[i++] = '\r';
-                    _lexer_advance(lexer);
-                    break;
-                case 't':
-                    buf[i++] = '\t';
-                    _lexer_advance(lexer);
-                    break;
-                case 'u':
-                    // Need to process unicode sequence here.
-                    buf[i++] = '\\';
-                    buf[i++] = 'u';
-                    _lexer_advance(lexer);
-                    if (!_lexer_hex(lexer, buf, &i)) {
-                        free(buf);
-                        return _lexer_error(lexer, "illegal unicode sequence");
-                    }
-                    break;
-                default:
-                    // Unrecognized escape.
-                    free(buf);
-                    return _lexer_error(lexer, "illegal escape");
+    if (!non_ascii || (error = simd_find_utf8_error(p, q)) == q) {
+        return true;
+    }
+    _lexer_seek(lexer, error - lexer->text);
+    return _lexer_error(lexer, JSON_ERROR_STRING, "invalid UTF-8");
+}
+
+/** Consume the string under the cursor, checking it without unescaping. */
+static bool _lexer_string_skip(Lexer *lexer) {
+    const char *text = lexer->text;
+    const char *end = &text[lexer->len];
+    // Skip the opening quote.
+    const char *p = &text[lexer->pos + 1];
+    const char *q;
+    char scratch[4];
+    size_t written;
+    bool non_ascii;
+
+    while (1) {
+        q = simd_find_string_run(p, end, &non_ascii);
+        if (!_lexer_utf8_run(lexer, p, q, non_ascii)) {
+            return false;
+        } else if (q == end) {
+            _lexer_seek(lexer, lexer->len);
+            return _lexer_error(
+                lexer, JSON_ERROR_EOF, "EOF reached while parsing string"
+            );
+        } else if (*q == '"') {
+            break;
+        } else if (*q == '\\') {
+            if (!(p = _lexer_unescape(lexer, q, scratch, &written))) {
+                return false;
             }
         } else {
-            if (*chr == '\\') {
-                esc = true;
-            } else {
-                buf[i++] = *chr;
-            }
-            _lexer_advance(lexer);
+            _lexer_seek(lexer, q - text);
+            return _lexer_error(
+                lexer, JSON_ERROR_STRING, "control character in string"
+            );
         }
     }
 
-    if (!*chr) {
-        free(buf);
-        return _lexer_error(lexer, "EOF reached while parsing string");
-    } else {
-        _lexer_advance(lexer);
-    }
-
-    token = token_construct(TOKEN_STRING, buf, 0, i);
-    free(buf);
-    return token;
+    _lexer_seek(lexer, q + 1 - text);
+    return true;
 }
 
-Token *_lexer_number(Lexer *lexer) {
-    // A valid json number is also a valid c double.
-    // We can simply collect the entire sequence and pass it to strtod.
+static bool _lexer_string(Lexer *lexer, Token *token) {
     size_t start = lexer->pos;
-    size_t i = 0;
-    char *chr = &lexer->chr;
 
-    bool leading_zero = false;
-    enum NumberPhase phase = PHASE_INTEGER;
-
-    // integer: digit | onenine digits | '-' digit | '-' onenine digits
-    if (*chr == '-') {
-        _lexer_advance(lexer);
-    }
-    while (isdigit(*chr)) {
-        if (i == 0) {
-            if (*chr == '0') {
-                leading_zero = true;
-            }
-        } else if (leading_zero) {
-            return _lexer_error(lexer, "illegal integer sequence");
-        }
-        i++;
-        _lexer_advance(lexer);
+    if (!_lexer_string_skip(lexer)) {
+        return false;
     }
-    if (i == 0) {
-        // leading sign followed by no digit.
-        return _lexer_error(lexer, "sign not followed by digits");
+    return _lexer_token(lexer, token, TOKEN_STRING, start);
+}
+
+static bool _lexer_number(Lexer *lexer, Token *token) {
+    size_t start = lexer->pos;
+    Number number;
+
+    if (!lexer_number(lexer, &number)) {
+        return false;
     }
+    return _lexer_token(lexer, token, TOKEN_NUMBER, start);
+}
 
-    // fraction: "" | '.' digits
-    if (*chr == '.') {
-        _lexer_advance(lexer);
-        i = 0;
-        while (isdigit(*chr)) {
-            i++;
-            _lexer_advance(lexer);
-        }
-        if (i == 0) {
-            // dot without digit.
-            return _lexer_error(lexer, "dot not followed by digits");
+/** Unescape the string whose content starts at *p*, up to its closing quote.
+ *
+ * Return a newly allocated copy and store its length in *len* and the
+ * position of the closing quote in *close*, or return NULL on error.
+ */
+static char *_lexer_string_copy(
+    Lexer *lexer, const char *p, size_t *len, const char **close
+) {
+    const char *text = lexer->text;
+    const char *end = &text[lexer->len];
+    const char *q;
+    char *buf = NULL;
+    size_t cap = 0;
+    size_t n = 0;
+    size_t run;
+    size_t written;
+    bool non_ascii;
+
+    while (1) {
+        // Everything up to the next special byte is copied as is.
+        q = simd_find_string_run(p, end, &non_ascii);
+        run = q - p;
+        if (!_lexer_utf8_run(lexer, p, q, non_ascii)) {
+            free(buf);
+            return NULL;
         }
-    }
 
-    // exponent: "" | 'E' sign digits | 'e' sign digits
-    if (*chr == 'e' || *chr == 'E') {
-        _lexer_advance(lexer);
-        if (*chr == '+' || *chr == '-') {
-            _lexer_advance(lexer);
+        if (q < end && *q == '"' && !buf) {
+            // No escapes at all: one allocation of the exact size.
+            if (!(buf = malloc(run + 1))) {
+                return NULL;
+            }
+            memcpy(buf, p, run);
+            n = run;
+            break;
         }
-        i = 0;
-        while (isdigit(*chr)) {
-            i++;
-            _lexer_advance(lexer);
+
+        // An escape takes at most 4 bytes once decoded.
+        if (!_lexer_string_reserve(&buf, &cap, n + run + 4 + 1)) {
+            free(buf);
+            return NULL;
         }
-        if (i == 0) {
-            // exponent without digit.
-            return _lexer_error(lexer, "incomplete exponent");
+        memcpy(&buf[n], p, run);
+        n += run;
+
+        if (q == end) {
+            free(buf);
+            _lexer_seek(lexer, lexer->len);
+            _lexer_error(
+                lexer, JSON_ERROR_EOF, "EOF reached while parsing string"
+            );
+            return NULL;
+        } else if (*q == '"') {
+            break;
+        } else if (*q == '\\') {
+            if (!(p = _lexer_unescape(lexer, q, &buf[n], &written))) {
+                free(buf);
+                return NULL;
+            }
+            n += written;
+        } else {
+            free(buf);
+            _lexer_seek(lexer, q - text);
+            _lexer_error(
+                lexer, JSON_ERROR_STRING, "control character in string"
+            );
+            return NULL;
         }
     }
 
-    return token_construct(TOKEN_NUMBER, lexer->text, start, lexer->pos);
+    buf[n] = 0;
+    *len = n;
+    *close = q;
+    return buf;
 }
 
 
-/** Construct a lexer with given text, keeping copy of the text.
+/** Initialize a lexer over *len* bytes of *text*.
+ *
+ * The text is borrowed, not copied, and needs not be NUL-terminated.
+ * It must outlive the lexer.
+ */
+void lexer_init(Lexer *lexer, const char *text, size_t len) {
+    lexer->text = text;
+    lexer->len = len;
+    lexer->pos = 0;
+    lexer->chr = (len) ? text[0] : 0;
+    lexer->error.code = JSON_ERROR_NONE;
+    structidx_init(&lexer->index);
+}
+
+/** Construct a lexer over *len* bytes of *text*, borrowing the text.
  *
  * Return NULL when memory is low.
  */
-Lexer *lexer_construct(char *text) {
+Lexer *lexer_construct(const char *text, size_t len) {
     Lexer *lexer = malloc(sizeof (Lexer));
-    size_t len;
 
     if (!lexer) {
         return NULL;
     }
-    len = strlen(text);
-    lexer->text = malloc((len + 1) * sizeof (char));
-    if (!lexer->text) {
-        free(lexer);
-        return NULL;
-    }
-    if (!memcpy(lexer->text, text, len + 1)) {
-        free(lexer->text);
-        free(lexer);
-        return NULL;
-    }
-    lexer->pos = 0;
-    lexer->line = 1;
-    lexer->line_start = 0;
-    lexer->chr = lexer->text[lexer->pos];
+    lexer_init(lexer, text, len);
     return lexer;
 }
 
-/** Destruct lexer and also its text. */
+/** Destruct lexer. The borrowed text is left alone. */
 void lexer_destruct(Lexer *lexer) {
-    free(lexer->text);
     free(lexer);
 }
 
-/** Return next token. Token may be EOF or NULL. */
-Token *lexer_next(Lexer *lexer) {
-    char *chr = &lexer->chr;
-    size_t start;
-    size_t end;
-    Token *token;
-
-    while (*chr != 0) {
-        _lexer_skip_ws(lexer);
-        start = lexer->pos;
-        end = start + 1;
-
-        switch (*chr) {
-            case 'n':
-                return _lexer_const(lexer, TOKEN_NULL, "null");
-            case 't':
-                return _lexer_const(lexer, TOKEN_BOOL, "true");
-            case 'f':
-                return _lexer_const(lexer, TOKEN_BOOL, "false");
-            case '"':
-                _lexer_advance(lexer);
-                token = _lexer_string(lexer);
-                return token;
-            case ':':
-                token = token_construct(TOKEN_COLON, lexer->text, start, end);
-                _lexer_advance(lexer);
-                return token;
-            case '{':
-                token = token_construct(
-                    TOKEN_OPENING_CURLY_BRACKET, lexer->text, start, end
-                );
-                _lexer_advance(lexer);
-                return token;
-            case '}':
-                token = token_construct(
-                    TOKEN_CLOSING_CURLY_BRACKET, lexer->text, start, end
-                );
-                _lexer_advance(lexer);
-                return token;
-            case '[':
-                token = token_construct(
-                    TOKEN_OPENING_SQUARE_BRACKET, lexer->text, start, end
-                );
-                _lexer_advance(lexer);
-                return token;
-            case ']':
-                token = token_construct(
-                    TOKEN_CLOSING_SQUARE_BRACKET, lexer->text, start, end
+/** Move the cursor past the character under it. Does nothing at EOF. */
+void lexer_advance(Lexer *lexer) {
+    if (lexer->pos < lexer->len) {
+        _lexer_advance(lexer);
+    }
+}
+
+/** Skip whitespace and return the character under the cursor (0 at EOF). */
+char lexer_peek(Lexer *lexer) {
+    _lexer_skip_ws(lexer);
+    return lexer->chr;
+}
+
+/** Report if the cursor has reached the end of the text. */
+bool lexer_eof(Lexer *lexer) {
+    return lexer->pos >= lexer->len;
+}
+
+/** Put the cursor at *pos*, which must lie outside strings, like the start
+ * of a token or the end of the text.
+ *
+ * The structural index restarts from there unless it already covers it.
+ */
+void lexer_seek(Lexer *lexer, size_t pos) {
+    StructIndex *index = &lexer->index;
+
+    if (pos < index->base || pos > index->end) {
+        structidx_init(index);
+        index->base = pos;
+        index->end = pos;
+    } else {
+        // Entries before *pos* are passed over again when needed.
+        index->next = 0;
+    }
+    _lexer_seek(lexer, pos);
+}
+
+/** Move the cursor to the next token, without reading the one under it.
+ *
+ * Only the structural index is looked at, so a string or a number is
+ * passed over without a look at its content.
+ */
+void lexer_skip_token(Lexer *lexer) {
+    _lexer_skip_ws(lexer);
+    if (lexer->pos < lexer->len) {
+        lexer->pos++;
+        _lexer_seek(lexer, _lexer_next_entry(lexer));
+    }
+}
+
+/** Skip tokens by matching brackets until *depth* containers are closed. */
+static bool _lexer_skip(Lexer *lexer, size_t depth) {
+    char chr;
+
+    _lexer_skip_ws(lexer);
+    do {
+        // Always on an entry here, never on whitespace.
+        chr = lexer->chr;
+        if (chr == '[' || chr == '{') {
+            depth++;
+        } else if (chr == ']' || chr == '}') {
+            if (!depth) {
+                return _lexer_error(
+                    lexer, JSON_ERROR_SYNTAX, "unexpected bracket"
                 );
-                _lexer_advance(lexer);
-                return token;
-            case ',':
-                token = token_construct(TOKEN_COMMA, lexer->text, start, end);
-                _lexer_advance(lexer);
-                return token;
-            case '-':
-            case '0':
-            case '1':
-            case '2':
-            case '3':
-            case '4':
-            case '5':
-            case '6':
-            case '7':
-            case '8':
-            case '9':
-                return _lexer_number(lexer);
-            case 0:
-                return token_construct(TOKEN_EOF, "EOF", 0, 3);
-            default:
-                return _lexer_error(lexer, "unrecognized token");
-                break;
+            }
+            depth--;
+        } else if (lexer->pos >= lexer->len) {
+            return _lexer_error(
+                lexer, JSON_ERROR_EOF, "EOF reached while skipping value"
+            );
+        } else if (!depth && (chr == ',' || chr == ':')) {
+            return _lexer_error(lexer, JSON_ERROR_SYNTAX, "expected value");
         }
+        lexer->pos++;
+        _lexer_seek(lexer, _lexer_next_entry(lexer));
+    } while (depth);
+    return true;
+}
+
+/** Skip the value under the cursor by matching brackets, and leave the
+ * cursor on the next token. Report success.
+ *
+ * Only the structural index is looked at: strings, numbers and literals
+ * inside the value are neither read nor validated.
+ */
+bool lexer_skip_value(Lexer *lexer) {
+    return _lexer_skip(lexer, 0);
+}
+
+/** Like lexer_skip_value(), but from inside *depth* containers, which are
+ * all skipped to their closing bracket.
+ */
+bool lexer_skip_rest(Lexer *lexer, size_t depth) {
+    return _lexer_skip(lexer, depth);
+}
+
+/** Consume the literal *ref* under the cursor and report success. */
+bool lexer_literal(Lexer *lexer, char *ref) {
+    char *chr = &lexer->chr;
+    size_t start = lexer->pos;
+    size_t n = 0;
+
+    while (isalpha(*chr)) {
+        _lexer_advance(lexer);
+        n++;
+    }
+    if (n != strlen(ref) || strncmp(&(lexer->text[start]), ref, n)) {
+        _lexer_error(lexer, JSON_ERROR_LITERAL, "invalid literal");
+        return false;
     }
+    return true;
+}
+
+/** Consume the string under the cursor, opening quote included.
+ *
+ * Return a newly allocated, unescaped copy of its content and store its
+ * length in *len*, or return NULL on error.
+ */
+char *lexer_string(Lexer *lexer, size_t *len) {
+    const char *close;
+    // Skip the opening quote.
+    char *buf = _lexer_string_copy(
+        lexer, &lexer->text[lexer->pos + 1], len, &close
+    );
+
+    if (buf) {
+        _lexer_seek(lexer, close + 1 - lexer->text);
+    }
+    return buf;
+}
+
+/** Consume the string under the cursor, unescaping its content into *out*.
+ *
+ * *out* needs room for the string as it appears in the text, quotes
+ * included, which is always enough for the terminated content. Store the
+ * length of the content in *len* and report success.
+ */
+bool lexer_string_into(Lexer *lexer, char *out, size_t *len) {
+    const char *text = lexer->text;
+    const char *end = &text[lexer->len];
+    // Skip the opening quote.
+    const char *p = &text[lexer->pos + 1];
+    const char *q;
+    size_t n = 0;
+    size_t written;
+    bool non_ascii;
 
-    return token_construct(TOKEN_EOF, "EOF", 0, 3);
+    while (1) {
+        q = simd_find_string_run(p, end, &non_ascii);
+        if (!_lexer_utf8_run(lexer, p, q, non_ascii)) {
+            return false;
+        }
+        memcpy(&out[n], p, q - p);
+        n += q - p;
+
+        if (q == end) {
+            _lexer_seek(lexer, lexer->len);
+            return _lexer_error(
+                lexer, JSON_ERROR_EOF, "EOF reached while parsing string"
+            );
+        } else if (*q == '"') {
+            break;
+        } else if (*q == '\\') {
+            if (!(p = _lexer_unescape(lexer, q, &out[n], &written))) {
+                return false;
+            }
+            n += written;
+        } else {
+            _lexer_seek(lexer, q - text);
+            return _lexer_error(
+                lexer, JSON_ERROR_STRING, "control character in string"
+            );
+        }
+    }
+
+    out[n] = 0;
+    _lexer_seek(lexer, q + 1 - text);
+    *len = n;
+    return true;
+}
+
+/** Unescape the content of the string *token* into *out*, which needs room
+ * for the token. Store the length of the content in *len*.
+ *
+ * The cursor is left alone, so this works for any token already read.
+ */
+bool lexer_token_string_into(
+    Lexer *lexer, const Token *token, char *out, size_t *len
+) {
+    size_t pos = lexer->pos;
+    bool done;
+
+    _lexer_seek(lexer, token->start);
+    done = lexer_string_into(lexer, out, len);
+    _lexer_seek(lexer, pos);
+    return done;
+}
+
+/** Return a newly allocated, unescaped copy of the content of the string
+ * *token*, and store its length in *len*. Return NULL when memory is low.
+ *
+ * The cursor is left alone, so this works for any token already read.
+ */
+char *lexer_token_string(Lexer *lexer, const Token *token, size_t *len) {
+    const char *close;
+
+    return _lexer_string_copy(
+        lexer, &lexer->text[token->start + 1], len, &close
+    );
+}
+
+/** Consume the number under the cursor and report success.
+ *
+ * The number spans from the cursor position before the call up to the
+ * cursor position after it, and is taken apart into *number*.
+ */
+bool lexer_number(Lexer *lexer, Number *number) {
+    const char *error;
+    size_t n = number_scan(
+        &lexer->text[lexer->pos], &lexer->text[lexer->len], number, &error
+    );
+
+    _lexer_seek(lexer, lexer->pos + n);
+    if (error) {
+        _lexer_error(lexer, JSON_ERROR_NUMBER, error);
+        return false;
+    }
+    return true;
+}
+
+/** Read the next token into *token* and report success.
+ *
+ * Nothing is allocated: a token is only a span of the text. See
+ * lexer_token_string() for the value of a string. At the end of the text,
+ * the token is TOKEN_EOF.
+ */
+bool lexer_next(Lexer *lexer, Token *token) {
+    size_t start;
+
+    _lexer_skip_ws(lexer);
+    start = lexer->pos;
+
+    switch (lexer->chr) {
+        case 'n':
+            return _lexer_const(lexer, token, TOKEN_NULL, "null");
+        case 't':
+            return _lexer_const(lexer, token, TOKEN_BOOL, "true");
+        case 'f':
+            return _lexer_const(lexer, token, TOKEN_BOOL, "false");
+        case '"':
+            return _lexer_string(lexer, token);
+        case ':':
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ',':
+            // Punctuation kinds are the characters themselves.
+            _lexer_advance(lexer);
+            return _lexer_token(lexer, token, lexer->text[start], start);
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return _lexer_number(lexer, token);
+        case 0:
+            if (!lexer_eof(lexer)) {
+                return _lexer_error(
+                    lexer, JSON_ERROR_CHARACTER, "unexpected NUL character"
+                );
+            }
+            return _lexer_token(lexer, token, TOKEN_EOF, start);
+        default:
+            return _lexer_error(
+                lexer, JSON_ERROR_CHARACTER, "unrecognized token"
+            );
+    }
 }
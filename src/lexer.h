@@ -1,28 +1,131 @@
 #ifndef __JSON_LEXER_H__
 #define __JSON_LEXER_H__
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "json.h"
+#include "number.h"
+#include "structidx.h"
 #include "token.h"
 
 
+/**
+ * Whitespace is skipped with the help of a structural index, which is built
+ * ahead of the cursor one chunk at a time.
+ * Lines are not tracked: errors only keep their offset, and are located
+ * when reported.
+ */
 typedef struct Lexer {
-    char *text;
+    const char *text;
+    size_t len;
     size_t pos;
-    size_t line;
-    size_t line_start;
     char chr;
+    // The last error, of the lexer or of whatever reads from it.
+    JsonError error;
+    StructIndex index;
 } Lexer;
 
 
-/** Construct a lexer with given text, keeping copy of the text.
+/** Initialize a lexer over *len* bytes of *text*.
+ *
+ * The text is borrowed, not copied, and needs not be NUL-terminated.
+ * It must outlive the lexer.
+ */
+void lexer_init(Lexer *lexer, const char *text, size_t len);
+
+/** Construct a lexer over *len* bytes of *text*, borrowing the text.
  *
  * Return NULL when memory is low.
  */
-Lexer *lexer_construct(char *text);
+Lexer *lexer_construct(const char *text, size_t len);
 
-/** Destruct lexer and also its text. */
+/** Destruct lexer. The borrowed text is left alone. */
 void lexer_destruct(Lexer *lexer);
 
-/** Return next token. Token may be EOF or NULL. */
-Token *lexer_next(Lexer *lexer);
+/** Read the next token into *token* and report success.
+ *
+ * Nothing is allocated: a token is only a span of the text. See
+ * lexer_token_string() for the value of a string. At the end of the text,
+ * the token is TOKEN_EOF.
+ */
+bool lexer_next(Lexer *lexer, Token *token);
+
+/** Move the cursor past the character under it. Does nothing at EOF. */
+void lexer_advance(Lexer *lexer);
+
+/** Skip whitespace and return the character under the cursor (0 at EOF). */
+char lexer_peek(Lexer *lexer);
+
+/** Report if the cursor has reached the end of the text. */
+bool lexer_eof(Lexer *lexer);
+
+/** Put the cursor at *pos*, which must lie outside strings, like the start
+ * of a token or the end of the text.
+ *
+ * The structural index restarts from there unless it already covers it.
+ */
+void lexer_seek(Lexer *lexer, size_t pos);
+
+/** Move the cursor to the next token, without reading the one under it.
+ *
+ * Only the structural index is looked at, so a string or a number is
+ * passed over without a look at its content.
+ */
+void lexer_skip_token(Lexer *lexer);
+
+/** Skip the value under the cursor by matching brackets, and leave the
+ * cursor on the next token. Report success.
+ *
+ * Only the structural index is looked at: strings, numbers and literals
+ * inside the value are neither read nor validated.
+ */
+bool lexer_skip_value(Lexer *lexer);
+
+/** Like lexer_skip_value(), but from inside *depth* containers, which are
+ * all skipped to their closing bracket.
+ */
+bool lexer_skip_rest(Lexer *lexer, size_t depth);
+
+/** Consume the literal *ref* under the cursor and report success. */
+bool lexer_literal(Lexer *lexer, char *ref);
+
+/** Consume the string under the cursor, opening quote included.
+ *
+ * Return a newly allocated, unescaped copy of its content and store its
+ * length in *len*, or return NULL on error.
+ */
+char *lexer_string(Lexer *lexer, size_t *len);
+
+/** Consume the string under the cursor, unescaping its content into *out*.
+ *
+ * *out* needs room for the string as it appears in the text, quotes
+ * included, which is always enough for the terminated content. Store the
+ * length of the content in *len* and report success.
+ */
+bool lexer_string_into(Lexer *lexer, char *out, size_t *len);
+
+/** Unescape the content of the string *token* into *out*, which needs room
+ * for the token. Store the length of the content in *len*.
+ *
+ * The cursor is left alone, so this works for any token already read.
+ */
+bool lexer_token_string_into(
+    Lexer *lexer, const Token *token, char *out, size_t *len
+);
+
+/** Return a newly allocated, unescaped copy of the content of the string
+ * *token*, and store its length in *len*. Return NULL when memory is low.
+ *
+ * The cursor is left alone, so this works for any token already read.
+ */
+char *lexer_token_string(Lexer *lexer, const Token *token, size_t *len);
+
+/** Consume the number under the cursor and report success.
+ *
+ * The number spans from the cursor position before the call up to the
+ * cursor position after it, and is taken apart into *number*.
+ */
+bool lexer_number(Lexer *lexer, Number *number);
 
 
 #endif
@@ -0,0 +1,673 @@
+#include <float.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "number.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+#define NUMBER_BUFSIZE              64
+// Exponents beyond this are infinity or zero whatever the digits are.
+#define NUMBER_EXPONENT_LIMIT       100000
+#define NUMBER_MANTISSA_BITS        52
+#define NUMBER_INFINITE_POWER       0x7ff
+#define NUMBER_EXPONENT_BIAS        1023
+
+
+// See numtable.c.
+extern const uint64_t _NUMBER_POW5_128[];
+extern const uint64_t _NUMBER_POW10_64[];
+
+static const double _NUMBER_POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+static const uint64_t _NUMBER_POW10_U64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+// Two digits at a time, from "00" to "99".
+static const char _NUMBER_DIGIT_PAIRS[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+typedef struct _NumberU128 {
+    uint64_t high;
+    uint64_t low;
+} _NumberU128;
+
+
+static inline _NumberU128 _number_mul(uint64_t a, uint64_t b) {
+    _NumberU128 r;
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128) a * b;
+    r.high = (uint64_t) (p >> 64);
+    r.low = (uint64_t) p;
+#elif defined(_MSC_VER) && defined(_M_X64)
+    r.low = _umul128(a, b, &r.high);
+#else
+    uint64_t a_lo = (uint32_t) a;
+    uint64_t a_hi = a >> 32;
+    uint64_t b_lo = (uint32_t) b;
+    uint64_t b_hi = b >> 32;
+    uint64_t p0 = a_lo * b_lo;
+    uint64_t p1 = a_lo * b_hi;
+    uint64_t p2 = a_hi * b_lo;
+    uint64_t mid = (p0 >> 32) + (uint32_t) p1 + (uint32_t) p2;
+    r.low = (mid << 32) | (uint32_t) p0;
+    r.high = a_hi * b_hi + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+    return r;
+}
+
+static inline int _number_clz64(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - (int) index;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+/** Eisel-Lemire: IEEE bits, sign aside, of the double nearest to w * 10^q.
+ *
+ * The 128-bit product with the tabulated power of five is always precise
+ * enough when *w* is exact (Mushtak & Lemire, 2023).
+ */
+static uint64_t _number_eisel_lemire(int64_t q, uint64_t w) {
+    _NumberU128 first;
+    _NumberU128 second;
+    size_t index;
+    int lz;
+    int upperbit;
+    int shift;
+    uint64_t mantissa;
+    int64_t power2;
+
+    if (w == 0 || q < NUMBER_POW5_MIN) {
+        return 0;
+    }
+    if (q > NUMBER_POW5_MAX) {
+        return (uint64_t) NUMBER_INFINITE_POWER << NUMBER_MANTISSA_BITS;
+    }
+
+    lz = _number_clz64(w);
+    w <<= lz;
+    index = 2 * (size_t) (q - NUMBER_POW5_MIN);
+    first = _number_mul(w, _NUMBER_POW5_128[index]);
+    // Only look at the low half of the power when the bits we keep might
+    // still change.
+    if ((first.high & 0x1ff) == 0x1ff) {
+        second = _number_mul(w, _NUMBER_POW5_128[index + 1]);
+        first.low += second.high;
+        if (second.high > first.low) {
+            first.high++;
+        }
+    }
+
+    upperbit = (int) (first.high >> 63);
+    shift = upperbit + 64 - NUMBER_MANTISSA_BITS - 3;
+    mantissa = first.high >> shift;
+    // floor(q * log2(10)) + 63, then biased.
+    power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz
+        + NUMBER_EXPONENT_BIAS;
+
+    if (power2 <= 0) {
+        // Subnormal, or zero.
+        if (-power2 + 1 >= 64) {
+            return 0;
+        }
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        // Rounding may have carried into the smallest normal.
+        power2 = (mantissa < ((uint64_t) 1 << NUMBER_MANTISSA_BITS)) ? 0 : 1;
+        return mantissa | ((uint64_t) power2 << NUMBER_MANTISSA_BITS);
+    }
+
+    // Exactly halfway, which only happens for small q: round to even.
+    if (first.low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1
+            && (mantissa << shift) == first.high) {
+        mantissa &= ~(uint64_t) 1;
+    }
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((uint64_t) 2 << NUMBER_MANTISSA_BITS)) {
+        mantissa = (uint64_t) 1 << NUMBER_MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~((uint64_t) 1 << NUMBER_MANTISSA_BITS);
+    if (power2 >= NUMBER_INFINITE_POWER) {
+        return (uint64_t) NUMBER_INFINITE_POWER << NUMBER_MANTISSA_BITS;
+    }
+    return mantissa | ((uint64_t) power2 << NUMBER_MANTISSA_BITS);
+}
+
+/** Last resort for the rare undecidable cases, made locale independent. */
+static double _number_strtod(const Number *number) {
+    char buf[NUMBER_BUFSIZE];
+    char *copy = buf;
+    char point = localeconv()->decimal_point[0];
+    char *dot;
+    double value;
+
+    if (number->len >= NUMBER_BUFSIZE && !(copy = malloc(number->len + 1))) {
+        // Out of memory: the first 19 digits are a fine approximation.
+        return (number->negative ? -1.0 : 1.0) * (double) number->mantissa;
+    }
+    memcpy(copy, number->start, number->len);
+    copy[number->len] = 0;
+    if ((dot = strchr(copy, '.'))) {
+        *dot = point;
+    }
+    value = strtod(copy, NULL);
+    if (copy != buf) {
+        free(copy);
+    }
+    return value;
+}
+
+
+/** Validate and take apart the number at the start of [*p*, *end*).
+ *
+ * Return the length of the number and set *error* to NULL. On failure, set
+ * *error* to a message and return the offset of the offending character.
+ */
+size_t number_scan(
+    const char *p, const char *end, Number *number, const char **error
+) {
+    const char *start = p;
+    uint64_t mantissa = 0;
+    int64_t exponent = 0;
+    int64_t explicit = 0;
+    unsigned int digits = 0;
+    bool truncated = false;
+    bool negative_exponent = false;
+    unsigned int d;
+
+    *error = NULL;
+    number->negative = false;
+    number->integer = true;
+
+    // integer: digit | onenine digits | '-' digit | '-' onenine digits
+    if (p < end && *p == '-') {
+        number->negative = true;
+        p++;
+    }
+    if (p >= end || (unsigned int) (*p - '0') > 9) {
+        // leading sign followed by no digit.
+        *error = "sign not followed by digits";
+        return p - start;
+    }
+    if (*p == '0') {
+        p++;
+        if (p < end && (unsigned int) (*p - '0') <= 9) {
+            *error = "illegal integer sequence";
+            return p - start;
+        }
+    } else {
+        for (; p < end && (d = (unsigned int) (*p - '0')) <= 9; p++) {
+            if (digits < NUMBER_MAX_DIGITS) {
+                mantissa = mantissa * 10 + d;
+                digits++;
+            } else {
+                // Dropped digits still scale the value.
+                exponent++;
+                truncated |= d != 0;
+            }
+        }
+    }
+
+    // fraction: "" | '.' digits
+    if (p < end && *p == '.') {
+        number->integer = false;
+        p++;
+        if (p >= end || (unsigned int) (*p - '0') > 9) {
+            // dot without digit.
+            *error = "dot not followed by digits";
+            return p - start;
+        }
+        for (; p < end && (d = (unsigned int) (*p - '0')) <= 9; p++) {
+            if (digits < NUMBER_MAX_DIGITS) {
+                mantissa = mantissa * 10 + d;
+                exponent--;
+                // Leading zeros of a fraction are not significant.
+                digits += mantissa != 0;
+            } else {
+                truncated |= d != 0;
+            }
+        }
+    }
+
+    // exponent: "" | 'E' sign digits | 'e' sign digits
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        number->integer = false;
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative_exponent = *p == '-';
+            p++;
+        }
+        if (p >= end || (unsigned int) (*p - '0') > 9) {
+            // exponent without digit.
+            *error = "incomplete exponent";
+            return p - start;
+        }
+        for (; p < end && (d = (unsigned int) (*p - '0')) <= 9; p++) {
+            if (explicit < NUMBER_EXPONENT_LIMIT) {
+                explicit = explicit * 10 + d;
+            }
+        }
+        exponent += negative_exponent ? -explicit : explicit;
+    }
+
+    number->start = start;
+    number->len = p - start;
+    number->mantissa = mantissa;
+    number->exponent = exponent;
+    number->truncated = truncated;
+    return p - start;
+}
+
+/** Convert to the nearest double, ties to even, independently of locale. */
+double number_to_double(const Number *number) {
+    uint64_t bits;
+    double value;
+
+#if FLT_EVAL_METHOD == 0
+    // Clinger's fast path: both operands are exact, so is the one rounding.
+    if (!number->truncated
+            && number->exponent >= -22 && number->exponent <= 22
+            && number->mantissa <= ((uint64_t) 1 << 53)) {
+        value = (double) number->mantissa;
+        if (number->exponent < 0) {
+            value /= _NUMBER_POW10[-number->exponent];
+        } else {
+            value *= _NUMBER_POW10[number->exponent];
+        }
+        return number->negative ? -value : value;
+    }
+#endif
+
+    bits = _number_eisel_lemire(number->exponent, number->mantissa);
+    if (number->truncated
+            && bits != _number_eisel_lemire(
+                number->exponent, number->mantissa + 1
+            )) {
+        // The dropped digits decide the rounding.
+        return _number_strtod(number);
+    }
+    bits |= (uint64_t) number->negative << 63;
+    memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+/** Store the value in *value* if the number is integral and fits int64_t.
+ *
+ * "-0" does not fit, since the sign would be lost.
+ */
+bool number_to_int64(const Number *number, int64_t *value) {
+    uint64_t magnitude = number->mantissa;
+
+    // More than 19 digits never fit.
+    if (!number->integer || number->exponent != 0) {
+        return false;
+    }
+    if (!number->negative) {
+        if (magnitude > INT64_MAX) {
+            return false;
+        }
+        *value = (int64_t) magnitude;
+    } else {
+        if (magnitude == 0 || magnitude > (uint64_t) INT64_MAX + 1) {
+            return false;
+        }
+        *value = (int64_t) (0 - magnitude);
+    }
+    return true;
+}
+
+/** Store the value in *value* if the number is integral and fits uint64_t. */
+bool number_to_uint64(const Number *number, uint64_t *value) {
+    uint64_t result = 0;
+    unsigned int d;
+
+    if (!number->integer || number->negative || number->exponent > 1) {
+        return false;
+    }
+    if (number->exponent == 0) {
+        *value = number->mantissa;
+        return true;
+    }
+    // Exactly 20 digits: redo it with overflow checks.
+    for (size_t i = 0; i < number->len; i++) {
+        d = (unsigned int) (number->start[i] - '0');
+        if (result > (UINT64_MAX - d) / 10) {
+            return false;
+        }
+        result = result * 10 + d;
+    }
+    *value = result;
+    return true;
+}
+
+
+/** A floating point number f * 2^e with a 64-bit significand, for Grisu. */
+typedef struct _NumberFp {
+    uint64_t f;
+    int e;
+} _NumberFp;
+
+
+/** The product of *a* and *b*, rounded to 64 bits. */
+static inline _NumberFp _number_fp_mul(_NumberFp a, _NumberFp b) {
+    _NumberU128 product = _number_mul(a.f, b.f);
+
+    return (_NumberFp) {
+        product.high + (product.low >> 63), a.e + b.e + 64
+    };
+}
+
+static inline _NumberFp _number_fp_normalize(_NumberFp x) {
+    int lz = _number_clz64(x.f);
+
+    return (_NumberFp) { x.f << lz, x.e - lz };
+}
+
+/** The cached power of ten that brings a normalized number of binary
+ * exponent *e* to one in [-60, -32], and its decimal exponent, negated,
+ * in *k*.
+ */
+static _NumberFp _number_cached_power(int e, int *k) {
+    // Always positive, so truncating rounds down.
+    double dk = (-61 - e) * 0.30102999566398114
+        - NUMBER_POW10_CACHED_MIN - 1;
+    int smallest = (int) dk;
+    size_t index;
+    int power;
+
+    if (dk - smallest > 0.0) {
+        smallest++;
+    }
+    index = (size_t) (smallest / NUMBER_POW10_CACHED_STEP + 1);
+    power = NUMBER_POW10_CACHED_MIN + (int) index * NUMBER_POW10_CACHED_STEP;
+    *k = -power;
+    // floor(power * log2(10)) - 63.
+    return (_NumberFp) {
+        _NUMBER_POW10_64[index], ((217706 * power) >> 16) - 63
+    };
+}
+
+static inline int _number_count_digits32(uint32_t n) {
+    if (n < 10) return 1;
+    if (n < 100) return 2;
+    if (n < 1000) return 3;
+    if (n < 10000) return 4;
+    if (n < 100000) return 5;
+    if (n < 1000000) return 6;
+    if (n < 10000000) return 7;
+    if (n < 100000000) return 8;
+    return 9;
+}
+
+/** Move the last digit down as long as that brings it closer to *w*, while
+ * it stays within *delta* of the upper bound.
+ */
+static inline void _number_grisu_round(
+    char *buf,
+    int len,
+    uint64_t delta,
+    uint64_t rest,
+    uint64_t ten_kappa,
+    uint64_t wp_w
+) {
+    while (rest < wp_w && delta - rest >= ten_kappa
+            && (rest + ten_kappa < wp_w
+                || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+/** Generate the fewest digits of *upper* that stay within *delta* of it,
+ * and add the power of ten they were cut at to *k*.
+ */
+static int _number_digit_gen(
+    _NumberFp w, _NumberFp upper, uint64_t delta, char *buf, int *k
+) {
+    _NumberFp one = { (uint64_t) 1 << -upper.e, upper.e };
+    uint64_t wp_w = upper.f - w.f;
+    uint32_t p1 = (uint32_t) (upper.f >> -one.e);
+    uint64_t p2 = upper.f & (one.f - 1);
+    int kappa = _number_count_digits32(p1);
+    int len = 0;
+    uint32_t d;
+    uint64_t rest;
+
+    // The integral part, a digit at a time.
+    while (kappa > 0) {
+        switch (kappa) {
+            case 9: d = p1 / 100000000; p1 %= 100000000; break;
+            case 8: d = p1 / 10000000; p1 %= 10000000; break;
+            case 7: d = p1 / 1000000; p1 %= 1000000; break;
+            case 6: d = p1 / 100000; p1 %= 100000; break;
+            case 5: d = p1 / 10000; p1 %= 10000; break;
+            case 4: d = p1 / 1000; p1 %= 1000; break;
+            case 3: d = p1 / 100; p1 %= 100; break;
+            case 2: d = p1 / 10; p1 %= 10; break;
+            default: d = p1; p1 = 0; break;
+        }
+        if (d || len) {
+            buf[len++] = (char) ('0' + d);
+        }
+        kappa--;
+        rest = ((uint64_t) p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            _number_grisu_round(
+                buf, len, delta, rest,
+                _NUMBER_POW10_U64[kappa] << -one.e, wp_w
+            );
+            return len;
+        }
+    }
+
+    // Then the fractional part.
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t) (p2 >> -one.e);
+        if (d || len) {
+            buf[len++] = (char) ('0' + d);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            _number_grisu_round(
+                buf, len, delta, p2, one.f,
+                -kappa < 20 ? wp_w * _NUMBER_POW10_U64[-kappa] : 0
+            );
+            return len;
+        }
+    }
+}
+
+/** Grisu2 (Loitsch, 2010): write the digits of the positive, finite
+ * *value* to *buf* and set *k* so that they read back as digits * 10^k.
+ *
+ * The digits are the shortest within the rounding interval of *value*
+ * narrowed by an ulp at each end, which is the true shortest nearly always.
+ */
+static int _number_grisu2(double value, char *buf, int *k) {
+    uint64_t bits;
+    int biased;
+    _NumberFp v;
+    _NumberFp upper;
+    _NumberFp lower;
+    _NumberFp cached;
+
+    memcpy(&bits, &value, sizeof bits);
+    biased = (int) (bits >> NUMBER_MANTISSA_BITS);
+    v.f = bits & (((uint64_t) 1 << NUMBER_MANTISSA_BITS) - 1);
+    if (biased) {
+        v.f |= (uint64_t) 1 << NUMBER_MANTISSA_BITS;
+        v.e = biased - NUMBER_EXPONENT_BIAS - NUMBER_MANTISSA_BITS;
+    } else {
+        v.e = 1 - NUMBER_EXPONENT_BIAS - NUMBER_MANTISSA_BITS;
+    }
+
+    // The halfway points to the neighbours, on a common exponent. Below a
+    // power of two, the gap to the previous double is half as wide.
+    upper = _number_fp_normalize((_NumberFp) { (v.f << 1) + 1, v.e - 1 });
+    if (v.f == (uint64_t) 1 << NUMBER_MANTISSA_BITS && biased > 1) {
+        lower = (_NumberFp) { (v.f << 2) - 1, v.e - 2 };
+    } else {
+        lower = (_NumberFp) { (v.f << 1) - 1, v.e - 1 };
+    }
+    lower.f <<= lower.e - upper.e;
+    lower.e = upper.e;
+
+    cached = _number_cached_power(upper.e, k);
+    v = _number_fp_mul(_number_fp_normalize(v), cached);
+    upper = _number_fp_mul(upper, cached);
+    lower = _number_fp_mul(lower, cached);
+    // Stay clear of the error of the products.
+    upper.f--;
+    lower.f++;
+    return _number_digit_gen(v, upper, upper.f - lower.f, buf, k);
+}
+
+/** Write the decimal exponent *k*, without a plus sign. */
+static size_t _number_write_exponent(int k, char *buf) {
+    char *p = buf;
+
+    if (k < 0) {
+        *p++ = '-';
+        k = -k;
+    }
+    if (k >= 100) {
+        *p++ = (char) ('0' + k / 100);
+        k %= 100;
+        memcpy(p, &_NUMBER_DIGIT_PAIRS[k * 2], 2);
+        p += 2;
+    } else if (k >= 10) {
+        memcpy(p, &_NUMBER_DIGIT_PAIRS[k * 2], 2);
+        p += 2;
+    } else {
+        *p++ = (char) ('0' + k);
+    }
+    return (size_t) (p - buf);
+}
+
+/** Lay the *len* digits at *buf*, worth digits * 10^k, out as a number. */
+static size_t _number_prettify(char *buf, int len, int k) {
+    // Position of the decimal point after the first digit.
+    int point = len + k;
+
+    if (k >= 0 && point <= 21) {
+        // 1234e7 is 12340000000.
+        memset(&buf[len], '0', (size_t) k);
+        return (size_t) point;
+    }
+    if (point > 0 && point <= 21) {
+        // 1234e-2 is 12.34.
+        memmove(&buf[point + 1], &buf[point], (size_t) (len - point));
+        buf[point] = '.';
+        return (size_t) len + 1;
+    }
+    if (point > -6 && point <= 0) {
+        // 1234e-6 is 0.001234.
+        memmove(&buf[2 - point], buf, (size_t) len);
+        buf[0] = '0';
+        buf[1] = '.';
+        memset(&buf[2], '0', (size_t) -point);
+        return (size_t) (len + 2 - point);
+    }
+    if (len == 1) {
+        // 1e30.
+        buf[1] = 'e';
+        return 2 + _number_write_exponent(point - 1, &buf[2]);
+    }
+    // 1234e30 is 1.234e33.
+    memmove(&buf[2], &buf[1], (size_t) len - 1);
+    buf[1] = '.';
+    buf[len + 1] = 'e';
+    return (size_t) len + 2 + _number_write_exponent(point - 1, &buf[len + 2]);
+}
+
+/** Write the shortest text that reads back as the finite *value*, in most
+ * cases, and never one that reads back as another double.
+ *
+ * Integral values below 2^53 are written as integers; others use an
+ * exponent once they would need more than 21 digits, or 6 leading zeros.
+ * Return the length written to *buf*, which is not terminated.
+ */
+size_t number_format_double(double value, char *buf) {
+    uint64_t bits;
+    size_t sign;
+    int len;
+    int k;
+
+    memcpy(&bits, &value, sizeof bits);
+    sign = (size_t) (bits >> 63);
+    if (sign) {
+        *buf = '-';
+        value = -value;
+    }
+    // Integers of the exact range need no search for digits.
+    if (value < 9007199254740992.0 && value == (double) (uint64_t) value) {
+        return sign + number_format_uint64((uint64_t) value, &buf[sign]);
+    }
+    len = _number_grisu2(value, &buf[sign], &k);
+    return sign + _number_prettify(&buf[sign], len, k);
+}
+
+/** Write *value* in decimal to *buf*, unterminated, and return the length. */
+size_t number_format_int64(int64_t value, char *buf) {
+    if (value < 0) {
+        *buf = '-';
+        return 1 + number_format_uint64(0 - (uint64_t) value, &buf[1]);
+    }
+    return number_format_uint64((uint64_t) value, buf);
+}
+
+/** Write *value* in decimal to *buf*, unterminated, and return the length. */
+size_t number_format_uint64(uint64_t value, char *buf) {
+    char digits[20];
+    char *p = &digits[sizeof digits];
+    size_t len;
+
+    // From the right, two digits at a time.
+    while (value >= 100) {
+        p -= 2;
+        memcpy(p, &_NUMBER_DIGIT_PAIRS[(value % 100) * 2], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        p -= 2;
+        memcpy(p, &_NUMBER_DIGIT_PAIRS[value * 2], 2);
+    } else {
+        *--p = (char) ('0' + value);
+    }
+    len = (size_t) (&digits[sizeof digits] - p);
+    memcpy(buf, p, len);
+    return len;
+}
@@ -0,0 +1,78 @@
+#ifndef __JSON_NUMBER_H__
+#define __JSON_NUMBER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Range of decimal exponents covered by the power-of-five table. */
+#define NUMBER_POW5_MIN             -342
+#define NUMBER_POW5_MAX             308
+
+/** Significant digits that always fit in the 64-bit mantissa. */
+#define NUMBER_MAX_DIGITS           19
+
+/** Decimal exponents of the cached powers of ten used for formatting. */
+#define NUMBER_POW10_CACHED_MIN     -348
+#define NUMBER_POW10_CACHED_MAX     340
+#define NUMBER_POW10_CACHED_STEP    8
+
+/** Room for any number written by the number_format_* functions. */
+#define NUMBER_FORMAT_BUFSIZE       32
+
+
+/**
+ * A JSON number taken apart while it is validated, so converting it never
+ * needs to look at the text again, except in rare corner cases.
+ *
+ * The value is (-1)^negative * mantissa * 10^exponent, where mantissa holds
+ * the first NUMBER_MAX_DIGITS significant digits. *truncated* tells that
+ * non-zero digits were dropped after those.
+ */
+typedef struct Number {
+    const char *start;
+    size_t len;
+    uint64_t mantissa;
+    int64_t exponent;
+    bool negative;
+    bool integer;
+    bool truncated;
+} Number;
+
+
+/** Validate and take apart the number at the start of [*p*, *end*).
+ *
+ * Return the length of the number and set *error* to NULL. On failure, set
+ * *error* to a message and return the offset of the offending character.
+ */
+size_t number_scan(
+    const char *p, const char *end, Number *number, const char **error
+);
+
+/** Convert to the nearest double, ties to even, independently of locale. */
+double number_to_double(const Number *number);
+
+/** Store the value in *value* if the number is integral and fits int64_t. */
+bool number_to_int64(const Number *number, int64_t *value);
+
+/** Store the value in *value* if the number is integral and fits uint64_t. */
+bool number_to_uint64(const Number *number, uint64_t *value);
+
+/** Write the shortest text that reads back as the finite *value*, in most
+ * cases, and never one that reads back as another double.
+ *
+ * Integral values below 2^53 are written as integers; others use an
+ * exponent once they would need more than 21 digits, or 6 leading zeros.
+ * Return the length written to *buf*, which is not terminated.
+ */
+size_t number_format_double(double value, char *buf);
+
+/** Write *value* in decimal to *buf*, unterminated, and return the length. */
+size_t number_format_int64(int64_t value, char *buf);
+
+/** Write *value* in decimal to *buf*, unterminated, and return the length. */
+size_t number_format_uint64(uint64_t value, char *buf);
+
+
+#endif
@@ -1,62 +1,75 @@
 #include <assert.h>
 #include <stdbool.h>
-#include <stdio.h>
 #include <stdlib.h>
 
 #include "ast.h"
+#include "json.h"
+#include "jsonerror.h"
 #include "lexer.h"
 #include "parser.h"
 #include "token.h"
 
 
-static ASTNode *_parser_value(Parser *parser);
+/** Text of the current token. */
+static inline const char *_parser_text(Parser *parser) {
+    return &parser->lexer->text[parser->token->start];
+}
 
+/** Read the next token; the current one becomes NULL if that fails. */
+static inline void _parser_next(Parser *parser) {
+    parser->token = lexer_next(parser->lexer, &parser->_token)
+        ? &parser->_token
+        : NULL;
+}
 
-static ASTNode *_parser_error(Lexer *lexer, TokenKind expected, TokenKind got) {
-    char *p = &lexer->text[lexer->line_start];
-    // Lexer has already advanced, so we subtract 1.
-    size_t len = lexer->pos - lexer->line_start - 1;
-    size_t pos;
-    size_t pos_oneth;
 
-    fprintf(
-        stderr,
-        "\nParser: error: expected '%c', got '%c' (line %llu, pos %llu)\n",
-        expected,
-        got,
-        lexer->line,
-        len
-    );
+/** Record what went wrong at the current token and return NULL. */
+static ASTNode *_parser_error(
+    Parser *parser, JsonErrorCode code, const char *msg
+) {
+    Token *token = parser->token;
 
-    do {
-        fprintf(stderr, "%c", *p++);
-    } while (*p != '\n' && *p);
-    fprintf(stderr, "\n");
-    // Super helpful error indicator!
-    for (pos = 0; pos < len; pos++) {
-        if (pos % 10) {
-            fprintf(stderr, "_");
-        } else {
-            pos_oneth = pos / 10;
-            while (pos_oneth >= 10) {
-                pos_oneth /= 10;
-            }
-            fprintf(stderr, "%llu", pos_oneth);
-        }
+    if (token && token->kind == TOKEN_EOF) {
+        code = JSON_ERROR_EOF;
     }
-    fprintf(stderr, "^\n");
-
+    jsonerror_set(
+        &parser->lexer->error,
+        code,
+        msg,
+        token ? token->start : parser->lexer->pos
+    );
     return NULL;
 }
 
-static ASTNode *_parser_error_memory() {
-    fprintf(stderr, "\nParser: insufficient memory\n");
-    return NULL;
+static ASTNode *_parser_error_expected(Parser *parser, TokenKind expected) {
+    const char *msg;
+
+    switch (expected) {
+        case TOKEN_STRING:
+            msg = "expected string key";
+            break;
+        case TOKEN_COLON:
+            msg = "expected ':'";
+            break;
+        case TOKEN_CLOSING_SQUARE_BRACKET:
+            msg = "expected ',' or ']'";
+            break;
+        case TOKEN_CLOSING_CURLY_BRACKET:
+            msg = "expected ',' or '}'";
+            break;
+        default:
+            msg = "unexpected token";
+            break;
+    }
+    return _parser_error(parser, JSON_ERROR_SYNTAX, msg);
 }
 
-static ASTNode *_parser_error_unexpected(Token *token) {
-    fprintf(stderr, "\nParser: error: unexpected token: %s\n", token->value);
-    return NULL;
+static ASTNode *_parser_error_memory(Parser *parser) {
+    return _parser_error(parser, JSON_ERROR_MEMORY, "insufficient memory");
+}
+
+static ASTNode *_parser_error_unexpected(Parser *parser) {
+    return _parser_error(parser, JSON_ERROR_SYNTAX, "unexpected token");
 }
 
 
@@ -64,20 +77,20 @@ static bool _parser_eat(Parser *parser, TokenKind expected) {
     if (!parser->token) {
         return false;
     } else if (parser->token->kind == expected) {
-        token_destruct(parser->token);
-        parser->token = lexer_next(parser->lexer);
+        _parser_next(parser);
         return true;
     } else {
-        _parser_error(parser->lexer, expected, parser->token->kind);
-        token_destruct(parser->token);
+        _parser_error_expected(parser, expected);
         return false;
     }
 }
 
 static ASTNode *_parser_null(Parser *parser) {
-    ASTNode *node = ast_construct_nullnode(parser->token);
+    ASTNode *node = ast_construct_nullnode(
+        _parser_text(parser), parser->token->len
+    );
     if (!node) {
-        return _parser_error_memory();
+        return _parser_error_memory(parser);
     }
     if (!_parser_eat(parser, TOKEN_NULL)) {
         ast_destruct_node(node);
@@ -87,9 +100,11 @@ static ASTNode *_parser_null(Parser *parser) {
 }
 
 static ASTNode *_parser_bool(Parser *parser) {
-    ASTNode *node = ast_construct_boolnode(parser->token);
+    ASTNode *node = ast_construct_boolnode(
+        _parser_text(parser), parser->token->len
+    );
     if (!node) {
-        return _parser_error_memory();
+        return _parser_error_memory(parser);
     }
     if (!_parser_eat(parser, TOKEN_BOOL)) {
         ast_destruct_node(node);
@@ -99,9 +114,11 @@ static ASTNode *_parser_bool(Parser *parser) {
 }
 
 static ASTNode *_parser_number(Parser *parser) {
-    ASTNode *node = ast_construct_numbernode(parser->token);
+    ASTNode *node = ast_construct_numbernode(
+        _parser_text(parser), parser->token->len
+    );
     if (!node) {
-        return _parser_error_memory();
+        return _parser_error_memory(parser);
     }
     if (!_parser_eat(parser, TOKEN_NUMBER)) {
         ast_destruct_node(node);
@@ -111,9 +128,17 @@ static ASTNode *_parser_number(Parser *parser) {
 }
 
 static ASTNode *_parser_string(Parser *parser) {
-    ASTNode *node = ast_construct_stringnode(parser->token);
+    size_t len;
+    char *value = lexer_token_string(parser->lexer, parser->token, &len);
+    ASTNode *node;
+
+    if (!value) {
+        return _parser_error_memory(parser);
+    }
+    node = ast_construct_stringnode(value, len);
+    free(value);
     if (!node) {
-        return _parser_error_memory();
+        return _parser_error_memory(parser);
     }
     if (!_parser_eat(parser, TOKEN_STRING)) {
         ast_destruct_node(node);
@@ -123,153 +148,210 @@ static ASTNode *_parser_string(Parser *parser) {
 }
 
 static ASTNode *_parser_array(Parser *parser) {
-    ASTNode *parent = ast_construct_arraynode(parser->token);
-    ASTNode *child;
-    Token **token = &parser->token;
-
-    if (!parent) {
-        return _parser_error_memory();
+    ASTNode *node = ast_construct_arraynode(
+        _parser_text(parser), parser->token->len
+    );
+    if (!node) {
+        return _parser_error_memory(parser);
     }
     if (!_parser_eat(parser, TOKEN_OPENING_SQUARE_BRACKET)) {
-        ast_destruct_node(parent);
+        ast_destruct_node(node);
         return NULL;
     }
+    return node;
+}
 
-    if (*token && (*token)->kind != TOKEN_CLOSING_SQUARE_BRACKET) {
-        if (!(child = _parser_value(parser))) {
-            ast_destruct(parent);
-            return NULL;
-        }
-        if (!ast_append(parent, child)) {
-            ast_destruct(parent);
-            return _parser_error_memory();
-        }
-
-        while (*token && (*token)->kind == TOKEN_COMMA) {
-            if (!_parser_eat(parser, TOKEN_COMMA)) {
-                ast_destruct(parent);
-                return NULL;
-            }
-
-            if (!(child = _parser_value(parser))) {
-                ast_destruct(parent);
-                return NULL;
-            }
-            if (!ast_append(parent, child)) {
-                ast_destruct(parent);
-                return _parser_error_memory();
-            }
-        }
+static ASTNode *_parser_object(Parser *parser) {
+    ASTNode *node = ast_construct_objectnode(
+        _parser_text(parser), parser->token->len
+    );
+    if (!node) {
+        return _parser_error_memory(parser);
     }
-
-    if (!_parser_eat(parser, TOKEN_CLOSING_SQUARE_BRACKET)) {
-        ast_destruct(parent);
+    if (!_parser_eat(parser, TOKEN_OPENING_CURLY_BRACKET)) {
+        ast_destruct_node(node);
         return NULL;
     }
-    return parent;
+    return node;
 }
 
-static ASTNode *_parser_key(Parser *parser) {
-    ASTNode *parent = ast_construct_keynode(parser->token);
-    ASTNode *child;
+/** Parse a key and its colon into a new key node of the innermost object,
+ * which its value then goes to.
+ */
+static bool _parser_key(Parser *parser) {
+    ASTNode *object = parser->stack[parser->depth - 1];
+    size_t len;
+    char *value;
+    ASTNode *node;
 
-    if (!parent) {
-        return _parser_error_memory();
+    if (!parser->token) {
+        return false;
     }
-    if (!_parser_eat(parser, TOKEN_STRING)) {
-        ast_destruct_node(parent);
-        return NULL;
+    if (parser->token->kind != TOKEN_STRING) {
+        _parser_error_expected(parser, TOKEN_STRING);
+        return false;
     }
-    
-    // colon
-    if (!_parser_eat(parser, TOKEN_COLON)) {
-        ast_destruct_node(parent);
-        return NULL;
+    if (!(value = lexer_token_string(parser->lexer, parser->token, &len))) {
+        _parser_error_memory(parser);
+        return false;
     }
-
-    // value
-    if (!(child = _parser_value(parser))) {
-        ast_destruct_node(parent);
-        ast_destruct_node(child);
-        return NULL;
+    node = ast_construct_keynode(value, len);
+    free(value);
+    if (!node) {
+        _parser_error_memory(parser);
+        return false;
     }
-    if (!ast_append(parent, child)) {
-        ast_destruct_node(parent);
-        ast_destruct_node(child);
-        return _parser_error_memory();
+    if (!_parser_eat(parser, TOKEN_STRING)
+            || !_parser_eat(parser, TOKEN_COLON)) {
+        ast_destruct_node(node);
+        return false;
+    }
+    if (!ast_append(object, node)) {
+        ast_destruct_node(node);
+        _parser_error_memory(parser);
+        return false;
     }
+    return true;
+}
 
-    return parent;
+/** Make *node* the root, the next element of the innermost array, or the
+ * value of the last key of the innermost object.
+ */
+static bool _parser_attach(Parser *parser, ASTNode **root, ASTNode *node) {
+    ASTNode *parent;
+
+    if (!parser->depth) {
+        *root = node;
+        return true;
+    }
+    parent = parser->stack[parser->depth - 1];
+    if (parent->kind == AST_OBJECT) {
+        parent = parent->children[parent->len - 1];
+    }
+    if (!ast_append(parent, node)) {
+        ast_destruct(node);
+        _parser_error_memory(parser);
+        return false;
+    }
+    return true;
 }
 
-static ASTNode *_parser_object(Parser *parser) {
-    ASTNode *parent = ast_construct_objectnode(parser->token);
-    ASTNode *child;
-    Token **token = &parser->token;
+static bool _parser_push(Parser *parser, ASTNode *node) {
+    ASTNode **new_stack;
+    size_t new_cap;
 
-    if (!parent) {
-        return _parser_error_memory();
+    if (parser->depth == parser->max_depth) {
+        _parser_error(parser, JSON_ERROR_DEPTH, "maximum depth exceeded");
+        return false;
     }
-    if (!_parser_eat(parser, TOKEN_OPENING_CURLY_BRACKET)) {
-        return NULL;
+    if (parser->depth == parser->cap) {
+        new_cap = parser->cap * PARSER_GROW_FACTOR;
+        new_stack = realloc(parser->stack, new_cap * sizeof (ASTNode *));
+        if (!new_stack) {
+            _parser_error_memory(parser);
+            return false;
+        }
+        parser->stack = new_stack;
+        parser->cap = new_cap;
     }
+    parser->stack[parser->depth++] = node;
+    return true;
+}
 
-    if (*token && (*token)->kind != TOKEN_CLOSING_CURLY_BRACKET) {
-        if (!(child = _parser_key(parser))) {
-            ast_destruct(parent);
-            return NULL;
+/** Parse one value into *root*, arrays and objects included.
+ *
+ * Nesting is kept on the stack of the parser instead of the call stack.
+ * Every node is attached as soon as it is made, so on failure whatever was
+ * parsed hangs from *root*.
+ */
+static bool _parser_tree(Parser *parser, ASTNode **root) {
+    Token **token = &parser->token;
+    ASTNode *node;
+    TokenKind closing;
+
+    parser->depth = 0;
+    while (1) {
+        if (parser->depth
+                && parser->stack[parser->depth - 1]->kind == AST_OBJECT
+                && !_parser_key(parser)) {
+            return false;
         }
-        if (!ast_append(parent, child)) {
-            ast_destruct(parent);
-            return _parser_error_memory();
+        if (!*token) {
+            return false;
         }
 
-        while (*token && (*token)->kind == TOKEN_COMMA) {
-            if (!_parser_eat(parser, TOKEN_COMMA)) {
-                ast_destruct(parent);
-                return NULL;
-            }
+        switch((*token)->kind) {
+            case TOKEN_STRING:
+                node = _parser_string(parser);
+                break;
+            case TOKEN_BOOL:
+                node = _parser_bool(parser);
+                break;
+            case TOKEN_NUMBER:
+                node = _parser_number(parser);
+                break;
+            case TOKEN_OPENING_SQUARE_BRACKET:
+                node = _parser_array(parser);
+                break;
+            case TOKEN_OPENING_CURLY_BRACKET:
+                node = _parser_object(parser);
+                break;
+            case TOKEN_NULL:
+                node = _parser_null(parser);
+                break;
+            default:
+                node = _parser_error_unexpected(parser);
+                break;
+        }
+        if (!node || !_parser_attach(parser, root, node)) {
+            return false;
+        }
 
-            if (!(child = _parser_key(parser))) {
-                ast_destruct(parent);
-                return NULL;
+        if (node->kind == AST_ARRAY || node->kind == AST_OBJECT) {
+            if (!_parser_push(parser, node)) {
+                return false;
+            }
+            closing = (node->kind == AST_ARRAY)
+                ? TOKEN_CLOSING_SQUARE_BRACKET
+                : TOKEN_CLOSING_CURLY_BRACKET;
+            // Not empty: go on with its first element or member.
+            if (*token && (*token)->kind != closing) {
+                continue;
             }
-            if (!ast_append(parent, child)) {
-                ast_destruct(parent);
-                return _parser_error_memory();
+            if (!_parser_eat(parser, closing)) {
+                return false;
             }
+            parser->depth--;
         }
-    }
 
-    if (!_parser_eat(parser, TOKEN_CLOSING_CURLY_BRACKET)) {
-        ast_destruct(parent);
-        return NULL;
+        // Close every container that ends after this value.
+        while (parser->depth) {
+            if (*token && (*token)->kind == TOKEN_COMMA) {
+                _parser_next(parser);
+                break;
+            }
+            closing = (parser->stack[parser->depth - 1]->kind == AST_ARRAY)
+                ? TOKEN_CLOSING_SQUARE_BRACKET
+                : TOKEN_CLOSING_CURLY_BRACKET;
+            if (!_parser_eat(parser, closing)) {
+                return false;
+            }
+            parser->depth--;
+        }
+        if (!parser->depth) {
+            return true;
+        }
     }
-    return parent;
 }
 
 static ASTNode *_parser_value(Parser *parser) {
-    ASTNode *node;
+    ASTNode *root = NULL;
 
-    if (!parser->token) {
+    if (!_parser_tree(parser, &root)) {
+        ast_destruct(root);
         return NULL;
     }
-    switch(parser->token->kind) {
-        case TOKEN_STRING:
-            return _parser_string(parser);
-        case TOKEN_BOOL:
-            return _parser_bool(parser);
-        case TOKEN_NUMBER:
-            return _parser_number(parser);
-        case TOKEN_OPENING_SQUARE_BRACKET:
-            return _parser_array(parser);
-        case TOKEN_OPENING_CURLY_BRACKET:
-            return _parser_object(parser);
-        case TOKEN_NULL:
-            return _parser_null(parser);
-        default:
-            return _parser_error_unexpected(parser->token);
-    }
+    return root;
 }
 
 static ASTNode *_parser_element(Parser *parser) {
@@ -287,16 +369,22 @@ Parser *parser_construct(Lexer *lexer) {
     if (!parser) {
         return NULL;
     }
+    parser->stack = malloc(PARSER_INITIAL_DEPTH * sizeof (ASTNode *));
+    if (!parser->stack) {
+        free(parser);
+        return NULL;
+    }
     parser->lexer = lexer;
-    parser->token = lexer_next(lexer);
+    parser->max_depth = JSON_DEFAULT_MAX_DEPTH;
+    parser->depth = 0;
+    parser->cap = PARSER_INITIAL_DEPTH;
+    _parser_next(parser);
     return parser;
 }
 
-/** Destruct parser, but not the lexer.
- *
- * Last token needs to be destroyed manually if parsing didn't error out.
- */
+/** Destruct parser, but not the lexer. */
 void parser_destruct(Parser *parser) {
+    free(parser->stack);
     free(parser);
 }
 
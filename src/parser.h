@@ -1,23 +1,36 @@
 #ifndef __JSON_PARSER_H__
 #define __JSON_PARSER_H__
 
+#include <stddef.h>
+
+#include "ast.h"
 #include "lexer.h"
 #include "token.h"
 
 
+#define PARSER_INITIAL_DEPTH        32
+#define PARSER_GROW_FACTOR          2
+
+
 typedef struct Parser {
     Lexer *lexer;
+    // Points to _token, or is NULL after a lexer error.
     Token *token;
+    Token _token;
+    // Deeper documents are rejected. JSON_DEFAULT_MAX_DEPTH unless changed
+    // after construction.
+    size_t max_depth;
+    // The open array and object nodes, innermost last.
+    ASTNode **stack;
+    size_t depth;
+    size_t cap;
 } Parser;
 
 
 /** Construct a parser and initialize with the first token. */
 Parser *parser_construct(Lexer *lexer);
 
-/** Destruct parser, but not the lexer.
- *
- * Last token needs to be destroyed manually if parsing didn't error out.
- */
+/** Destruct parser, but not the lexer. */
 void parser_destruct(Parser *parser);
 
 ASTNode *parser_parse(Parser *parser);
@@ -0,0 +1,520 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "json.h"
+#include "jsonarr.h"
+#include "jsonerror.h"
+#include "jsonobj.h"
+#include "lexer.h"
+#include "pushparser.h"
+#include "simd.h"
+
+
+#define JSON_PARSER_INITIAL_DEPTH   16
+#define JSON_PARSER_GROW_FACTOR     2
+
+
+/** Ignore ' ', '\t', '\n', '\r' */
+#define _ISSPACE(c)         \
+    ((c) == 0x20 || (c) == 0x09 || (c) == 0x0a || (c) == 0x0d)
+
+#define _ISALPHA(c)         (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z')
+
+/** Offset of *p* in the whole text, within json_parser_feed(). */
+#define _OFFSET(p)          (parser->offset + (size_t) ((p) - buf))
+
+#define _ISNUMBER(c)        \
+    (((c) >= '0' && (c) <= '9') || (c) == '-' || (c) == '+' || (c) == '.' \
+     || (c) == 'e' || (c) == 'E')
+
+
+/** Record what went wrong at *offset* and stop for good.
+ *
+ * Chunks are not kept, so the error has no line and column.
+ */
+static JsonParserStatus _json_parser_error(
+    JsonParser *parser, size_t offset, JsonErrorCode code, const char *msg
+) {
+    jsonerror_set(&parser->error, code, msg, offset);
+    jsonerror_report(&parser->error);
+    parser->status = JSON_PARSER_ERROR;
+    return JSON_PARSER_ERROR;
+}
+
+static JsonParserStatus _json_parser_error_memory(JsonParser *parser) {
+    return _json_parser_error(
+        parser, parser->offset, JSON_ERROR_MEMORY, "insufficient memory"
+    );
+}
+
+/** Report if a value may start here. */
+static inline bool _json_parser_wants_value(JsonParser *parser) {
+    return parser->state == _JSON_PARSER_VALUE
+        || parser->state == _JSON_PARSER_ARRAY_FIRST;
+}
+
+/** Report if a key may start here. */
+static inline bool _json_parser_wants_key(JsonParser *parser) {
+    return parser->state == _JSON_PARSER_KEY
+        || parser->state == _JSON_PARSER_OBJECT_FIRST;
+}
+
+/** Put a finished value where it belongs: in the container on top of the
+ * stack, or at the root.
+ */
+static bool _json_parser_complete(JsonParser *parser, JsonValue *value) {
+    _JsonParserFrame *top;
+
+    parser->state = _JSON_PARSER_AFTER_VALUE;
+    if (!parser->depth) {
+        parser->root = *value;
+        parser->status = JSON_PARSER_DONE;
+        return true;
+    }
+    top = &parser->stack[parser->depth - 1];
+    if (top->container.type == JSON_ARRAY) {
+        if (!jsonarr_append(top->container.value.as_arr, value)) {
+            jsonval_destruct(value);
+            return false;
+        }
+    } else {
+        if (!jsonobj_setitem_adopt_n(
+                top->container.value.as_obj, top->key, top->key_len, value
+            )) {
+            jsonval_destruct(value);
+            return false;
+        }
+        top->key = NULL;
+    }
+    return true;
+}
+
+/** Decode a whole token lying at [*text*, *text* + *len*). */
+static JsonParserStatus _json_parser_token(
+    JsonParser *parser, const char *text, size_t len, size_t offset
+) {
+    JsonDecodeOptions options = {
+        .flags = parser->flags, .max_depth = parser->max_depth
+    };
+    _JsonParserFrame *top;
+    JsonValue value;
+    Lexer lexer;
+    bool error;
+
+    lexer_init(&lexer, text, len);
+    if (_json_parser_wants_key(parser)) {
+        // A key is a whole string token, and the object wants its length.
+        top = &parser->stack[parser->depth - 1];
+        if (!(top->key = lexer_string(&lexer, &top->key_len))) {
+            if (lexer.error.code == JSON_ERROR_NONE) {
+                return _json_parser_error_memory(parser);
+            }
+            return _json_parser_error(
+                parser,
+                offset + lexer.error.offset,
+                lexer.error.code,
+                lexer.error.message
+            );
+        }
+        parser->state = _JSON_PARSER_COLON;
+        return parser->status;
+    }
+
+    // A lone token is a document in itself, so the decoder does it all.
+    value = decoder_decode(&lexer, &options, NULL, &error);
+    if (error) {
+        return _json_parser_error(
+            parser,
+            offset + lexer.error.offset,
+            lexer.error.code,
+            lexer.error.message
+        );
+    }
+    if (!_json_parser_complete(parser, &value)) {
+        return _json_parser_error_memory(parser);
+    }
+    return parser->status;
+}
+
+/** Keep the token cut by the end of the chunk for the next one. */
+static bool _json_parser_keep(JsonParser *parser, const char *p, size_t len) {
+    size_t need = parser->partial_len + len;
+    size_t new_cap;
+    char *new_partial;
+
+    if (need > parser->partial_cap) {
+        new_cap = parser->partial_cap * JSON_PARSER_GROW_FACTOR;
+        if (new_cap < need) {
+            new_cap = need;
+        }
+        if (!(new_partial = realloc(parser->partial, new_cap))) {
+            return false;
+        }
+        parser->partial = new_partial;
+        parser->partial_cap = new_cap;
+    }
+    memcpy(&parser->partial[parser->partial_len], p, len);
+    parser->partial_len = need;
+    return true;
+}
+
+/** Find the end of the token of kind *kind* continuing at *p*.
+ *
+ * Return a pointer right past it, or NULL if it goes on past *end*, in
+ * which case *escaped* tells if the last byte is an unpaired backslash.
+ */
+static const char *_json_parser_token_end(
+    char kind, const char *p, const char *end, bool *escaped
+) {
+    const char *q;
+
+    switch (kind) {
+        case '"':
+            if (*escaped) {
+                if (p == end) {
+                    return NULL;
+                }
+                p++;
+                *escaped = false;
+            }
+            while ((q = simd_find_string_special(p, end)) < end) {
+                if (*q != '\\') {
+                    // The closing quote, or a control character the decoder
+                    // will complain about.
+                    return q + 1;
+                }
+                if (q + 1 == end) {
+                    *escaped = true;
+                    return NULL;
+                }
+                p = q + 2;
+            }
+            return NULL;
+        case '0':
+            while (p < end && _ISNUMBER(*p)) {
+                p++;
+            }
+            return (p < end) ? p : NULL;
+        default:
+            while (p < end && _ISALPHA(*p)) {
+                p++;
+            }
+            return (p < end) ? p : NULL;
+    }
+}
+
+/** Finish the token cut by the previous chunk, with the start of this one.
+ *
+ * Return how many bytes of the chunk it took, all of them if it is still
+ * not finished.
+ */
+static size_t _json_parser_resume(
+    JsonParser *parser, const char *buf, size_t len
+) {
+    const char *stop = _json_parser_token_end(
+        parser->partial_kind, buf, &buf[len], &parser->partial_escaped
+    );
+    size_t used = stop ? (size_t) (stop - buf) : len;
+
+    if (!_json_parser_keep(parser, buf, used)) {
+        _json_parser_error_memory(parser);
+        return len;
+    }
+    if (stop) {
+        parser->partial_kind = 0;
+        _json_parser_token(
+            parser, parser->partial, parser->partial_len, parser->partial_offset
+        );
+        parser->partial_len = 0;
+    }
+    return used;
+}
+
+static bool _json_parser_push(JsonParser *parser, JsonValue *container) {
+    _JsonParserFrame *new_stack;
+    size_t new_cap;
+
+    if (parser->depth == parser->cap) {
+        new_cap = parser->cap * JSON_PARSER_GROW_FACTOR;
+        new_stack = realloc(parser->stack, new_cap * sizeof (_JsonParserFrame));
+        if (!new_stack) {
+            return false;
+        }
+        parser->stack = new_stack;
+        parser->cap = new_cap;
+    }
+    parser->stack[parser->depth].container = *container;
+    parser->stack[parser->depth].key = NULL;
+    parser->depth++;
+    return true;
+}
+
+
+/** Construct a parser waiting for its first chunk, or return NULL.
+ *
+ * *options* may be NULL for the defaults.
+ */
+JsonParser *json_parser_construct(const JsonDecodeOptions *options) {
+    JsonParser *parser = malloc(sizeof (JsonParser));
+
+    if (!parser) {
+        return NULL;
+    }
+    parser->stack = malloc(JSON_PARSER_INITIAL_DEPTH * sizeof (_JsonParserFrame));
+    if (!parser->stack) {
+        free(parser);
+        return NULL;
+    }
+    parser->flags = options ? options->flags : 0;
+    parser->max_depth = decoder_max_depth(options);
+    parser->status = JSON_PARSER_MORE;
+    parser->error.code = JSON_ERROR_NONE;
+    parser->state = _JSON_PARSER_VALUE;
+    parser->depth = 0;
+    parser->cap = JSON_PARSER_INITIAL_DEPTH;
+    parser->root.type = JSON_NULL;
+    parser->offset = 0;
+    parser->partial_kind = 0;
+    parser->partial_escaped = false;
+    parser->partial_offset = 0;
+    parser->partial = NULL;
+    parser->partial_len = 0;
+    parser->partial_cap = 0;
+    return parser;
+}
+
+/** Destruct the parser along with whatever it has decoded and not handed
+ * over yet.
+ */
+void json_parser_destruct(JsonParser *parser) {
+    while (parser->depth) {
+        parser->depth--;
+        jsonval_destruct(&parser->stack[parser->depth].container);
+        free(parser->stack[parser->depth].key);
+    }
+    jsonval_destruct(&parser->root);
+    free(parser->stack);
+    free(parser->partial);
+    free(parser);
+}
+
+/** Parse the next *len* bytes of text, which may cut tokens anywhere.
+ *
+ * Return JSON_PARSER_DONE once the document is complete, after which only
+ * whitespace may follow, JSON_PARSER_MORE while it is not, or
+ * JSON_PARSER_ERROR, which sticks.
+ */
+JsonParserStatus json_parser_feed(
+    JsonParser *parser, const char *buf, size_t len
+) {
+    const char *p = buf;
+    const char *end = &buf[len];
+    const char *stop;
+    JsonValue container;
+    _JsonParserFrame *top;
+    char c;
+
+    if (parser->status == JSON_PARSER_ERROR) {
+        return JSON_PARSER_ERROR;
+    }
+    if (parser->partial_kind) {
+        p += _json_parser_resume(parser, buf, len);
+    }
+
+    while (p < end && parser->status != JSON_PARSER_ERROR) {
+        c = *p;
+        if (_ISSPACE(c)) {
+            p++;
+            continue;
+        }
+        if (parser->status == JSON_PARSER_DONE) {
+            return _json_parser_error(
+                parser,
+                _OFFSET(p),
+                JSON_ERROR_TRAILING,
+                "trailing characters after document"
+            );
+        }
+
+        switch (c) {
+            case '[':
+            case '{':
+                if (!_json_parser_wants_value(parser)) {
+                    return _json_parser_error(
+                        parser,
+                        _OFFSET(p),
+                        JSON_ERROR_SYNTAX,
+                        "unexpected bracket"
+                    );
+                }
+                if (parser->depth == parser->max_depth) {
+                    return _json_parser_error(
+                        parser,
+                        _OFFSET(p),
+                        JSON_ERROR_DEPTH,
+                        "maximum depth exceeded"
+                    );
+                }
+                if (c == '[') {
+                    container.type = JSON_ARRAY;
+                    container.value.as_arr = jsonarr_construct(SIZE_MAX);
+                } else {
+                    container.type = JSON_OBJECT;
+                    container.value.as_obj = jsonobj_construct(
+                        json_default_hasher, SIZE_MAX
+                    );
+                }
+                if ((c == '[')
+                        ? !container.value.as_arr
+                        : !container.value.as_obj) {
+                    return _json_parser_error_memory(parser);
+                }
+                if (!_json_parser_push(parser, &container)) {
+                    jsonval_destruct(&container);
+                    return _json_parser_error_memory(parser);
+                }
+                parser->state = (c == '[')
+                    ? _JSON_PARSER_ARRAY_FIRST
+                    : _JSON_PARSER_OBJECT_FIRST;
+                p++;
+                break;
+            case ']':
+            case '}':
+                top = parser->depth ? &parser->stack[parser->depth - 1] : NULL;
+                if (!top
+                        || top->container.type != ((c == ']') ? JSON_ARRAY : JSON_OBJECT)
+                        || !(parser->state == _JSON_PARSER_AFTER_VALUE
+                            || parser->state == ((c == ']')
+                                ? _JSON_PARSER_ARRAY_FIRST
+                                : _JSON_PARSER_OBJECT_FIRST))) {
+                    return _json_parser_error(
+                        parser,
+                        _OFFSET(p),
+                        JSON_ERROR_SYNTAX,
+                        "unexpected bracket"
+                    );
+                }
+                container = top->container;
+                parser->depth--;
+                if (!_json_parser_complete(parser, &container)) {
+                    return _json_parser_error_memory(parser);
+                }
+                p++;
+                break;
+            case ',':
+                if (parser->state != _JSON_PARSER_AFTER_VALUE || !parser->depth) {
+                    return _json_parser_error(
+                        parser, _OFFSET(p), JSON_ERROR_SYNTAX, "unexpected ','"
+                    );
+                }
+                top = &parser->stack[parser->depth - 1];
+                parser->state = (top->container.type == JSON_ARRAY)
+                    ? _JSON_PARSER_VALUE
+                    : _JSON_PARSER_KEY;
+                p++;
+                break;
+            case ':':
+                if (parser->state != _JSON_PARSER_COLON) {
+                    return _json_parser_error(
+                        parser, _OFFSET(p), JSON_ERROR_SYNTAX, "unexpected ':'"
+                    );
+                }
+                parser->state = _JSON_PARSER_VALUE;
+                p++;
+                break;
+            default:
+                if (c == '"') {
+                    if (!_json_parser_wants_value(parser)
+                            && !_json_parser_wants_key(parser)) {
+                        return _json_parser_error(
+                            parser,
+                            _OFFSET(p),
+                            JSON_ERROR_SYNTAX,
+                            "unexpected string"
+                        );
+                    }
+                    parser->partial_kind = '"';
+                } else if (_ISNUMBER(c) || _ISALPHA(c)) {
+                    if (!_json_parser_wants_value(parser)) {
+                        return _json_parser_error(
+                            parser,
+                            _OFFSET(p),
+                            JSON_ERROR_SYNTAX,
+                            "unexpected value"
+                        );
+                    }
+                    parser->partial_kind = _ISALPHA(c) ? 'a' : '0';
+                } else {
+                    return _json_parser_error(
+                        parser,
+                        _OFFSET(p),
+                        JSON_ERROR_CHARACTER,
+                        "unexpected character"
+                    );
+                }
+
+                parser->partial_escaped = false;
+                stop = _json_parser_token_end(
+                    parser->partial_kind,
+                    p + (c == '"'),
+                    end,
+                    &parser->partial_escaped
+                );
+                if (!stop) {
+                    // Cut by the end of the chunk.
+                    parser->partial_offset = _OFFSET(p);
+                    if (!_json_parser_keep(parser, p, end - p)) {
+                        return _json_parser_error_memory(parser);
+                    }
+                    p = end;
+                    break;
+                }
+                parser->partial_kind = 0;
+                _json_parser_token(parser, p, stop - p, _OFFSET(p));
+                p = stop;
+                break;
+        }
+    }
+
+    parser->offset += len;
+    return parser->status;
+}
+
+/** Tell the parser the text is over, and hand over the document.
+ *
+ * Return false if the document is incomplete or invalid. Otherwise, *value*
+ * belongs to the caller, to be freed with jsonval_destruct().
+ */
+bool json_parser_finish(JsonParser *parser, JsonValue *value) {
+    if (parser->status != JSON_PARSER_ERROR && parser->partial_kind) {
+        if (parser->partial_kind == '"') {
+            _json_parser_error(
+                parser,
+                parser->partial_offset,
+                JSON_ERROR_EOF,
+                "EOF reached while parsing string"
+            );
+        } else {
+            // Numbers and literals only end with what follows them.
+            parser->partial_kind = 0;
+            _json_parser_token(
+                parser, parser->partial, parser->partial_len, parser->partial_offset
+            );
+            parser->partial_len = 0;
+        }
+    }
+    if (parser->status == JSON_PARSER_MORE) {
+        _json_parser_error(
+            parser, parser->offset, JSON_ERROR_EOF, "unexpected EOF"
+        );
+    }
+    if (parser->status != JSON_PARSER_DONE) {
+        return false;
+    }
+    *value = parser->root;
+    parser->root.type = JSON_NULL;
+    return true;
+}
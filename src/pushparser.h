@@ -0,0 +1,62 @@
+#ifndef __JSON_PUSHPARSER_H__
+#define __JSON_PUSHPARSER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "json.h"
+
+
+/** What the parser expects next, outside of tokens. */
+typedef enum _JsonParserState {
+    _JSON_PARSER_VALUE,
+    // Right after '[': a value or ']'.
+    _JSON_PARSER_ARRAY_FIRST,
+    // Right after '{': a key or '}'.
+    _JSON_PARSER_OBJECT_FIRST,
+    _JSON_PARSER_KEY,
+    _JSON_PARSER_COLON,
+    // ',' or the closing bracket, or nothing but whitespace at the top.
+    _JSON_PARSER_AFTER_VALUE
+} _JsonParserState;
+
+/** An array or object being filled, and the key of its pending value. */
+typedef struct _JsonParserFrame {
+    JsonValue container;
+    char *key;
+    size_t key_len;
+} _JsonParserFrame;
+
+/**
+ * A resumable parser that is fed the text chunk by chunk.
+ *
+ * Between two chunks, it keeps the nesting stack of the containers being
+ * built and a copy of the token cut by the end of the last chunk, if any.
+ * Tokens that lie entirely in a chunk are decoded in place.
+ */
+struct JsonParser {
+    unsigned int flags;
+    size_t max_depth;
+    JsonParserStatus status;
+    // Why the status is JSON_PARSER_ERROR.
+    JsonError error;
+    _JsonParserState state;
+    _JsonParserFrame *stack;
+    size_t depth;
+    size_t cap;
+    JsonValue root;
+    // Bytes fed before the current chunk, for error reporting.
+    size_t offset;
+    // First character of the cut token ('"', '0' or 'a'), or 0 for none.
+    char partial_kind;
+    // Whether the cut string ends with an unpaired backslash.
+    bool partial_escaped;
+    // Where the cut token starts in the whole text.
+    size_t partial_offset;
+    char *partial;
+    size_t partial_len;
+    size_t partial_cap;
+};
+
+
+#endif
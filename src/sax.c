@@ -0,0 +1,353 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json.h"
+#include "jsonerror.h"
+#include "lexer.h"
+#include "number.h"
+#include "token.h"
+
+
+#define SAX_INITIAL_SCRATCH         256
+#define SAX_GROW_FACTOR             2
+
+
+/**
+ * Reads the text straight from the lexer like the decoder does, but hands
+ * every value to the handler instead of building a tree. The only memory it
+ * allocates is a scratch buffer for strings with escapes, as long as the
+ * longest of them, and only when there is a callback to pass them to.
+ */
+typedef struct _JsonSax {
+    Lexer *lexer;
+    const JsonHandler *handler;
+    void *ctx;
+    char *scratch;
+    size_t cap;
+    // Whether parsing stopped on an error, rather than a handler.
+    bool error;
+    size_t depth;
+    // A bit per open container, set for objects. The depth is capped, so
+    // this is all the stack it takes.
+    uint64_t objects[JSON_DEFAULT_MAX_DEPTH / 64];
+} _JsonSax;
+
+
+/** Record what went wrong under the cursor, and stop.
+ *
+ * Anything missing at the end of the text is an unexpected EOF.
+ */
+static bool _sax_error(_JsonSax *sax, JsonErrorCode code, const char *msg) {
+    if (code == JSON_ERROR_SYNTAX && lexer_eof(sax->lexer)) {
+        code = JSON_ERROR_EOF;
+    }
+    jsonerror_set(&sax->lexer->error, code, msg, sax->lexer->pos);
+    sax->error = true;
+    return false;
+}
+
+static bool _sax_error_memory(_JsonSax *sax) {
+    return _sax_error(sax, JSON_ERROR_MEMORY, "insufficient memory");
+}
+
+/** The lexer has already reported what went wrong. */
+static inline bool _sax_fail(_JsonSax *sax) {
+    sax->error = true;
+    return false;
+}
+
+
+/** Consume a string and pass its content, unescaped, to *callback*.
+ *
+ * Strings without escapes are passed as they lie in the text.
+ */
+static bool _sax_string(
+    _JsonSax *sax, bool (*callback)(void *, const char *, size_t)
+) {
+    Lexer *lexer = sax->lexer;
+    Token token;
+    const char *str;
+    size_t len;
+    size_t new_cap;
+    char *new_scratch;
+
+    if (!lexer_next(lexer, &token)) {
+        return _sax_fail(sax);
+    }
+    str = &lexer->text[token.start + 1];
+    len = token.len - 2;
+    if (!callback) {
+        return true;
+    }
+
+    if (memchr(str, '\\', len)) {
+        if (token.len > sax->cap) {
+            new_cap = sax->cap ? sax->cap : SAX_INITIAL_SCRATCH;
+            while (new_cap < token.len) {
+                new_cap *= SAX_GROW_FACTOR;
+            }
+            if (!(new_scratch = realloc(sax->scratch, new_cap))) {
+                return _sax_error_memory(sax);
+            }
+            sax->scratch = new_scratch;
+            sax->cap = new_cap;
+        }
+        lexer_token_string_into(lexer, &token, sax->scratch, &len);
+        str = sax->scratch;
+    }
+    return callback(sax->ctx, str, len);
+}
+
+static bool _sax_number(_JsonSax *sax) {
+    Number number;
+
+    if (!lexer_number(sax->lexer, &number)) {
+        return _sax_fail(sax);
+    }
+    return !sax->handler->on_number
+        || sax->handler->on_number(sax->ctx, number_to_double(&number));
+}
+
+static bool _sax_literal(_JsonSax *sax, char *ref) {
+    const JsonHandler *handler = sax->handler;
+
+    if (!lexer_literal(sax->lexer, ref)) {
+        return _sax_fail(sax);
+    }
+    if (ref[0] == 'n') {
+        return !handler->on_null || handler->on_null(sax->ctx);
+    }
+    return !handler->on_bool || handler->on_bool(sax->ctx, ref[0] == 't');
+}
+
+/** Parse the scalar that starts with *chr*, already peeked. */
+static bool _sax_scalar(_JsonSax *sax, char chr) {
+    switch (chr) {
+        case 'n':
+            return _sax_literal(sax, "null");
+        case 't':
+            return _sax_literal(sax, "true");
+        case 'f':
+            return _sax_literal(sax, "false");
+        case '"':
+            return _sax_string(sax, sax->handler->on_string);
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return _sax_number(sax);
+        case 0:
+            if (lexer_eof(sax->lexer)) {
+                return _sax_error(sax, JSON_ERROR_EOF, "unexpected EOF");
+            }
+            return _sax_error(
+                sax, JSON_ERROR_CHARACTER, "unexpected NUL character"
+            );
+        default:
+            return _sax_error(
+                sax, JSON_ERROR_CHARACTER, "unexpected character"
+            );
+    }
+}
+
+/** The closing bracket of the innermost container. */
+static inline char _sax_closing(_JsonSax *sax) {
+    size_t i = sax->depth - 1;
+
+    return ((sax->objects[i / 64] >> (i % 64)) & 1) ? '}' : ']';
+}
+
+/** Consume the bracket *chr* and enter a new container. */
+static bool _sax_open(_JsonSax *sax, char chr) {
+    const JsonHandler *handler = sax->handler;
+    size_t i = sax->depth;
+    uint64_t bit = (uint64_t) 1 << (i % 64);
+
+    if (i == JSON_DEFAULT_MAX_DEPTH) {
+        return _sax_error(sax, JSON_ERROR_DEPTH, "maximum depth exceeded");
+    }
+    if (chr == '{') {
+        sax->objects[i / 64] |= bit;
+    } else {
+        sax->objects[i / 64] &= ~bit;
+    }
+    sax->depth++;
+
+    lexer_advance(sax->lexer);
+    if (chr == '[') {
+        return !handler->on_start_array || handler->on_start_array(sax->ctx);
+    }
+    return !handler->on_start_object || handler->on_start_object(sax->ctx);
+}
+
+/** Leave the innermost container, whose closing bracket is consumed. */
+static bool _sax_close(_JsonSax *sax) {
+    const JsonHandler *handler = sax->handler;
+    char closing = _sax_closing(sax);
+
+    sax->depth--;
+    if (closing == ']') {
+        return !handler->on_end_array || handler->on_end_array(sax->ctx);
+    }
+    return !handler->on_end_object || handler->on_end_object(sax->ctx);
+}
+
+/** Consume a key and the colon after it. */
+static bool _sax_key(_JsonSax *sax) {
+    Lexer *lexer = sax->lexer;
+
+    if (lexer_peek(lexer) != '"') {
+        return _sax_error(sax, JSON_ERROR_SYNTAX, "expected string key");
+    }
+    if (!_sax_string(sax, sax->handler->on_key)) {
+        return false;
+    }
+    if (lexer_peek(lexer) != ':') {
+        return _sax_error(sax, JSON_ERROR_SYNTAX, "expected ':'");
+    }
+    lexer_advance(lexer);
+    return true;
+}
+
+/** Parse one value, containers and all, keeping the nesting on the stack
+ * of *sax* rather than on the call stack.
+ */
+static bool _sax_value(_JsonSax *sax) {
+    Lexer *lexer = sax->lexer;
+    char closing;
+    char chr;
+
+    while (1) {
+        if (sax->depth && _sax_closing(sax) == '}' && !_sax_key(sax)) {
+            return false;
+        }
+
+        chr = lexer_peek(lexer);
+        if (chr == '[' || chr == '{') {
+            if (!_sax_open(sax, chr)) {
+                return false;
+            }
+            // Not empty: go on with its first element or member.
+            if (lexer_peek(lexer) != _sax_closing(sax)) {
+                continue;
+            }
+            lexer_advance(lexer);
+            if (!_sax_close(sax)) {
+                return false;
+            }
+        } else if (!_sax_scalar(sax, chr)) {
+            return false;
+        }
+
+        // Close every container that ends after this value.
+        while (sax->depth) {
+            closing = _sax_closing(sax);
+            chr = lexer_peek(lexer);
+            if (chr == ',') {
+                lexer_advance(lexer);
+                break;
+            } else if (chr != closing) {
+                return _sax_error(
+                    sax,
+                    JSON_ERROR_SYNTAX,
+                    (closing == ']')
+                        ? "expected ',' or ']'"
+                        : "expected ',' or '}'"
+                );
+            }
+            lexer_advance(lexer);
+            if (!_sax_close(sax)) {
+                return false;
+            }
+        }
+        if (!sax->depth) {
+            return true;
+        }
+    }
+}
+
+
+/** Run *handler* over the document of *lexer*, as json_sax_parse() does.
+ *
+ * On error, what went wrong is left in the error of the lexer, unlocated.
+ */
+static bool _sax_parse(
+    Lexer *lexer, const JsonHandler *handler, void *ctx, bool *error
+) {
+    _JsonSax sax = { .lexer = lexer, .handler = handler, .ctx = ctx };
+    bool done;
+
+    done = _sax_value(&sax);
+    if (done) {
+        lexer_peek(lexer);
+        if (!lexer_eof(lexer)) {
+            done = _sax_error(
+                &sax, JSON_ERROR_TRAILING, "trailing characters after document"
+            );
+        }
+    }
+    free(sax.scratch);
+    *error = sax.error;
+    return done;
+}
+
+
+/** Parse *len* bytes of JSON text, calling *handler* for every event.
+ *
+ * No tree is built. Return true once the whole document has gone through
+ * the handler. Return false if the text is invalid, setting *error* value
+ * to true, or if a callback returned false, leaving *error* false.
+ */
+bool json_sax_parse(
+    const char *text,
+    size_t len,
+    const JsonHandler *handler,
+    void *ctx,
+    bool *error
+) {
+    Lexer lexer;
+    bool done;
+
+    lexer_init(&lexer, text, len);
+    done = _sax_parse(&lexer, handler, ctx, error);
+    if (*error) {
+        jsonerror_locate(&lexer.error, text, len);
+        jsonerror_report(&lexer.error);
+    }
+    return done;
+}
+
+/** Check that *len* bytes of *text* are one well-formed JSON document.
+ *
+ * Nothing is allocated and no tree is built. Nesting deeper than
+ * JSON_DEFAULT_MAX_DEPTH is an error.
+ * Return true if the text is valid. Otherwise, fill *error* unless it is
+ * NULL, and return false.
+ */
+bool json_validate(const char *text, size_t len, JsonError *error) {
+    // Without callbacks, strings are never unescaped, so nothing is
+    // allocated.
+    static const JsonHandler none = { NULL };
+    Lexer lexer;
+    bool failed;
+
+    lexer_init(&lexer, text, len);
+    if (_sax_parse(&lexer, &none, NULL, &failed)) {
+        return true;
+    }
+    if (error) {
+        jsonerror_locate(&lexer.error, text, len);
+        *error = lexer.error;
+    }
+    return false;
+}
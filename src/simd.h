@@ -0,0 +1,517 @@
+#ifndef __JSON_SIMD_H__
+#define __JSON_SIMD_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Instruction set selection for the vectorized kernels.
+ *
+ * Everything is decided at compile time: build with -mavx2 (or -march=native)
+ * to get the AVX2 paths, which come with SSSE3. SSE2 is always there on
+ * x86-64. Other targets get the scalar fallbacks, which produce identical
+ * results.
+ */
+
+#if defined(__AVX2__)
+#define JSON_SIMD_AVX2
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSON_SIMD_SSE2
+#endif
+
+#if defined(__SSSE3__) || defined(JSON_SIMD_AVX2)
+#define JSON_SIMD_SSSE3
+#endif
+
+#if defined(__PCLMUL__)
+#define JSON_SIMD_PCLMUL
+#endif
+
+#if defined(JSON_SIMD_AVX2) || defined(JSON_SIMD_SSE2) \
+    || defined(JSON_SIMD_SSSE3) || defined(JSON_SIMD_PCLMUL)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+/** Index of the lowest set bit. *bits* must not be zero. */
+static inline unsigned int simd_ctz64(uint64_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+/** Index of the lowest set bit. *bits* must not be zero. */
+static inline unsigned int simd_ctz32(uint32_t bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return index;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+/** Each output bit is the parity of all input bits at or below it. */
+static inline uint64_t simd_prefix_xor(uint64_t bits) {
+#if defined(JSON_SIMD_PCLMUL)
+    __m128i all_ones = _mm_set1_epi8((char) 0xff);
+    __m128i result = _mm_clmulepi64_si128(
+        _mm_set_epi64x(0, (long long) bits), all_ones, 0
+    );
+    return (uint64_t) _mm_cvtsi128_si64(result);
+#else
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+#endif
+}
+
+/** Bit i is set when byte i of the 16 at *p* is *byte*. */
+static inline uint32_t simd_match_byte16(
+    const unsigned char *p, unsigned char byte
+) {
+#if defined(JSON_SIMD_SSE2)
+    __m128i v = _mm_loadu_si128((const __m128i *) p);
+
+    return (uint32_t) _mm_movemask_epi8(
+        _mm_cmpeq_epi8(v, _mm_set1_epi8((char) byte))
+    );
+#else
+    uint32_t mask = 0;
+
+    for (unsigned int i = 0; i < 16; i++) {
+        mask |= (uint32_t) (p[i] == byte) << i;
+    }
+    return mask;
+#endif
+}
+
+/** Bit i is the top bit of byte i of the 16 at *p*. */
+static inline uint32_t simd_top_bits16(const unsigned char *p) {
+#if defined(JSON_SIMD_SSE2)
+    return (uint32_t) _mm_movemask_epi8(
+        _mm_loadu_si128((const __m128i *) p)
+    );
+#else
+    uint32_t mask = 0;
+
+    for (unsigned int i = 0; i < 16; i++) {
+        mask |= (uint32_t) (p[i] >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+
+/** Find the first '"', '\\' or control character in [*p*, *end*), and
+ * tell in *non_ascii* if any byte before it may be outside ASCII.
+ *
+ * These are the only bytes that end a clean run inside a JSON string.
+ * Return *end* if there is none.
+ */
+static inline const char *simd_find_string_run(
+    const char *p, const char *end, bool *non_ascii
+) {
+    uint32_t high = 0;
+
+#if defined(JSON_SIMD_AVX2)
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i backslash32 = _mm256_set1_epi8('\\');
+    const __m256i control32 = _mm256_set1_epi8(0x1f);
+    __m256i v32;
+    uint32_t mask32;
+
+    for (; end - p >= 32; p += 32) {
+        v32 = _mm256_loadu_si256((const __m256i *) p);
+        mask32 = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v32, quote32),
+                _mm256_cmpeq_epi8(v32, backslash32)
+            ),
+            // Unsigned v <= 0x1f.
+            _mm256_cmpeq_epi8(_mm256_min_epu8(v32, control32), v32)
+        ));
+        // Bytes past the special one may count too; that only costs a look.
+        high |= (uint32_t) _mm256_movemask_epi8(v32);
+        if (mask32) {
+            *non_ascii = high != 0;
+            return p + simd_ctz32(mask32);
+        }
+    }
+#endif
+#if defined(JSON_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    __m128i v;
+    uint32_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        mask = (uint32_t) _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            // Unsigned v <= 0x1f.
+            _mm_cmpeq_epi8(_mm_min_epu8(v, control), v)
+        ));
+        high |= (uint32_t) _mm_movemask_epi8(v);
+        if (mask) {
+            *non_ascii = high != 0;
+            return p + simd_ctz32(mask);
+        }
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '"' || *p == '\\' || (unsigned char) *p < 0x20) {
+            break;
+        }
+        high |= (unsigned char) *p & 0x80;
+    }
+    *non_ascii = high != 0;
+    return p;
+}
+
+/** Find the first '"', '\\' or control character in [*p*, *end*).
+ *
+ * Return *end* if there is none.
+ */
+static inline const char *simd_find_string_special(
+    const char *p, const char *end
+) {
+    bool non_ascii;
+
+    return simd_find_string_run(p, end, &non_ascii);
+}
+
+
+/** Find the first byte of [*p*, *end*) that a JSON encoder has to escape:
+ * '"', '\\' or a control character, and any byte outside ASCII when
+ * *ascii* is set.
+ *
+ * Return *end* if there is none.
+ */
+static inline const char *simd_find_escape(
+    const char *p, const char *end, bool ascii
+) {
+#if defined(JSON_SIMD_AVX2) || defined(JSON_SIMD_SSE2)
+    // Flipping the top bit first turns the signed comparison with 0x20
+    // into an unsigned one, which lets the bytes outside ASCII through.
+    const char bias = ascii ? 0 : (char) 0x80;
+#endif
+
+#if defined(JSON_SIMD_AVX2)
+    const __m256i quote32 = _mm256_set1_epi8('"');
+    const __m256i backslash32 = _mm256_set1_epi8('\\');
+    const __m256i bias32 = _mm256_set1_epi8(bias);
+    const __m256i limit32 = _mm256_set1_epi8((char) (0x20 ^ bias));
+    __m256i v32;
+    uint32_t mask32;
+
+    for (; end - p >= 32; p += 32) {
+        v32 = _mm256_loadu_si256((const __m256i *) p);
+        mask32 = (uint32_t) _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v32, quote32),
+                _mm256_cmpeq_epi8(v32, backslash32)
+            ),
+            _mm256_cmpgt_epi8(limit32, _mm256_xor_si256(v32, bias32))
+        ));
+        if (mask32) {
+            return p + simd_ctz32(mask32);
+        }
+    }
+#endif
+#if defined(JSON_SIMD_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i bias16 = _mm_set1_epi8(bias);
+    const __m128i limit = _mm_set1_epi8((char) (0x20 ^ bias));
+    __m128i v;
+    uint32_t mask;
+
+    for (; end - p >= 16; p += 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        mask = (uint32_t) _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+            _mm_cmplt_epi8(_mm_xor_si128(v, bias16), limit)
+        ));
+        if (mask) {
+            return p + simd_ctz32(mask);
+        }
+    }
+#endif
+    // Unsigned comparisons, since char is unsigned on ARM, among others.
+    for (; p < end; p++) {
+        if (*p == '"' || *p == '\\' || (unsigned char) *p < 0x20
+                || (ascii && (unsigned char) *p >= 0x80)) {
+            break;
+        }
+    }
+    return p;
+}
+
+/** Find the first byte of [*p*, *end*) that does not start a valid UTF-8
+ * sequence, one sequence at a time, skipping ASCII 16 bytes at a time.
+ */
+static inline const char *_simd_find_utf8_error_scalar(
+    const char *p, const char *end
+) {
+    const unsigned char *s;
+    unsigned char lead;
+    unsigned char low;
+    unsigned char high;
+    size_t n;
+
+    while (p < end) {
+#if defined(JSON_SIMD_SSE2)
+        while (end - p >= 16
+                && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) p))) {
+            p += 16;
+        }
+        if (p == end) {
+            break;
+        }
+#endif
+        lead = (unsigned char) *p;
+        if (lead < 0x80) {
+            p++;
+            continue;
+        } else if (lead >= 0xc2 && lead <= 0xdf) {
+            n = 1;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            n = 2;
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            n = 3;
+        } else {
+            return p;
+        }
+        if (end - p <= (ptrdiff_t) n) {
+            return p;
+        }
+        // Some leads narrow the range of the next byte: no overlong forms,
+        // no surrogates and nothing above U+10FFFF.
+        low = (lead == 0xe0) ? 0xa0 : (lead == 0xf0) ? 0x90 : 0x80;
+        high = (lead == 0xed) ? 0x9f : (lead == 0xf4) ? 0x8f : 0xbf;
+        s = (const unsigned char *) p + 1;
+        if (s[0] < low || s[0] > high) {
+            return p;
+        }
+        for (size_t i = 1; i < n; i++) {
+            if ((s[i] & 0xc0) != 0x80) {
+                return p;
+            }
+        }
+        p += n + 1;
+    }
+    return end;
+}
+
+#if defined(JSON_SIMD_SSSE3)
+
+// What a pair of consecutive bytes can tell is wrong, one bit per error.
+#define _SIMD_UTF8_TOO_SHORT        0x01
+#define _SIMD_UTF8_TOO_LONG         0x02
+#define _SIMD_UTF8_OVERLONG_3       0x04
+#define _SIMD_UTF8_TOO_LARGE        0x08
+#define _SIMD_UTF8_SURROGATE        0x10
+#define _SIMD_UTF8_OVERLONG_2       0x20
+#define _SIMD_UTF8_TOO_LARGE_1000   0x40
+#define _SIMD_UTF8_OVERLONG_4       0x40
+#define _SIMD_UTF8_TWO_CONTS        0x80
+#define _SIMD_UTF8_CARRY            (_SIMD_UTF8_TOO_SHORT \
+    | _SIMD_UTF8_TOO_LONG | _SIMD_UTF8_TWO_CONTS)
+
+/** The errors of the 16 bytes of *input*, following those of *prev*.
+ *
+ * Each byte is looked up by its high nibble, and the one before it by both
+ * nibbles; a bit set in all three lookups is an error, except that the
+ * third and fourth bytes of a sequence are expected to be two continuations
+ * in a row (Keiser and Lemire, "Validating UTF-8 in less than one
+ * instruction per byte").
+ */
+static inline __m128i _simd_utf8_block_errors(__m128i input, __m128i prev) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i byte_1_high_table = _mm_setr_epi8(
+        // ASCII first.
+        _SIMD_UTF8_TOO_LONG, _SIMD_UTF8_TOO_LONG,
+        _SIMD_UTF8_TOO_LONG, _SIMD_UTF8_TOO_LONG,
+        _SIMD_UTF8_TOO_LONG, _SIMD_UTF8_TOO_LONG,
+        _SIMD_UTF8_TOO_LONG, _SIMD_UTF8_TOO_LONG,
+        // A continuation first.
+        (char) _SIMD_UTF8_TWO_CONTS, (char) _SIMD_UTF8_TWO_CONTS,
+        (char) _SIMD_UTF8_TWO_CONTS, (char) _SIMD_UTF8_TWO_CONTS,
+        // 110_ then 1110 then 1111 leads.
+        _SIMD_UTF8_TOO_SHORT | _SIMD_UTF8_OVERLONG_2,
+        _SIMD_UTF8_TOO_SHORT,
+        _SIMD_UTF8_TOO_SHORT | _SIMD_UTF8_OVERLONG_3 | _SIMD_UTF8_SURROGATE,
+        _SIMD_UTF8_TOO_SHORT | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000 | _SIMD_UTF8_OVERLONG_4
+    );
+    const __m128i byte_1_low_table = _mm_setr_epi8(
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_OVERLONG_3
+            | _SIMD_UTF8_OVERLONG_2 | _SIMD_UTF8_OVERLONG_4),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_OVERLONG_2),
+        (char) _SIMD_UTF8_CARRY,
+        (char) _SIMD_UTF8_CARRY,
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        // ED: only up to 9F follows, below the surrogates.
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000 | _SIMD_UTF8_SURROGATE),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000),
+        (char) (_SIMD_UTF8_CARRY | _SIMD_UTF8_TOO_LARGE
+            | _SIMD_UTF8_TOO_LARGE_1000)
+    );
+    const __m128i byte_2_high_table = _mm_setr_epi8(
+        // ASCII second.
+        _SIMD_UTF8_TOO_SHORT, _SIMD_UTF8_TOO_SHORT,
+        _SIMD_UTF8_TOO_SHORT, _SIMD_UTF8_TOO_SHORT,
+        _SIMD_UTF8_TOO_SHORT, _SIMD_UTF8_TOO_SHORT,
+        _SIMD_UTF8_TOO_SHORT, _SIMD_UTF8_TOO_SHORT,
+        // 1000, 1001, then 101_ continuations second.
+        (char) (_SIMD_UTF8_TOO_LONG | _SIMD_UTF8_OVERLONG_2
+            | _SIMD_UTF8_TWO_CONTS | _SIMD_UTF8_OVERLONG_3
+            | _SIMD_UTF8_TOO_LARGE_1000 | _SIMD_UTF8_OVERLONG_4),
+        (char) (_SIMD_UTF8_TOO_LONG | _SIMD_UTF8_OVERLONG_2
+            | _SIMD_UTF8_TWO_CONTS | _SIMD_UTF8_OVERLONG_3
+            | _SIMD_UTF8_TOO_LARGE),
+        (char) (_SIMD_UTF8_TOO_LONG | _SIMD_UTF8_OVERLONG_2
+            | _SIMD_UTF8_TWO_CONTS | _SIMD_UTF8_SURROGATE
+            | _SIMD_UTF8_TOO_LARGE),
+        (char) (_SIMD_UTF8_TOO_LONG | _SIMD_UTF8_OVERLONG_2
+            | _SIMD_UTF8_TWO_CONTS | _SIMD_UTF8_SURROGATE
+            | _SIMD_UTF8_TOO_LARGE),
+        // A lead second.
+        _SIMD_UTF8_TOO_SHORT, _SIMD_UTF8_TOO_SHORT,
+        _SIMD_UTF8_TOO_SHORT, _SIMD_UTF8_TOO_SHORT
+    );
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(
+            _mm_shuffle_epi8(
+                byte_1_high_table,
+                _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)
+            ),
+            _mm_shuffle_epi8(byte_1_low_table, _mm_and_si128(prev1, nibble))
+        ),
+        _mm_shuffle_epi8(
+            byte_2_high_table, _mm_and_si128(_mm_srli_epi16(input, 4), nibble)
+        )
+    );
+    // Only bytes after 111_____ and 1111____ leads end up at 0x80 or more.
+    __m128i must_be_cont = _mm_or_si128(
+        _mm_subs_epu8(_mm_alignr_epi8(input, prev, 14), _mm_set1_epi8(0x60)),
+        _mm_subs_epu8(_mm_alignr_epi8(input, prev, 13), _mm_set1_epi8(0x70))
+    );
+
+    return _mm_xor_si128(
+        _mm_and_si128(must_be_cont, _mm_set1_epi8((char) 0x80)), special
+    );
+}
+
+/** Report if [*p*, *end*) is all valid UTF-8, 16 bytes at a time. */
+static inline bool _simd_utf8_valid(const char *p, const char *end) {
+    // Nonzero where a lead at the end of a block needs more bytes.
+    const __m128i incomplete_max = _mm_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char) (0xf0 - 1), (char) (0xe0 - 1), (char) (0xc0 - 1)
+    );
+    __m128i error = _mm_setzero_si128();
+    __m128i prev = _mm_setzero_si128();
+    __m128i incomplete = _mm_setzero_si128();
+    __m128i input;
+    char last[16];
+    bool done = false;
+
+    while (!done) {
+        if (end - p >= 16) {
+            input = _mm_loadu_si128((const __m128i *) p);
+            p += 16;
+        } else {
+            // The zeros after the end are ASCII: a sequence cut by the end
+            // is then too short.
+            memset(last, 0, sizeof last);
+            memcpy(last, p, end - p);
+            input = _mm_loadu_si128((const __m128i *) last);
+            done = true;
+        }
+        if (!_mm_movemask_epi8(input)) {
+            error = _mm_or_si128(error, incomplete);
+        } else {
+            error = _mm_or_si128(error, _simd_utf8_block_errors(input, prev));
+            incomplete = _mm_subs_epu8(input, incomplete_max);
+        }
+        prev = input;
+    }
+    return _mm_movemask_epi8(
+        _mm_cmpeq_epi8(error, _mm_setzero_si128())
+    ) == 0xffff;
+}
+
+#endif
+
+/** Find the first byte of [*p*, *end*) that does not belong to a valid
+ * UTF-8 sequence: overlong forms, surrogates and code points above U+10FFFF
+ * are all invalid. Return *end* if there is none.
+ *
+ * ASCII is skipped 16 bytes at a time. With SSSE3, the rest is checked with
+ * lookup tables 16 bytes at a time, and only text with an error is looked
+ * at again one sequence at a time, to find it.
+ */
+static inline const char *simd_find_utf8_error(
+    const char *p, const char *end
+) {
+#if defined(JSON_SIMD_SSE2)
+    while (end - p >= 16
+            && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) p))) {
+        p += 16;
+    }
+#endif
+    while (p < end && (unsigned char) *p < 0x80) {
+        p++;
+    }
+    if (p == end) {
+        return end;
+    }
+#if defined(JSON_SIMD_SSSE3)
+    // Right after ASCII, *p* starts a sequence.
+    if (_simd_utf8_valid(p, end)) {
+        return end;
+    }
+#endif
+    return _simd_find_utf8_error_scalar(p, end);
+}
+
+
+#endif
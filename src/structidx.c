@@ -0,0 +1,256 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simd.h"
+#include "structidx.h"
+
+
+#define STRUCTIDX_BLOCK             64
+#define STRUCTIDX_EVEN_BITS         0x5555555555555555ULL
+
+
+/** Bitmaps of interesting characters in a block, one bit per byte. */
+typedef struct _StructIndexBlock {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t space;
+    uint64_t op;
+} _StructIndexBlock;
+
+
+#if defined(JSON_SIMD_AVX2)
+
+static void _structidx_classify(const char *p, _StructIndexBlock *block) {
+    __m256i v;
+    __m256i folded;
+    __m256i space;
+    __m256i op;
+    uint64_t bits[4];
+
+    memset(block, 0, sizeof (_StructIndexBlock));
+    for (int i = 0; i < 2; i++) {
+        v = _mm256_loadu_si256((const __m256i *) (p + i * 32));
+        // '[' and ']' are '{' and '}' with bit 0x20 cleared.
+        folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        space = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))
+            ),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))
+            )
+        );
+        op = _mm256_or_si256(
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}'))
+            ),
+            _mm256_or_si256(
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')),
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))
+            )
+        );
+        bits[0] = (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))
+        );
+        bits[1] = (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))
+        );
+        bits[2] = (uint32_t) _mm256_movemask_epi8(space);
+        bits[3] = (uint32_t) _mm256_movemask_epi8(op);
+        block->quote |= bits[0] << (i * 32);
+        block->backslash |= bits[1] << (i * 32);
+        block->space |= bits[2] << (i * 32);
+        block->op |= bits[3] << (i * 32);
+    }
+}
+
+#elif defined(JSON_SIMD_SSE2)
+
+static void _structidx_classify(const char *p, _StructIndexBlock *block) {
+    __m128i v;
+    __m128i folded;
+    __m128i space;
+    __m128i op;
+    uint64_t bits[4];
+
+    memset(block, 0, sizeof (_StructIndexBlock));
+    for (int i = 0; i < 4; i++) {
+        v = _mm_loadu_si128((const __m128i *) (p + i * 16));
+        // '[' and ']' are '{' and '}' with bit 0x20 cleared.
+        folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        space = _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))
+            ),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))
+            )
+        );
+        op = _mm_or_si128(
+            _mm_or_si128(
+                _mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))
+            ),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(':')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(','))
+            )
+        );
+        bits[0] = (uint16_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))
+        );
+        bits[1] = (uint16_t) _mm_movemask_epi8(
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))
+        );
+        bits[2] = (uint16_t) _mm_movemask_epi8(space);
+        bits[3] = (uint16_t) _mm_movemask_epi8(op);
+        block->quote |= bits[0] << (i * 16);
+        block->backslash |= bits[1] << (i * 16);
+        block->space |= bits[2] << (i * 16);
+        block->op |= bits[3] << (i * 16);
+    }
+}
+
+#else
+
+static void _structidx_classify(const char *p, _StructIndexBlock *block) {
+    uint64_t bit;
+
+    memset(block, 0, sizeof (_StructIndexBlock));
+    for (int i = 0; i < STRUCTIDX_BLOCK; i++) {
+        bit = (uint64_t) 1 << i;
+        switch (p[i]) {
+            case '"':
+                block->quote |= bit;
+                break;
+            case '\\':
+                block->backslash |= bit;
+                break;
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                block->space |= bit;
+                break;
+            case '{':
+            case '}':
+            case '[':
+            case ']':
+            case ':':
+            case ',':
+                block->op |= bit;
+                break;
+        }
+    }
+}
+
+#endif
+
+
+/** Return the bits of characters preceded by an odd run of backslashes. */
+static inline uint64_t _structidx_escaped(StructIndex *index, uint64_t bs) {
+    uint64_t prev = index->_escaped;
+    uint64_t starts = bs & ~(bs << 1);
+    // A run continuing from the previous block has its parity flipped.
+    uint64_t even_start_mask = STRUCTIDX_EVEN_BITS ^ prev;
+    uint64_t even_starts = starts & even_start_mask;
+    uint64_t odd_starts = starts & ~even_start_mask;
+    uint64_t even_ends;
+    uint64_t odd_ends;
+
+    // Adding a run's start bit carries out right past the end of the run.
+    // A run starting on an even bit and ending on an odd one has odd length,
+    // and so does one starting on an odd bit and ending on an even one.
+    even_ends = (bs + even_starts) & ~bs;
+    odd_ends = bs + odd_starts;
+    // An odd run that falls off the top escapes the next block's first byte.
+    index->_escaped = odd_ends < bs;
+    odd_ends = (odd_ends | prev) & ~bs;
+
+    return (even_ends & ~STRUCTIDX_EVEN_BITS) | (odd_ends & STRUCTIDX_EVEN_BITS);
+}
+
+/** Append positions of set bits of *bits*, offset by *offset*. */
+static inline size_t _structidx_flatten(
+    uint16_t *pos, size_t n, uint64_t bits, size_t offset
+) {
+    while (bits) {
+        pos[n++] = (uint16_t) (offset + simd_ctz64(bits));
+        bits &= bits - 1;
+    }
+    return n;
+}
+
+
+/** Prepare the index to start from the beginning of a text. */
+void structidx_init(StructIndex *index) {
+    index->base = 0;
+    index->end = 0;
+    index->len = 0;
+    index->next = 0;
+    index->_in_string = 0;
+    index->_escaped = 0;
+    index->_scalar = 0;
+}
+
+/** Index the next chunk of the *len* bytes of *text*.
+ *
+ * Entries of the chunk replace the previous ones and are relative to
+ * *index->base*. Return the number of entries, which may be zero.
+ */
+size_t structidx_next_chunk(StructIndex *index, const char *text, size_t len) {
+    size_t base = index->end;
+    size_t stop = base + STRUCTIDX_CHUNK;
+    size_t offset;
+    size_t n = 0;
+    char tail[STRUCTIDX_BLOCK];
+    const char *p;
+    _StructIndexBlock block;
+    uint64_t escaped;
+    uint64_t quote;
+    uint64_t in_string;
+    uint64_t scalar;
+    uint64_t entries;
+
+    if (stop > len) {
+        stop = len;
+    }
+
+    for (offset = 0; base + offset < stop; offset += STRUCTIDX_BLOCK) {
+        p = &text[base + offset];
+        if (stop - (base + offset) < STRUCTIDX_BLOCK) {
+            // Pad the last block with whitespace so it adds no entries.
+            memset(tail, ' ', STRUCTIDX_BLOCK);
+            memcpy(tail, p, stop - (base + offset));
+            p = tail;
+        }
+        _structidx_classify(p, &block);
+
+        escaped = _structidx_escaped(index, block.backslash);
+        quote = block.quote & ~escaped;
+        // Set from an opening quote up to, not including, its closing quote.
+        in_string = simd_prefix_xor(quote) ^ index->_in_string;
+        index->_in_string = (uint64_t) ((int64_t) in_string >> 63);
+
+        scalar = ~(block.op | block.space | quote | in_string);
+        entries = (block.op & ~in_string)
+            | (quote & in_string)
+            | (scalar & ~((scalar << 1) | index->_scalar));
+        index->_scalar = scalar >> 63;
+
+        n = _structidx_flatten(index->pos, n, entries, offset);
+    }
+
+    index->base = base;
+    index->end = stop;
+    index->len = n;
+    index->next = 0;
+    return n;
+}
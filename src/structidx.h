@@ -0,0 +1,46 @@
+#ifndef __JSON_STRUCTIDX_H__
+#define __JSON_STRUCTIDX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** Bytes indexed per chunk. Offsets within a chunk must fit in uint16_t. */
+#define STRUCTIDX_CHUNK             4096
+
+/**
+ * Positions where a token starts, found 64 bytes at a time with bitmaps.
+ *
+ * An entry is a bracket, a colon or a comma outside strings, the opening
+ * quote of a string, or the first byte of a literal or number. Anything
+ * between two tokens that is not an entry is whitespace, so a reader
+ * can jump from one token to the next without looking at the bytes between.
+ *
+ * The text is indexed one chunk at a time, in order, because each block
+ * depends on whether the previous one ended inside a string or after a
+ * backslash.
+ */
+typedef struct StructIndex {
+    size_t base;
+    size_t end;
+    size_t len;
+    size_t next;
+    uint64_t _in_string;
+    uint64_t _escaped;
+    uint64_t _scalar;
+    uint16_t pos[STRUCTIDX_CHUNK];
+} StructIndex;
+
+
+/** Prepare the index to start from the beginning of a text. */
+void structidx_init(StructIndex *index);
+
+/** Index the next chunk of the *len* bytes of *text*.
+ *
+ * Entries of the chunk replace the previous ones and are relative to
+ * *index->base*. Return the number of entries, which may be zero.
+ */
+size_t structidx_next_chunk(StructIndex *index, const char *text, size_t len);
+
+
+#endif
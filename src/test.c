@@ -1,15 +1,24 @@
 #include <assert.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "json.h"
+#include "jsonarena.h"
 #include "jsonarr.h"
 #include "jsonobj.h"
 #include "token.h"
 #include "ast.h"
 #include "lexer.h"
 #include "parser.h"
+#include "structidx.h"
 
 
 #define NSAMPLES        8
@@ -83,7 +92,94 @@ int test_arr() {
     return 1;
 }
 
+/** Hash every key the same, so that lookups have to probe past them all. */
+JsonObjectKeyHash colliding_hasher(const void *data, size_t len) {
+    return 42;
+}
+
+/** Hash keys of every length up to 64, from buffers exactly that long. */
+int test_hasher() {
+    static const char text[] =
+        "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do!";
+    JsonObjectKeyHash hashes[65];
+    char *copy;
+
+    for (size_t len = 0; len <= 64; len++) {
+        // Nothing past the key is read, as ASan would tell.
+        copy = malloc(len ? len : 1);
+        assert(copy);
+        memcpy(copy, text, len);
+        hashes[len] = json_default_hasher(copy, len);
+        assert(json_default_hasher(&text[0], len) == hashes[len]);
+        free(copy);
+        // The prefixes of the same text all differ.
+        for (size_t i = 0; i < len; i++) {
+            assert(hashes[i] != hashes[len]);
+        }
+    }
+    // Each byte counts, wherever it is.
+    assert(json_default_hasher("user_id_0001", 12)
+        != json_default_hasher("user_id_0002", 12));
+    assert(json_default_hasher("a", 1) != json_default_hasher("b", 1));
+    assert(json_default_hasher("ab", 2) != json_default_hasher("ba", 2));
+    return 1;
+}
+
+/** Insert, delete and insert again many keys hashed with *hasher*. */
+int test_obj_churn(JsonObjectHashFunction hasher) {
+    JsonObject *obj = jsonobj_construct(hasher, SIZE_MAX);
+    JsonObjectIterator *iter;
+    JsonValue jsval = { JSON_NUMBER };
+    // Enough keys for positions of 8, 16 and 32 bits in the index.
+    size_t nkeys = (hasher == colliding_hasher) ? 100 : 50000;
+    char key[32];
+    size_t i;
+
+    for (size_t round = 0; round < 3; round++) {
+        for (i = 0; i < nkeys; i++) {
+            sprintf(key, "k%llu", (unsigned long long) i);
+            jsval.value.as_num = i + round;
+            assert(jsonobj_setitem(obj, key, &jsval));
+        }
+        assert(obj->len == nkeys);
+        // Leave deleted slots among the others.
+        for (i = 0; i < nkeys; i += 2) {
+            sprintf(key, "k%llu", (unsigned long long) i);
+            assert(jsonobj_delitem(obj, key));
+        }
+        assert(obj->len == nkeys / 2);
+        for (i = 0; i < nkeys; i++) {
+            sprintf(key, "k%llu", (unsigned long long) i);
+            assert(jsonobj_contains(obj, key) == (i % 2 == 1));
+            if (i % 2) {
+                assert(jsonobj_getitem(obj, key)->value.as_num == i + round);
+            }
+        }
+    }
+    iter = jsonobj_iter(obj);
+    i = 0;
+    while (jsonobj_next(iter)) {
+        assert(iter->key[0] == 'k' && iter->value->value.as_num >= 2);
+        assert(iter->key_len == strlen(iter->key));
+        i++;
+    }
+    assert(i == obj->len);
+
+    // Down to nothing, and the table shrinks back.
+    for (i = 1; i < nkeys; i += 2) {
+        sprintf(key, "k%llu", (unsigned long long) i);
+        assert(jsonobj_delitem(obj, key));
+    }
+    assert(obj->len == 0 && !jsonobj_contains(obj, "k1"));
+    assert(obj->_cap < nkeys);
+    jsonobj_destruct(obj);
+    return 1;
+}
+
 int test_obj() {
+    static char *ordered[] = {
+        "shore", "sea", "the", "by", "shells", "she", "sells"
+    };
     size_t i;
     JsonObject *obj = jsonobj_construct(json_default_hasher, -1);
     JsonObject *obj2 = jsonobj_construct(json_default_hasher, -1);
@@ -128,25 +224,880 @@ int test_obj() {
     jsval2.value.as_obj = obj2;
     assert(jsonval_equal(&jsval, &jsval2));
 
+    // Entries come in the order they were first added, whatever the hash.
+    jsonobj_clear(obj);
+    jsval = (JsonValue) { JSON_NUMBER, .value.as_num = 1 };
+    for (i = 0; i < NSAMPLES; i++) {
+        jsonobj_setitem(obj, sample[NSAMPLES - 1 - i], &jsval);
+    }
+    jsonobj_delitem(obj, "sells");
+    jsonobj_setitem(obj, "sells", &jsval);
+    jsonobj_setitem(obj, "shore", &jsval);
+    iter = jsonobj_iter(obj);
+    i = 0;
+    while (jsonobj_next(iter)) {
+        assert(strcmp(iter->key, ordered[i++]) == 0);
+    }
+    assert(i == obj->len && i == 7);
+
     jsonobj_destruct(obj);
     jsonobj_destruct(obj2);
+    return test_hasher()
+        && test_obj_churn(json_default_hasher)
+        && test_obj_churn(colliding_hasher);
+}
+
+int test_arena() {
+    JsonArena arena;
+    JsonArray *array;
+    JsonObject *obj;
+    JsonValue jsval = { JSON_NUMBER, .value.as_num = 1 };
+    char *p;
+    char *q;
+
+    jsonarena_init(&arena, 0);
+    // Alignment, and growth in place of the most recent block.
+    p = jsonarena_alloc(&arena, 3);
+    assert(p && ((size_t) p % 16) == 0);
+    memcpy(p, "ab", 3);
+    q = jsonarena_realloc(&arena, p, 3, 100);
+    assert(q == p && strcmp(q, "ab") == 0);
+    // A block that is not the last one moves.
+    jsonarena_alloc(&arena, 8);
+    q = jsonarena_realloc(&arena, p, 100, 200);
+    assert(q != p && strcmp(q, "ab") == 0);
+    // Big blocks get a chunk of their own and keep growing.
+    p = jsonarena_alloc(&arena, 1 << 20);
+    memset(p, 'x', 1 << 20);
+    q = jsonarena_realloc(&arena, p, 1 << 20, 1 << 22);
+    assert(q && q[(1 << 20) - 1] == 'x');
+    jsonarena_free(&arena);
+
+    // Containers work the same, without freeing anything themselves.
+    array = jsonarr_construct_in(&arena, SIZE_MAX);
+    obj = jsonobj_construct_in(&arena, json_default_hasher, SIZE_MAX);
+    for (size_t i = 0; i < 1000; i++) {
+        jsval.value.as_num = i;
+        assert(jsonarr_append(array, &jsval));
+    }
+    for (size_t i = 0; i < 1000; i++) {
+        assert(jsonarr_getitem(array, i)->value.as_num == i);
+    }
+    while (array->len > 10) {
+        jsonarr_pop(array);
+    }
+    for (size_t i = 0; i < NSAMPLES; i++) {
+        jsval.value.as_num = strlen(sample[i]);
+        assert(jsonobj_setitem(obj, sample[i], &jsval));
+    }
+    for (size_t i = 0; i < NSAMPLES; i++) {
+        assert(jsonobj_getitem(obj, sample[i])->value.as_num == strlen(sample[i]));
+    }
+    jsonobj_delitem(obj, "sells");
+    assert(!jsonobj_contains(obj, "sells"));
+    jsonobj_clear(obj);
+    assert(obj->len == 0 && !jsonobj_contains(obj, "she"));
+    jsonarr_destruct(array);
+    jsonobj_destruct(obj);
+    jsonarena_free(&arena);
+    return 1;
+}
+
+int test_document(bool quiet) {
+    char *samples[] = {
+        "null",
+        "\"lone string\"",
+        "[ 1, \"two\", { \"three\": [ 3, \"\\\"3\\\"\" ] }, [], {} ]",
+        "{ \"a\": { \"b\": { \"c\": \"deep\" } }, \"d\": -0.5e-3 }"
+    };
+    JsonDocument *document;
+    JsonValue jsval;
+    size_t len;
+    char *big;
+    bool error;
+
+    for (size_t i = 0; i < sizeof samples / sizeof *samples; i++) {
+        document = json_document_decode(
+            samples[i], strlen(samples[i]), NULL, &error
+        );
+        assert(!error && document);
+        jsval = json_sdecode(samples[i], &error);
+        assert(!error);
+        assert(jsonval_equal(&document->root, &jsval));
+        jsonval_destruct(&jsval);
+        assert(jsval.type == JSON_NULL);
+        json_document_free(document);
+    }
+
+    // Enough to go through several chunks, with a big growing array.
+    big = malloc(200000 * 24 + 16);
+    len = sprintf(big, "[");
+    for (size_t i = 0; i < 200000; i++) {
+        len += sprintf(&big[len], "%s{\"k%llu\": \"v\\n\"}", i ? "," : "", (unsigned long long) i % 97);
+    }
+    len += sprintf(&big[len], "]");
+    document = json_document_decode(big, len, NULL, &error);
+    assert(!error && document->root.value.as_arr->len == 200000);
+    jsval = json_ndecode(big, len, NULL, &error);
+    assert(!error && jsonval_equal(&document->root, &jsval));
+    jsonval_destruct(&jsval);
+
+    // The tree can still grow, from the arena of the document.
+    jsval.type = JSON_NUMBER;
+    jsval.value.as_num = 1;
+    for (size_t i = 0; i < 100000; i++) {
+        assert(jsonarr_append(document->root.value.as_arr, &jsval));
+    }
+    assert(document->root.value.as_arr->len == 300000);
+    json_document_free(document);
+    free(big);
+
+    if (!quiet) {
+        document = json_document_decode("[ \"a\", { \"b\": x } ]", 20, NULL, &error);
+        assert(error && !document);
+    }
+    return 1;
+}
+
+int test_mmap(bool quiet) {
+    char *path = "test_mmap.json";
+    JsonDocument *document;
+    JsonValue expected;
+    FILE *stream;
+    size_t len;
+    size_t i;
+    char *text;
+    char *back;
+    bool error;
+
+    // Long strings with escapes, straddling pages and index chunks.
+    text = malloc(2000 * 64 + 16);
+    len = sprintf(text, "[");
+    for (i = 0; i < 2000; i++) {
+        len += sprintf(&text[len], "%s\"%llu \\\"quoted\\\"\\n\\\\ \\\" [\\\"\", \n  %llu", i ? ",\n" : "", (unsigned long long) i, (unsigned long long) i);
+        if (i % 100 == 0) {
+            len += sprintf(&text[len], ", \"");
+            for (size_t j = 0; j < 500; j++) {
+                len += sprintf(&text[len], "\\\"{");
+            }
+            len += sprintf(&text[len], "\"");
+        }
+    }
+    len += sprintf(&text[len], "]");
+    stream = fopen(path, "wb");
+    assert(stream);
+    fwrite(text, 1, len, stream);
+    fclose(stream);
+
+    expected = json_ndecode(text, len, NULL, &error);
+    assert(!error);
+    document = json_mmap_decode(path, NULL, &error);
+    assert(!error && document);
+    assert(jsonval_equal(&expected, &document->root));
+    json_document_free(document);
+    jsonval_destruct(&expected);
+
+    // The file is left as it was.
+    back = malloc(len + 1);
+    stream = fopen(path, "rb");
+    assert(fread(back, 1, len + 1, stream) == len);
+    fclose(stream);
+    assert(memcmp(text, back, len) == 0);
+    free(back);
+    free(text);
+    remove(path);
+
+    // An empty file fails as empty text does, not as one that cannot be read.
+    stream = fopen(path, "wb");
+    assert(stream);
+    fclose(stream);
+    document = json_mmap_decode(path, NULL, &error);
+    assert(error && !document && json_last_error()->code == JSON_ERROR_EOF);
+    remove(path);
+
+    if (!quiet) {
+        document = json_mmap_decode(path, NULL, &error);
+        assert(error && !document);
+    }
+    return 1;
+}
+
+int test_lines(bool quiet) {
+    size_t workers[] = { 1, 3, 8, 0 };
+    size_t starts[20000];
+    JsonLines *lines;
+    JsonValue jsval;
+    size_t len = 0;
+    size_t n = 0;
+    char *text;
+    char *end;
+    bool error;
+
+    // Enough for several workers, with blank lines and no final newline.
+    text = malloc(20000 * 64);
+    for (size_t i = 0; i < 20000; i++) {
+        if (i % 1000 == 7) {
+            len += sprintf(&text[len], "  \r\n\n");
+        }
+        starts[n++] = len;
+        len += sprintf(&text[len], "{\"id\": %llu, \"tags\": [\"a\\tb\", null, %s]}", (unsigned long long) i, (i % 2) ? "true" : "-1.5e3");
+        if (i < 19999) {
+            text[len++] = '\n';
+        }
+    }
+
+    for (size_t w = 0; w < sizeof workers / sizeof *workers; w++) {
+        lines = json_decode_lines(text, len, NULL, workers[w], &error);
+        assert(!error && lines && lines->len == n);
+        for (size_t i = 0; i < n; i++) {
+            end = memchr(&text[starts[i]], '\n', len - starts[i]);
+            jsval = json_ndecode(
+                &text[starts[i]],
+                (end ? end : &text[len]) - &text[starts[i]],
+                NULL,
+                &error
+            );
+            assert(!error && jsonval_equal(&lines->values[i], &jsval));
+            jsonval_destruct(&jsval);
+        }
+        json_lines_free(lines);
+    }
+
+    lines = json_decode_lines("\n \n", 3, NULL, 0, &error);
+    assert(!error && lines->len == 0);
+    json_lines_free(lines);
+
+    if (!quiet) {
+        text[starts[15000] + 1] = 'x';
+        lines = json_decode_lines(text, len, NULL, 4, &error);
+        assert(error && !lines);
+    }
+    free(text);
+    return 1;
+}
+
+int test_parallel() {
+    size_t workers[] = { 1, 3, 8, 0 };
+    JsonDecodeOptions options = { 0, 2 };
+    JsonDocument *document;
+    JsonValue expected;
+    const JsonError *last;
+    size_t len = 0;
+    size_t bad;
+    char *text;
+    bool error;
+
+    // Enough for several workers, with brackets and commas in strings.
+    text = malloc(20000 * 64);
+    len += sprintf(&text[len], " [\n");
+    for (size_t i = 0; i < 20000; i++) {
+        if (i == 15000) {
+            bad = len;
+        }
+        len += sprintf(&text[len], "%s{\"id\": %llu, \"tags\": [\"],[\", {}, %s]}", i ? ",\n" : "", (unsigned long long) i, (i % 2) ? "true" : "-1.5e3");
+    }
+    len += sprintf(&text[len], "\n] ");
+    expected = json_ndecode(text, len, NULL, &error);
+    assert(!error);
+
+    for (size_t w = 0; w < sizeof workers / sizeof *workers; w++) {
+        document = json_document_decode_parallel(
+            text, len, NULL, workers[w], &error
+        );
+        assert(!error && document);
+        assert(jsonval_equal(&expected, &document->root));
+        json_document_free(document);
+    }
+    jsonval_destruct(&expected);
+
+    // Elements may nest one level less than the document.
+    document = json_document_decode_parallel(text, len, &options, 4, &error);
+    assert(error && !document);
+    assert(json_last_error()->code == JSON_ERROR_DEPTH);
+
+    // Errors are located in the whole text, whichever thread found them.
+    text[bad + 2] = 'x';
+    document = json_document_decode_parallel(text, len, NULL, 4, &error);
+    assert(error && !document);
+    last = json_last_error();
+    assert(last->code == JSON_ERROR_CHARACTER && last->offset == bad + 2);
+    assert(last->line == 15002 && last->column == 1);
+    text[bad + 2] = '{';
+
+    // Left to the serial decoder: bad brackets, other roots, extra text.
+    text[len - 2] = '}';
+    document = json_document_decode_parallel(text, len, NULL, 4, &error);
+    assert(error && !document);
+    text[len - 2] = ']';
+    text[len - 1] = '0';
+    document = json_document_decode_parallel(text, len, NULL, 4, &error);
+    assert(error && json_last_error()->code == JSON_ERROR_TRAILING);
+    text[len - 1] = ' ';
+    text[len - 3] = ',';
+    document = json_document_decode_parallel(text, len, NULL, 4, &error);
+    assert(error && json_last_error()->code == JSON_ERROR_CHARACTER);
+    document = json_document_decode_parallel("{\"a\": []}", 9, NULL, 4, &error);
+    assert(!error && document->root.type == JSON_OBJECT);
+    json_document_free(document);
+    free(text);
+    return 1;
+}
+
+/** Writes every SAX event to a buffer, and stops after *limit* of them. */
+typedef struct SaxLog {
+    char text[512];
+    size_t len;
+    size_t events;
+    size_t limit;
+} SaxLog;
+
+bool sax_log(SaxLog *log, const char *event, const char *str, size_t len) {
+    log->len += sprintf(&log->text[log->len], "%s", event);
+    memcpy(&log->text[log->len], str, len);
+    log->len += len;
+    log->text[log->len++] = ' ';
+    log->text[log->len] = 0;
+    return ++log->events != log->limit;
+}
+
+bool sax_null(void *ctx) { return sax_log(ctx, "null", "", 0); }
+bool sax_bool(void *ctx, bool value) { return sax_log(ctx, value ? "true" : "false", "", 0); }
+bool sax_string(void *ctx, const char *str, size_t len) { return sax_log(ctx, "s:", str, len); }
+bool sax_key(void *ctx, const char *key, size_t len) { return sax_log(ctx, "k:", key, len); }
+bool sax_start_object(void *ctx) { return sax_log(ctx, "{", "", 0); }
+bool sax_end_object(void *ctx) { return sax_log(ctx, "}", "", 0); }
+bool sax_start_array(void *ctx) { return sax_log(ctx, "[", "", 0); }
+bool sax_end_array(void *ctx) { return sax_log(ctx, "]", "", 0); }
+
+bool sax_number(void *ctx, double value) {
+    char buf[32];
+
+    return sax_log(ctx, "n:", buf, sprintf(buf, "%g", value));
+}
+
+/** Sums numbers, and nothing else. */
+bool sax_sum(void *ctx, double value) {
+    *(double *) ctx += value;
+    return true;
+}
+
+int test_sax(bool quiet) {
+    JsonHandler handler = {
+        sax_null, sax_bool, sax_number, sax_string, sax_start_object,
+        sax_key, sax_end_object, sax_start_array, sax_end_array
+    };
+    JsonHandler summer = { .on_number = sax_sum };
+    char *code = "{ \"a\": [ 1, -2.5e1, \"x\\ty\", true, null ], \"b\\u0041\": {}, "
+        "\"c\": [ [], false ] }";
+    SaxLog log = { "", 0, 0, 0 };
+    double sum = 0;
+    char *big;
+    size_t len;
+    bool error;
+
+    assert(json_sax_parse(code, strlen(code), &handler, &log, &error));
+    assert(!error);
+    assert(strcmp(
+        log.text,
+        "{ k:a [ n:1 n:-25 s:x\ty true null ] k:bA { } k:c [ [ ] false ] } "
+    ) == 0);
+
+    // A callback stops everything; that is not an error.
+    log.len = log.events = 0;
+    log.limit = 4;
+    assert(!json_sax_parse(code, strlen(code), &handler, &log, &error));
+    assert(!error && strcmp(log.text, "{ k:a [ n:1 ") == 0);
+
+    // Missing callbacks are skipped.
+    big = malloc(100000 * 32 + 16);
+    len = sprintf(big, "[");
+    for (size_t i = 0; i < 100000; i++) {
+        len += sprintf(&big[len], "%s{\"k\\n\": \"v\", \"n\": [%llu]}", i ? "," : "", (unsigned long long) i);
+    }
+    len += sprintf(&big[len], "]");
+    assert(json_sax_parse(big, len, &summer, &sum, &error));
+    assert(!error && sum == 99999.0 * 100000 / 2);
+    free(big);
+
+    if (!quiet) {
+        char *invalid[] = { "", "[ 1, ]", "{ \"a\" 1 }", "[ \"\\x\" ]", "[] []" };
+
+        for (size_t i = 0; i < sizeof invalid / sizeof *invalid; i++) {
+            assert(!json_sax_parse(invalid[i], strlen(invalid[i]), &summer, &sum, &error));
+            assert(error);
+        }
+    }
+    return 1;
+}
+
+int test_cursor() {
+    char *code = "{ \"skip\": [ \"]}\\\"{[\", { \"a\": [ [ ], { } ] } ], \"n\": -12.5e1, "
+        "\"k\\u0065y\": \"v\\tw\", \"b\": true, \"list\": [ 1, [ 2, 3 ], { \"x\": 4 }, 5 ], "
+        "\"i\": 9007199254740993 }";
+    JsonCursor *root = json_cursor_construct(code, strlen(code));
+    JsonDecodeOptions options = { .max_depth = 2 };
+    const JsonError *last;
+    JsonCursor field;
+    JsonCursor element;
+    JsonCursor inner;
+    JsonValue expected;
+    JsonValue jsval;
+    double number;
+    int64_t integer;
+    size_t len;
+    size_t count;
+    char *str;
+    char *big;
+    char *bad;
+    bool flag;
+    bool error;
+
+    assert(root && json_cursor_type(root) == JSON_OBJECT);
+    // In order, then backwards, which wraps around.
+    assert(json_cursor_find_field(root, "n", &field));
+    assert(json_cursor_get_double(&field, &number) && number == -125);
+    assert(json_cursor_find_field(root, "b", &field));
+    assert(json_cursor_get_bool(&field, &flag) && flag);
+    assert(json_cursor_find_field(root, "i", &field));
+    assert(json_cursor_get_int64(&field, &integer) && integer == 9007199254740993LL);
+    assert(json_cursor_find_field(root, "n", &field));
+    assert(json_cursor_type(&field) == JSON_NUMBER);
+    assert(!json_cursor_find_field(root, "missing", &field));
+    assert(!json_cursor_get_bool(&field, &flag));
+    assert(json_cursor_find_field(root, "key", &field));
+    str = json_cursor_get_string(&field, &len);
+    assert(str && len == 3 && strcmp(str, "v\tw") == 0);
+    free(str);
+
+    // Elements, looking into some of them.
+    assert(json_cursor_find_field(root, "list", &field));
+    count = 0;
+    while (json_cursor_next_element(&field, &element)) {
+        if (json_cursor_type(&element) == JSON_OBJECT) {
+            assert(json_cursor_find_field(&element, "x", &inner));
+            assert(json_cursor_get_double(&inner, &number) && number == 4);
+        } else if (json_cursor_type(&element) == JSON_ARRAY) {
+            // Only partly, so the rest is skipped from there.
+            assert(json_cursor_next_element(&element, &inner));
+            assert(json_cursor_get_double(&inner, &number) && number == 2);
+        }
+        count++;
+    }
+    assert(count == 4 && !json_cursor_next_element(&field, &element));
+
+    assert(json_cursor_find_field(root, "skip", &field));
+    jsval = json_cursor_decode(&field, NULL, &error);
+    expected = json_sdecode("[ \"]}\\\"{[\", { \"a\": [ [ ], { } ] } ]", &error);
+    assert(!error && jsonval_equal(&expected, &jsval));
+    jsonval_destruct(&jsval);
+    jsonval_destruct(&expected);
+    json_cursor_destruct(root);
+
+    // Errors are located in the whole text, and options apply.
+    bad = "{ \"a\": [ 1,, 2 ],\n  \"b\": [ [ [ 1 ] ] ], \"c\": [ 1 } ";
+    root = json_cursor_construct(bad, strlen(bad));
+    assert(root && json_cursor_find_field(root, "a", &field));
+    json_cursor_decode(&field, NULL, &error);
+    last = json_last_error();
+    assert(error && last->offset == 11 && last->column == 12);
+    assert(json_cursor_find_field(root, "b", &field));
+    json_cursor_decode(&field, &options, &error);
+    last = json_last_error();
+    assert(error && last->code == JSON_ERROR_DEPTH && last->line == 2);
+    assert(json_cursor_find_field(root, "c", &field));
+    json_cursor_decode(&field, NULL, &error);
+    last = json_last_error();
+    assert(error && last->code == JSON_ERROR_SYNTAX && last->offset == 49);
+    json_cursor_destruct(root);
+
+    // Spread over many index chunks, read back and forth.
+    big = malloc(50000 * 48 + 16);
+    len = sprintf(big, "[");
+    for (size_t i = 0; i < 50000; i++) {
+        len += sprintf(&big[len], "%s{\"s\": \"{[\\\"\", \"v\": %llu, \"t\": [[]]}", i ? "," : "", (unsigned long long) i);
+    }
+    len += sprintf(&big[len], "]");
+    root = json_cursor_construct(big, len);
+    for (int round = 0; round < 2; round++) {
+        // Iterate a copy, so that the root can go through again.
+        inner = *root;
+        count = 0;
+        while (json_cursor_next_element(&inner, &element)) {
+            assert(json_cursor_find_field(&element, "v", &field));
+            assert(json_cursor_get_double(&field, &number) && number == count);
+            assert(json_cursor_find_field(&element, "s", &field));
+            count++;
+        }
+        assert(count == 50000);
+    }
+    json_cursor_destruct(root);
+    free(big);
+    return 1;
+}
+
+/** Feed *code* to a push parser cut at every *step* bytes. */
+bool push_decode(char *code, size_t len, size_t step, JsonValue *value) {
+    JsonParser *parser = json_parser_construct(NULL);
+    JsonParserStatus status = JSON_PARSER_MORE;
+    bool done;
+
+    assert(parser);
+    for (size_t i = 0; i < len && status != JSON_PARSER_ERROR; i += step) {
+        status = json_parser_feed(
+            parser, &code[i], (len - i < step) ? len - i : step
+        );
+    }
+    done = json_parser_finish(parser, value);
+    json_parser_destruct(parser);
+    return done;
+}
+
+int test_pushparser(bool quiet) {
+    char *samples[] = {
+        "null",
+        "-12.5e+3",
+        "  true ",
+        "\"I will say \\\"Ni!\\\" again\\\\ to \\u0079ou\"",
+        "[ 1, \"two\", { \"three\": [ 3, \"\\\"3\\\"\" ] }, [], {} ]",
+        "{ \"a\": { \"b\": { \"c\": \"deep\" } }, \"d\": -0.5e-3 }\n",
+        "[[[[[[[[[[[[[[[[[[[[[[[[ false, null ]]]]]]]]]]]]]]]]]]]]]]]]"
+    };
+    char *invalid[] = {
+        "", "[", "[ 1, ]", "{ \"a\" 1 }", "{ 1: 2 }", "[ 1 } ", "\"open",
+        "[ tru ]", "1 2", "[ 1 ] x", "{ \"a\": 1, }", "]"
+    };
+    JsonValue expected;
+    JsonValue jsval;
+    FILE *stream;
+    size_t len;
+    char *big;
+    bool error;
+
+    for (size_t i = 0; i < sizeof samples / sizeof *samples; i++) {
+        len = strlen(samples[i]);
+        expected = json_sdecode(samples[i], &error);
+        assert(!error);
+        for (size_t step = 1; step <= len; step++) {
+            assert(push_decode(samples[i], len, step, &jsval));
+            assert(jsonval_equal(&expected, &jsval));
+            jsonval_destruct(&jsval);
+        }
+        jsonval_destruct(&expected);
+    }
+
+    // Cut a long document at odd places, and read it back from a file.
+    big = malloc(100000 * 32 + 16);
+    len = sprintf(big, "[");
+    for (size_t i = 0; i < 100000; i++) {
+        len += sprintf(&big[len], "%s{\"k%llu\": [\"v\\n\", %llu.5]}", i ? "," : "", (unsigned long long) i % 97, (unsigned long long) i);
+    }
+    len += sprintf(&big[len], "]");
+    expected = json_ndecode(big, len, NULL, &error);
+    assert(!error);
+    assert(push_decode(big, len, 4093, &jsval));
+    assert(jsonval_equal(&expected, &jsval));
+    jsonval_destruct(&jsval);
+
+    stream = tmpfile();
+    assert(stream);
+    fwrite(big, 1, len, stream);
+    rewind(stream);
+    jsval = json_fdecode(stream, &error);
+    assert(!error && jsonval_equal(&expected, &jsval));
+    jsonval_destruct(&jsval);
+    fclose(stream);
+    jsonval_destruct(&expected);
+    free(big);
+
+    if (!quiet) {
+        for (size_t i = 0; i < sizeof invalid / sizeof *invalid; i++) {
+            len = strlen(invalid[i]);
+            for (size_t step = 1; step <= len || step == 1; step++) {
+                assert(!push_decode(invalid[i], len, step, &jsval));
+            }
+        }
+    }
+    return 1;
+}
+
+/** Write *depth* nested arrays, or objects with key "a", around 0. */
+char *gen_nested(size_t depth, bool objects) {
+    char *text = malloc(depth * 6 + 2);
+    size_t len = 0;
+
+    assert(text);
+    for (size_t i = 0; i < depth; i++) {
+        len += sprintf(&text[len], "%s", objects ? "{\"a\":" : "[");
+    }
+    text[len++] = '0';
+    for (size_t i = 0; i < depth; i++) {
+        text[len++] = objects ? '}' : ']';
+    }
+    text[len] = 0;
+    return text;
+}
+
+int test_depth(bool quiet) {
+    JsonDecodeOptions options = { 0, 200000 };
+    JsonDocument *document;
+    JsonParser *push;
+    JsonValue jsval;
+    JsonValue copy;
+    Lexer *lexer;
+    Parser *parser;
+    ASTNode *node;
+    FILE *stream;
+    char *encoded;
+    char *text;
+    size_t len;
+    size_t count;
+    bool error;
+
+    // Far deeper than the call stack would take, within the limit given.
+    for (int objects = 0; objects < 2; objects++) {
+        text = gen_nested(150000, objects);
+        len = strlen(text);
+        jsval = json_ndecode(text, len, &options, &error);
+        assert(!error);
+        copy = json_ndecode(text, len, &options, &error);
+        assert(!error && jsonval_equal(&jsval, &copy));
+
+        stream = tmpfile();
+        assert(stream);
+        json_fencode(stream, &jsval, false);
+        rewind(stream);
+        encoded = malloc(len + 1);
+        count = fread(encoded, 1, len + 1, stream);
+        assert(count == len && memcmp(encoded, text, len) == 0);
+        fclose(stream);
+        free(encoded);
+        jsonval_destruct(&copy);
+        jsonval_destruct(&jsval);
+
+        document = json_document_decode(text, len, &options, &error);
+        assert(!error && document->root.type == (objects ? JSON_OBJECT : JSON_ARRAY));
+        json_document_free(document);
+
+        push = json_parser_construct(&options);
+        assert(json_parser_feed(push, text, len) == JSON_PARSER_DONE);
+        assert(json_parser_finish(push, &jsval));
+        jsonval_destruct(&jsval);
+        json_parser_destruct(push);
+
+        lexer = lexer_construct(text, len);
+        parser = parser_construct(lexer);
+        parser->max_depth = options.max_depth;
+        node = parser_parse(parser);
+        assert(node != NULL);
+        ast_destruct(node);
+        parser_destruct(parser);
+        lexer_destruct(lexer);
+        free(text);
+    }
+
+    // The default limit is inclusive.
+    text = gen_nested(JSON_DEFAULT_MAX_DEPTH, true);
+    jsval = json_sdecode(text, &error);
+    assert(!error);
+    jsonval_destruct(&jsval);
+    assert(json_sax_parse(text, strlen(text), &(JsonHandler) { 0 }, NULL, &error));
+    free(text);
+
+    if (!quiet) {
+        text = gen_nested(JSON_DEFAULT_MAX_DEPTH + 1, false);
+        len = strlen(text);
+        jsval = json_sdecode(text, &error);
+        assert(error && jsval.type == JSON_NULL);
+        assert(!json_sax_parse(text, len, &(JsonHandler) { 0 }, NULL, &error));
+        assert(error);
+        assert(!push_decode(text, len, 7, &jsval));
+        lexer = lexer_construct(text, len);
+        parser = parser_construct(lexer);
+        assert(parser_parse(parser) == NULL);
+        parser_destruct(parser);
+        lexer_destruct(lexer);
+        free(text);
+
+        options.max_depth = 3;
+        jsval = json_ndecode("[[[[]]]]", 8, &options, &error);
+        assert(error);
+        jsval = json_ndecode("{\"a\": [{\"b\": {}}]}", 18, &options, &error);
+        assert(error);
+    }
+    return 1;
+}
+
+/** Check that *code* fails validation with *expected*, at *line*:*column*. */
+void validate_expect(
+    char *code, JsonErrorCode expected, size_t offset, size_t line, size_t column
+) {
+    JsonError error;
+
+    assert(!json_validate(code, strlen(code), &error));
+    assert(error.code == expected && error.message);
+    assert(error.offset == offset);
+    assert(error.line == line && error.column == column);
+}
+
+int test_validate() {
+    char *samples[] = {
+        "null",
+        " -12.5e+3 ",
+        "\"I will say \\\"Ni!\\\" again\"",
+        "[ 1, \"two\", { \"three\": [ 3, {} ] }, [], {} ]",
+        "{ \"a\": { \"b\": { \"c\": \"deep\" } }, \"d\": -0.5e-3 }\n"
+    };
+    const JsonError *last;
+    JsonParser *push;
+    JsonLines *lines;
+    JsonValue jsval;
+    char *text;
+    bool error;
+
+    for (size_t i = 0; i < sizeof samples / sizeof *samples; i++) {
+        assert(json_validate(samples[i], strlen(samples[i]), NULL));
+    }
+
+    validate_expect("", JSON_ERROR_EOF, 0, 1, 1);
+    validate_expect("[1, 2", JSON_ERROR_EOF, 5, 1, 6);
+    validate_expect("[\n  1,\n  x\n]", JSON_ERROR_CHARACTER, 9, 3, 3);
+    validate_expect("{\"a\" 1}", JSON_ERROR_SYNTAX, 5, 1, 6);
+    validate_expect("{\"a\": 1,\n}", JSON_ERROR_SYNTAX, 9, 2, 1);
+    validate_expect("[1 2]", JSON_ERROR_SYNTAX, 3, 1, 4);
+    validate_expect("\"a\\qb\"", JSON_ERROR_STRING, 3, 1, 4);
+    validate_expect("[-]", JSON_ERROR_NUMBER, 2, 1, 3);
+    validate_expect("[tru]", JSON_ERROR_LITERAL, 4, 1, 5);
+    validate_expect("[1] 2", JSON_ERROR_TRAILING, 4, 1, 5);
+    validate_expect("[\"ab\xe9" "cd\"]", JSON_ERROR_STRING, 4, 1, 5);
+    validate_expect("[\"a\\ud800\"]", JSON_ERROR_STRING, 3, 1, 4);
+    text = gen_nested(JSON_DEFAULT_MAX_DEPTH + 1, false);
+    validate_expect(text, JSON_ERROR_DEPTH, JSON_DEFAULT_MAX_DEPTH, 1, 1025);
+    free(text);
+    assert(!json_validate("[", 1, NULL));
+
+    // The decoders leave the same error behind, on this thread.
+    jsval = json_sdecode("{\n\"a\": [1,\n\"b\" }", &error);
+    assert(error && jsval.type == JSON_NULL);
+    last = json_last_error();
+    assert(last->code == JSON_ERROR_SYNTAX && last->offset == 15);
+    assert(last->line == 3 && last->column == 5);
+
+    // Offsets count from the start of all the records.
+    lines = json_decode_lines("{\"a\": 1}\n[2]\n[3,]\n", 18, NULL, 2, &error);
+    assert(error && lines == NULL);
+    last = json_last_error();
+    assert(last->code == JSON_ERROR_CHARACTER && last->offset == 16);
+    assert(last->line == 3 && last->column == 4);
+
+    // The push parser has forgotten the lines by then.
+    push = json_parser_construct(NULL);
+    assert(json_parser_feed(push, "[1, ", 4) == JSON_PARSER_MORE);
+    assert(json_parser_feed(push, "2 x", 3) == JSON_PARSER_ERROR);
+    assert(!json_parser_finish(push, &jsval));
+    json_parser_destruct(push);
+    last = json_last_error();
+    assert(last->code == JSON_ERROR_SYNTAX && last->offset == 6);
+    assert(last->line == 0 && last->column == 0);
+
+    // So have keys, which it unescapes by itself.
+    push = json_parser_construct(NULL);
+    assert(json_parser_feed(push, "{\"a\": 1, ", 9) == JSON_PARSER_MORE);
+    assert(json_parser_feed(push, "\"b\\x\": 2}", 9) == JSON_PARSER_ERROR);
+    assert(!json_parser_finish(push, &jsval));
+    json_parser_destruct(push);
+    last = json_last_error();
+    assert(last->code == JSON_ERROR_STRING && last->offset == 12);
+    return 1;
+}
+
+/** Byte-at-a-time reference for the structural index. */
+size_t structidx_reference(char *text, size_t len, size_t *out) {
+    bool in_string = false;
+    bool escaped = false;
+    bool escaped_now;
+    bool scalar = false;
+    size_t n = 0;
+    char c;
+
+    for (size_t i = 0; i < len; i++) {
+        c = text[i];
+        escaped_now = escaped;
+        escaped = c == '\\' && !escaped_now;
+        if (c == '"' && !escaped_now) {
+            if (!in_string) {
+                out[n++] = i;
+            }
+            in_string = !in_string;
+            scalar = false;
+        } else if (in_string) {
+            continue;
+        } else if (c && strchr("{}[]:,", c)) {
+            out[n++] = i;
+            scalar = false;
+        } else if (c && strchr(" \t\n\r", c)) {
+            scalar = false;
+        } else {
+            if (!scalar) {
+                out[n++] = i;
+            }
+            scalar = true;
+        }
+    }
+    return n;
+}
+
+int test_structidx() {
+    static StructIndex index;
+    char alphabet[] = "\"\\\\ \n{}[]:,a1";
+    size_t len = 3 * STRUCTIDX_CHUNK + 17;
+    char *text = malloc(len);
+    size_t *expected = malloc(len * sizeof (size_t));
+    size_t n;
+    size_t k;
+
+    srand(42);
+    for (int round = 0; round < 64; round++) {
+        for (size_t i = 0; i < len; i++) {
+            // Every other round is mostly backslashes, to get long runs
+            // crossing block boundaries.
+            if (round % 2 && rand() % 4) {
+                text[i] = '\\';
+            } else {
+                text[i] = alphabet[rand() % (sizeof alphabet - 1)];
+            }
+        }
+        n = structidx_reference(text, len, expected);
+
+        k = 0;
+        structidx_init(&index);
+        while (index.end < len) {
+            structidx_next_chunk(&index, text, len);
+            for (size_t i = 0; i < index.len; i++) {
+                assert(k < n);
+                assert(expected[k++] == index.base + index.pos[i]);
+            }
+        }
+        assert(k == n);
+    }
+
+    free(text);
+    free(expected);
     return 1;
 }
 
 void print_tokens(Lexer *lexer) {
-    Token *token;
-    while ((token = lexer_next(lexer))) {
-        token_print(token);
-        if (token->kind == TOKEN_EOF)
+    Token token;
+    while (lexer_next(lexer, &token)) {
+        token_print(&token, lexer->text);
+        if (token.kind == TOKEN_EOF)
             break;
     }
 }
 
 int test_lexer() {
     Lexer *lexer;
-    Token *token;
-
-    lexer = lexer_construct("\
+    Token token;
+    char *code = "\
         [\
             true,\
             false,\
@@ -156,17 +1107,42 @@ int test_lexer() {
                 \"int\": -10,\
                 \"float\": 3.14\
             },\
-            \"x\\udead\\ubeef\"\
+            \"x\\ud83d\\ude00\\u00e9\"\
         ]\
-    ");
+    ";
+
+    TokenKind kinds[] = {
+        '[', TOKEN_BOOL, ',', TOKEN_BOOL, ',', TOKEN_NULL, ',', '{',
+        TOKEN_STRING, ':', TOKEN_NUMBER, ',', TOKEN_STRING, ':', TOKEN_NUMBER,
+        ',', TOKEN_STRING, ':', TOKEN_NUMBER, '}', ',', TOKEN_STRING, ']',
+        TOKEN_EOF
+    };
+    char *value;
+    size_t len;
+    size_t n = 0;
+    bool ok;
+
+    lexer = lexer_construct(code, strlen(code));
     // print_tokens(lexer);
     while (1) {
-        token = lexer_next(lexer);
-        assert(token != NULL);
-        if (token->kind == TOKEN_EOF) {
+        ok = lexer_next(lexer, &token);
+        assert(ok);
+        assert(token.kind == kinds[n++]);
+        if (token.kind == TOKEN_NUMBER && n == 11) {
+            assert(token.len == 7 && strncmp(&code[token.start], "1.2e+10", 7) == 0);
+        }
+        if (token.kind == TOKEN_STRING && n == 22) {
+            // Spans keep the quotes and the escapes, values are UTF-8.
+            assert(strncmp(&code[token.start], "\"x\\ud83d\\ude00\\u00e9\"", token.len) == 0);
+            value = lexer_token_string(lexer, &token, &len);
+            assert(value && len == 7 && strcmp(value, "x\xf0\x9f\x98\x80\xc3\xa9") == 0);
+            free(value);
+        }
+        if (token.kind == TOKEN_EOF) {
             break;
         }
     }
+    assert(n == sizeof kinds / sizeof *kinds);
     lexer_destruct(lexer);
 
     return 1;
@@ -177,7 +1153,7 @@ void gen_ast(char *code, bool quiet) {
     Parser *parser;
     ASTNode *node;
 
-    lexer = lexer_construct(code);
+    lexer = lexer_construct(code, strlen(code));
     parser = parser_construct(lexer);
     node = parser_parse(parser);
     assert(node != NULL);
@@ -188,7 +1164,6 @@ void gen_ast(char *code, bool quiet) {
         assert(strcmp(node->value, code) == 0);
     }
     lexer_destruct(lexer);
-    token_destruct(parser->token);
     parser_destruct(parser);
     ast_destruct(node);
 }
@@ -198,7 +1173,7 @@ void gen_ast_expect(char *code) {
     Parser *parser;
     ASTNode *node;
 
-    lexer = lexer_construct(code);
+    lexer = lexer_construct(code, strlen(code));
     parser = parser_construct(lexer);
     node = parser_parse(parser);
     assert(node == NULL);
@@ -253,34 +1228,42 @@ int test_decoder() {
     jsval = json_sdecode("null", &error);
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("true", &error);
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("false", &error);
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("0", &error);
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("1.5e3", &error);
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("\"spam\\u0020eggs\\n\\\"ham\\\"\\tjam\"", &error);
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("[1, 2, 3, 4, 5]", &error);
     json_fencode(stdout, &jsval, false);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode("{\"a\": 1, \"b\": 2, \"c\": 3}", &error);
     json_fencode(stdout, &jsval, false);
     printf("\n");
+    jsonval_destruct(&jsval);
 
     jsval = json_sdecode(
         "\
@@ -297,7 +1280,729 @@ int test_decoder() {
     printf("\n");
     json_fencode(stdout, &jsval, true);
     printf("\n");
+    jsonval_destruct(&jsval);
+
+    return 1;
+}
+
+void decode_expect(char *code) {
+    JsonValue jsval;
+    bool error;
+
+    jsval = json_sdecode(code, &error);
+    assert(error);
+    assert(jsval.type == JSON_NULL);
+}
+
+int test_decoder_slice(bool quiet) {
+    // Only the first *len* bytes are JSON; the rest must never be read.
+    char text[] = { '[', '1', '2', ',', '"', 'a', '"', ']', '3', 'x' };
+    JsonValue jsval;
+    bool error;
 
+    jsval = json_ndecode(text, 8, NULL, &error);
+    assert(!error && jsval.type == JSON_ARRAY);
+    assert(jsval.value.as_arr->len == 2);
+    assert(jsonarr_getitem(jsval.value.as_arr, 0)->value.as_num == 12);
+    assert(strcmp(jsonarr_getitem(jsval.value.as_arr, 1)->value.as_str, "a") == 0);
+    jsonval_destruct(&jsval);
+
+    jsval = json_ndecode(&text[1], 1, NULL, &error);
+    assert(!error && jsval.value.as_num == 1);
+
+    jsval = json_ndecode(&text[4], 3, NULL, &error);
+    assert(!error && strcmp(jsval.value.as_str, "a") == 0);
+    jsonval_destruct(&jsval);
+
+    if (!quiet) {
+        // Cut in the middle of a string or a literal.
+        json_ndecode(&text[4], 2, NULL, &error);
+        assert(error);
+        json_ndecode("true", 3, NULL, &error);
+        assert(error);
+    }
+    return 1;
+}
+
+int test_decoder_strings(bool quiet) {
+    char json[128];
+    char expected[128];
+    JsonValue jsval;
+    bool error;
+
+    // Put an escape at every offset around the 16 and 32 byte strides.
+    for (size_t len = 0; len < 70; len++) {
+        for (size_t at = 0; at <= len; at++) {
+            memset(json, 'x', sizeof json);
+            memset(expected, 'x', sizeof expected);
+            json[0] = '"';
+            json[1 + at] = '\\';
+            json[2 + at] = 'n';
+            json[len + 3] = '"';
+            expected[at] = '\n';
+            expected[len + 1] = 0;
+
+            jsval = json_ndecode(json, len + 4, NULL, &error);
+            assert(!error && jsval.type == JSON_STRING);
+            assert(strcmp(jsval.value.as_str, expected) == 0);
+            free(jsval.value.as_str);
+        }
+    }
+
+    jsval = json_sdecode("\"caf\xc3\xa9 \\u00e9 \\/\\\\\\b\\f\\r\\t\"", &error);
+    assert(!error);
+    assert(strcmp(jsval.value.as_str, "caf\xc3\xa9 \xc3\xa9 /\\\b\f\r\t") == 0);
+    free(jsval.value.as_str);
+
+    // Escapes of the same text compare, hash and count as the text.
+    jsval = json_sdecode("{\"\\u00e9t\\u00c9\": 1, \"\\uD834\\uDD1E\": 2}", &error);
+    assert(!error);
+    assert(jsonobj_contains(jsval.value.as_obj, "\xc3\xa9t\xc3\x89"));
+    assert(jsonobj_contains(jsval.value.as_obj, "\xf0\x9d\x84\x9e"));
+    jsonval_destruct(&jsval);
+
+    if (!quiet) {
+        decode_expect("\"tab\there\"");
+        decode_expect("\"bad \\x escape\"");
+        decode_expect("\"bad \\u12g4 escape\"");
+        decode_expect("\"cut \\u12");
+        decode_expect("\"cut \\");
+        decode_expect("\"nul \\u0000 inside\"");
+        decode_expect("\"lone \\ud800 high\"");
+        decode_expect("\"lone \\udc00 low\"");
+        decode_expect("\"high \\ud800\\u0041 then other\"");
+        decode_expect("\"raw \xc3 cut\"");
+        decode_expect("\"overlong \xc0\xaf\"");
+        decode_expect("\"surrogate \xed\xa0\x80\"");
+        decode_expect("\"too large \xf4\x90\x80\x80\"");
+    }
+    return 1;
+}
+
+/** Encode *jsval* into a new string, as json_fencode() writes it. */
+char *encode(JsonValue *jsval, unsigned int flags) {
+    FILE *stream = tmpfile();
+    char *text;
+    long len;
+
+    assert(stream);
+    json_fencode(stream, jsval, flags);
+    len = ftell(stream);
+    rewind(stream);
+    text = malloc(len + 1);
+    assert(text && fread(text, 1, len, stream) == (size_t) len);
+    text[len] = 0;
+    fclose(stream);
+    return text;
+}
+
+int test_encoder_strings() {
+    char *code = "[\"caf\xc3\xa9\", \"\\u00e9\\ud834\\udd1e\\\\u\\\"\\/\\n\"]";
+    char *raw = "[\"caf\xc3\xa9\",\"\xc3\xa9\xf0\x9d\x84\x9e\\\\u\\\"/\\n\"]";
+    char *ascii = "[\"caf\\u00e9\",\"\\u00e9\\ud834\\udd1e\\\\u\\\"/\\n\"]";
+    char *special[][2] = {
+        { "\"", "\\\"" }, { "\\", "\\\\" }, { "\n", "\\n" },
+        { "\x02", "\\u0002" }, { "\xc3\xa9", "\\u00e9" },
+    };
+    char str[80];
+    JsonValue jsval;
+    JsonValue copy;
+    char *text;
+    bool error;
+
+    jsval = json_sdecode(code, &error);
+    assert(!error);
+
+    // Both read back as the same strings.
+    text = encode(&jsval, 0);
+    assert(strcmp(text, raw) == 0);
+    copy = json_sdecode(text, &error);
+    assert(!error && jsonval_equal(&jsval, &copy));
+    jsonval_destruct(&copy);
+    free(text);
+
+    text = encode(&jsval, JSON_ENCODE_ASCII);
+    assert(strcmp(text, ascii) == 0);
+    copy = json_sdecode(text, &error);
+    assert(!error && jsonval_equal(&jsval, &copy));
+    jsonval_destruct(&copy);
+    free(text);
+    jsonval_destruct(&jsval);
+
+    // Whatever is not UTF-8 can only be replaced.
+    jsval.type = JSON_STRING;
+    jsval.value.as_str = "a\xff\xc3";
+    text = encode(&jsval, JSON_ENCODE_ASCII);
+    assert(strcmp(text, "\"a\\ufffd\\ufffd\"") == 0);
+    free(text);
+
+    // Control characters without a short form are escaped too.
+    jsval.value.as_str = "\x01\x1f\x7f\b";
+    text = encode(&jsval, 0);
+    assert(strcmp(text, "\"\\u0001\\u001f\x7f\\b\"") == 0);
+    free(text);
+
+    // Escapes anywhere in runs longer than a vector.
+    for (size_t i = 0; i < sizeof(special) / sizeof(special[0]); i++) {
+        for (size_t pos = 0; pos < 68; pos++) {
+            memset(str, 'a', 70);
+            str[70] = 0;
+            memcpy(&str[pos], special[i][0], strlen(special[i][0]));
+            jsval.value.as_str = str;
+            text = json_sencode(&jsval, JSON_ENCODE_ASCII, NULL);
+            assert(strncmp(&text[pos + 1], special[i][1],
+                strlen(special[i][1])) == 0);
+            assert(strlen(text) == 72 - strlen(special[i][0])
+                + strlen(special[i][1]));
+            free(text);
+        }
+    }
+    return 1;
+}
+
+int test_encoder() {
+    char *code = "{\"a\": [1, 2.5, true, null, \"x\", {}]}";
+    char buf[16];
+    char *big;
+    char *text;
+    char *copy;
+    JsonValue jsval;
+    size_t len;
+    size_t i;
+    bool error;
+
+    jsval = json_sdecode(code, &error);
+    assert(!error);
+
+    // All ways of encoding write the same text.
+    copy = json_sencode(&jsval, 0, &len);
+    text = encode(&jsval, 0);
+    assert(copy && len == strlen(text) && strcmp(copy, text) == 0);
+    assert(strcmp(copy, "{\"a\":[1,2.5,true,null,\"x\",{}]}") == 0);
+    free(copy);
+    free(text);
+
+    copy = json_sencode(&jsval, JSON_ENCODE_PRETTY, NULL);
+    text = encode(&jsval, JSON_ENCODE_PRETTY);
+    assert(copy && strcmp(copy, text) == 0 && strchr(copy, '\n'));
+    free(text);
+
+    // A fixed buffer is cut short, and terminated, as snprintf() would.
+    assert(json_sencode_into(NULL, 0, &jsval, JSON_ENCODE_PRETTY)
+        == strlen(copy));
+    assert(json_sencode_into(buf, sizeof(buf), &jsval, JSON_ENCODE_PRETTY)
+        == strlen(copy));
+    assert(strncmp(buf, copy, sizeof(buf) - 1) == 0);
+    assert(buf[sizeof(buf) - 1] == 0);
+    free(copy);
+
+    assert(json_sencode_into(buf, sizeof(buf), &jsval, 0) == 30);
+    len = json_sencode_into(buf, 1, &jsval, 0);
+    assert(len == 30 && buf[0] == 0);
+    jsonval_destruct(&jsval);
+
+    jsval.type = JSON_BOOL;
+    jsval.value.as_bool = true;
+    assert(json_sencode_into(buf, sizeof(buf), &jsval, 0) == 4);
+    assert(strcmp(buf, "true") == 0);
+
+    // Members are written in the order they were decoded.
+    code = "{\"zeta\":1,\"alpha\":{\"b\":2,\"a\":3},\"mid\":[],\"beta\":4}";
+    jsval = json_sdecode(code, &error);
+    assert(!error);
+    copy = json_sencode(&jsval, 0, NULL);
+    assert(copy && strcmp(copy, code) == 0);
+    free(copy);
+    jsonval_destruct(&jsval);
+
+    // Documents larger than the stream buffer go out in several blocks.
+    big = malloc(200000);
+    assert(big);
+    len = 0;
+    big[len++] = '[';
+    for (i = 0; i < 20000; i++) {
+        len += sprintf(&big[len], "%s\"%05zu\"", i ? "," : "", i);
+    }
+    big[len++] = ']';
+    big[len] = 0;
+    jsval = json_sdecode(big, &error);
+    assert(!error);
+    text = encode(&jsval, 0);
+    assert(strcmp(text, big) == 0);
+    copy = json_sencode(&jsval, 0, &len);
+    assert(copy && len == strlen(big) && strcmp(copy, big) == 0);
+    free(copy);
+    free(text);
+    free(big);
+    jsonval_destruct(&jsval);
+    return 1;
+}
+
+/** A sink that takes up to *limit* bytes a call, none every other call. */
+typedef struct TestSink {
+    char *text;
+    size_t len;
+    size_t limit;
+    size_t calls;
+    // The start of a string that must be handed by reference.
+    const char *ref;
+    bool referenced;
+} TestSink;
+
+size_t test_sink_write(void *ctx, const JsonChunk *chunks, size_t count) {
+    TestSink *sink = ctx;
+    size_t taken = 0;
+    size_t n;
+
+    if (sink->calls++ % 2) {
+        return 0;
+    }
+    for (size_t i = 0; i < count && taken < sink->limit; i++) {
+        n = chunks[i].len;
+        if (n > sink->limit - taken) {
+            n = sink->limit - taken;
+        }
+        if (chunks[i].data == sink->ref) {
+            sink->referenced = true;
+        }
+        memcpy(&sink->text[sink->len], chunks[i].data, n);
+        sink->len += n;
+        taken += n;
+    }
+    return taken;
+}
+
+size_t test_sink_fail(void *ctx, const JsonChunk *chunks, size_t count) {
+    return SIZE_MAX;
+}
+
+int test_sink() {
+    JsonArray *arr = jsonarr_construct(4);
+    JsonValue jsval = { .type = JSON_ARRAY, .value.as_arr = arr };
+    JsonValue item;
+    TestSink test = { 0 };
+    JsonSink sink = { test_sink_write, &test };
+    JsonEncoder *encoder;
+    JsonEncoderStatus status;
+    char *big = malloc(100000);
+    char *text;
+    char *copy;
+    size_t len;
+    size_t more = 0;
+    FILE *stream;
+#if !defined(_WIN32)
+    int fds[2];
+    ssize_t n;
+#endif
+
+    // A long string after a few values, and one to escape.
+    assert(arr && big);
+    memset(big, 'x', 99999);
+    big[99999] = 0;
+    for (int i = 0; i < 3; i++) {
+        item.type = JSON_NUMBER;
+        item.value.as_num = i * 0.5;
+        assert(jsonarr_append(arr, &item));
+        item.type = JSON_STRING;
+        // The tree owns its strings.
+        item.value.as_str = (i == 1) ? big : strdup("a \"b\"");
+        assert(jsonarr_append(arr, &item));
+    }
+    text = json_sencode(&jsval, JSON_ENCODE_PRETTY, &len);
+    assert(text);
+
+    // Paused and resumed until the sink has taken everything.
+    test.text = malloc(len);
+    test.limit = 1000;
+    test.ref = big;
+    encoder = json_encoder_construct(&jsval, JSON_ENCODE_PRETTY, sink);
+    assert(encoder && test.text);
+    while ((status = json_encoder_resume(encoder)) == JSON_ENCODER_MORE) {
+        more++;
+    }
+    assert(status == JSON_ENCODER_DONE && more > len / test.limit);
+    assert(json_encoder_resume(encoder) == JSON_ENCODER_DONE);
+    json_encoder_destruct(encoder);
+    assert(test.len == len && memcmp(test.text, text, len) == 0);
+    assert(test.referenced);
+
+    // Errors stick.
+    sink.write = test_sink_fail;
+    encoder = json_encoder_construct(&jsval, 0, sink);
+    assert(encoder);
+    assert(json_encoder_resume(encoder) == JSON_ENCODER_ERROR);
+    assert(json_last_error()->code == JSON_ERROR_IO);
+    assert(json_encoder_resume(encoder) == JSON_ENCODER_ERROR);
+    json_encoder_destruct(encoder);
+
+    // To a file descriptor, through writev().
+    stream = tmpfile();
+    assert(stream);
+    assert(json_fdencode(fileno(stream), &jsval, JSON_ENCODE_PRETTY));
+    rewind(stream);
+    copy = malloc(len + 1);
+    assert(copy && fread(copy, 1, len + 1, stream) == len);
+    assert(memcmp(copy, text, len) == 0);
+    fclose(stream);
+
+#if !defined(_WIN32)
+    // A pipe that fills up long before the text is over.
+    assert(pipe(fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    encoder = json_encoder_construct(
+        &jsval, JSON_ENCODE_PRETTY, json_fd_sink(fds[1])
+    );
+    assert(encoder);
+    more = 0;
+    len = 0;
+    do {
+        status = json_encoder_resume(encoder);
+        while ((n = read(fds[0], &copy[len], 4096)) > 0) {
+            len += n;
+        }
+        more += status == JSON_ENCODER_MORE;
+    } while (status == JSON_ENCODER_MORE);
+    assert(status == JSON_ENCODER_DONE && more > 0);
+    assert(len == strlen(text) && memcmp(copy, text, len) == 0);
+    json_encoder_destruct(encoder);
+    close(fds[0]);
+    close(fds[1]);
+#endif
+
+    free(copy);
+    free(test.text);
+    free(text);
+    jsonval_destruct(&jsval);
+    return 1;
+}
+
+/** Write {"a": [1, 2.5, true, null, "x", {}, -3, []]} through *writer*. */
+bool write_sample(JsonWriter *writer) {
+    return json_writer_begin_object(writer)
+        && json_writer_key(writer, "a")
+        && json_writer_begin_array(writer)
+        && json_writer_uint64(writer, 1)
+        && json_writer_double(writer, 2.5)
+        && json_writer_bool(writer, true)
+        && json_writer_null(writer)
+        && json_writer_string(writer, "x")
+        && json_writer_begin_object(writer)
+        && json_writer_end_object(writer)
+        && json_writer_int64(writer, -3)
+        && json_writer_begin_array(writer)
+        && json_writer_end_array(writer)
+        && json_writer_end_array(writer)
+        && json_writer_end_object(writer);
+}
+
+int test_writer() {
+    char *code = "{\"a\": [1, 2.5, true, null, \"x\", {}, -3, []]}";
+    unsigned int flags[] = { 0, JSON_ENCODE_PRETTY };
+    TestSink test = { 0 };
+    JsonSink sink = { test_sink_write, &test };
+    JsonWriter *writer;
+    JsonValue jsval;
+    const char *text;
+    char *expected;
+    char *buf;
+    size_t len;
+    bool error;
+
+    jsval = json_sdecode(code, &error);
+    assert(!error);
+
+    // The same text as from a tree.
+    for (int i = 0; i < 2; i++) {
+        expected = json_sencode(&jsval, flags[i], NULL);
+        writer = json_writer_construct(flags[i]);
+        assert(expected && writer && write_sample(writer));
+        assert(json_writer_finish(writer));
+        text = json_writer_text(writer, &len);
+        assert(text && len == strlen(expected) && strcmp(text, expected) == 0);
+        json_writer_destruct(writer);
+        free(expected);
+    }
+
+    // Through a sink that takes a few bytes at a time.
+    expected = json_sencode(&jsval, JSON_ENCODE_PRETTY, &len);
+    test.text = malloc(len);
+    test.limit = 5;
+    writer = json_writer_construct_sink(sink, JSON_ENCODE_PRETTY);
+    assert(expected && test.text && writer && write_sample(writer));
+    // Finishing tells that the sink has yet to take the rest.
+    assert(!json_writer_finish(writer) && test.len < len);
+    while (!json_writer_flush(writer)) {
+    }
+    assert(json_writer_text(writer, NULL) == NULL);
+    assert(test.len == len && memcmp(test.text, expected, len) == 0);
+    json_writer_destruct(writer);
+    free(test.text);
+    free(expected);
+    jsonval_destruct(&jsval);
+
+    // Long strings are copied, since the caller may reuse them right away.
+    buf = malloc(5001);
+    test = (TestSink) { .text = malloc(20000), .limit = SIZE_MAX, .ref = buf };
+    writer = json_writer_construct_sink(sink, 0);
+    assert(buf && test.text && writer && json_writer_begin_object(writer));
+    memset(buf, 'a', 5000);
+    buf[5000] = 0;
+    assert(json_writer_key(writer, buf));
+    memset(buf, 'b', 5000);
+    assert(json_writer_string(writer, buf));
+    assert(json_writer_end_object(writer) && json_writer_finish(writer));
+    assert(test.len == 10007 && !test.referenced);
+    for (size_t i = 0; i < 5000; i++) {
+        assert(test.text[2 + i] == 'a' && test.text[5005 + i] == 'b');
+    }
+    json_writer_destruct(writer);
+    free(test.text);
+    free(buf);
+
+    // Calls out of order fail, for good.
+    writer = json_writer_construct(0);
+    assert(writer && json_writer_begin_array(writer));
+    assert(!json_writer_key(writer, "a"));
+    assert(json_last_error()->code == JSON_ERROR_SYNTAX);
+    assert(!json_writer_null(writer));
+    json_writer_destruct(writer);
+
+    writer = json_writer_construct(0);
+    assert(writer && json_writer_begin_object(writer));
+    assert(!json_writer_string(writer, "a"));
+    json_writer_destruct(writer);
+
+    writer = json_writer_construct(0);
+    assert(writer && json_writer_begin_object(writer));
+    assert(json_writer_key(writer, "a"));
+    assert(!json_writer_end_object(writer));
+    json_writer_destruct(writer);
+
+    writer = json_writer_construct(0);
+    assert(writer && json_writer_begin_array(writer));
+    assert(!json_writer_end_object(writer));
+    json_writer_destruct(writer);
+
+    writer = json_writer_construct(0);
+    assert(writer && json_writer_begin_array(writer));
+    assert(!json_writer_finish(writer));
+    assert(json_last_error()->code == JSON_ERROR_EOF);
+    json_writer_destruct(writer);
+
+    writer = json_writer_construct(0);
+    assert(writer && json_writer_bool(writer, false));
+    assert(!json_writer_bool(writer, true));
+    assert(!json_writer_end_array(writer));
+    json_writer_destruct(writer);
+    return 1;
+}
+
+int test_encoder_numbers() {
+    struct {
+        double value;
+        char *text;
+    } cases[] = {
+        { 0.1, "0.1" }, { -0.0, "-0" }, { 3, "3" }, { 123.456, "123.456" },
+        { 1e20, "100000000000000000000" }, { 1e21, "1e21" },
+        { 1e-6, "0.000001" }, { 1e-7, "1e-7" }, { -1.5e-10, "-1.5e-10" },
+        { 5e-324, "5e-324" }, { 9007199254740993.0, "9007199254740992" },
+        { 1.7976931348623157e308, "1.7976931348623157e308" },
+        { 2.2250738585072014e-308, "2.2250738585072014e-308" },
+    };
+    char buf[64];
+    JsonValue jsval;
+    JsonValue copy;
+    uint64_t state = 88172645463325252ULL;
+    uint64_t bits;
+    char *text;
+    bool error;
+
+    jsval.type = JSON_NUMBER;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        jsval.value.as_num = cases[i].value;
+        json_sencode_into(buf, sizeof(buf), &jsval, 0);
+        assert(strcmp(buf, cases[i].text) == 0);
+    }
+
+    // JSON cannot tell these.
+    jsval.value.as_num = NAN;
+    json_sencode_into(buf, sizeof(buf), &jsval, 0);
+    assert(strcmp(buf, "null") == 0);
+    jsval.value.as_num = -INFINITY;
+    json_sencode_into(buf, sizeof(buf), &jsval, 0);
+    assert(strcmp(buf, "null") == 0);
+
+    jsval.type = JSON_INTEGER;
+    jsval.value.as_int = INT64_MIN;
+    json_sencode_into(buf, sizeof(buf), &jsval, 0);
+    assert(strcmp(buf, "-9223372036854775808") == 0);
+    jsval.type = JSON_UNSIGNED;
+    jsval.value.as_uint = UINT64_MAX;
+    json_sencode_into(buf, sizeof(buf), &jsval, 0);
+    assert(strcmp(buf, "18446744073709551615") == 0);
+
+    // Any double reads back the same.
+    jsval.type = JSON_NUMBER;
+    for (int i = 0; i < 100000; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        bits = (i % 2) ? state : state & 0x800fffffffffffffULL;
+        memcpy(&jsval.value.as_num, &bits, sizeof(bits));
+        if (!isfinite(jsval.value.as_num)) {
+            continue;
+        }
+        text = json_sencode(&jsval, 0, NULL);
+        copy = json_sdecode(text, &error);
+        assert(!error && copy.type == JSON_NUMBER);
+        assert(memcmp(&copy.value.as_num, &bits, sizeof(bits)) == 0);
+        free(text);
+    }
+    return 1;
+}
+
+double decode_number(char *code) {
+    JsonValue jsval;
+    bool error;
+
+    jsval = json_sdecode(code, &error);
+    assert(!error && jsval.type == JSON_NUMBER);
+    return jsval.value.as_num;
+}
+
+int test_decoder_numbers(bool quiet) {
+    JsonDecodeOptions options = { JSON_DECODE_INTEGERS };
+    char code[64];
+    char *p;
+    JsonValue jsval;
+    bool error;
+    double expected;
+    double value;
+
+    // Hard cases for correct rounding, checked against strtod.
+    char *hard[] = {
+        "9007199254740993", "9007199254740993.0000000000000000001",
+        "2.2250738585072011e-308", "2.2250738585072014e-308",
+        "4.9406564584124654e-324", "2.4703282292062327e-324",
+        "2.4703282292062328e-324", "1.7976931348623157e308",
+        "1.7976931348623158e308", "1.7976931348623159e308", "1e309",
+        "0.1", "0.3", "123456789012345678901234567890e-10", "7.3177701707893310e+15",
+        "1e-400", "0.0000000000000000000000000000000000001", "-0", "-0.0e5",
+        "3.14159265358979323846264338327950288419716939937510",
+        "1000000000000000000000000000000000000000000000000000000000001e-60",
+        "8.98846567431158e307", "4.35679828813468e-311", "1e23", "1e22"
+    };
+    for (size_t i = 0; i < sizeof hard / sizeof *hard; i++) {
+        value = decode_number(hard[i]);
+        expected = strtod(hard[i], NULL);
+        assert(memcmp(&value, &expected, sizeof value) == 0);
+    }
+
+    // Random digits, dots and exponents, against strtod too.
+    srand(42);
+    for (int i = 0; i < 200000; i++) {
+        p = code;
+        if (rand() % 2) {
+            *p++ = '-';
+        }
+        int ndigits = 1 + rand() % 24;
+        int dot = rand() % (ndigits + 1);
+        for (int j = 0; j < ndigits; j++) {
+            if (j == dot && j) {
+                *p++ = '.';
+            }
+            *p++ = (j == 0 && ndigits > 1 && dot != 1) ? '1' + rand() % 9 : '0' + rand() % 10;
+        }
+        if (rand() % 2) {
+            p += sprintf(p, "e%d", rand() % 660 - 340);
+        }
+        *p = 0;
+        value = decode_number(code);
+        expected = strtod(code, NULL);
+        assert(memcmp(&value, &expected, sizeof value) == 0);
+    }
+
+    // Integers survive exactly when asked to.
+    jsval = json_ndecode("9007199254740993", 16, &options, &error);
+    assert(!error && jsval.type == JSON_INTEGER);
+    assert(jsval.value.as_int == 9007199254740993LL);
+    jsval = json_ndecode("-9223372036854775808", 20, &options, &error);
+    assert(!error && jsval.type == JSON_INTEGER && jsval.value.as_int == INT64_MIN);
+    jsval = json_ndecode("18446744073709551615", 20, &options, &error);
+    assert(!error && jsval.type == JSON_UNSIGNED);
+    assert(jsval.value.as_uint == UINT64_MAX);
+    jsval = json_ndecode("18446744073709551616", 20, &options, &error);
+    assert(!error && jsval.type == JSON_NUMBER);
+    assert(jsval.value.as_num == 18446744073709551616.0);
+    jsval = json_ndecode("-9223372036854775809", 20, &options, &error);
+    assert(!error && jsval.type == JSON_NUMBER);
+    jsval = json_ndecode("-0", 2, &options, &error);
+    assert(!error && jsval.type == JSON_NUMBER && signbit(jsval.value.as_num));
+    jsval = json_ndecode("1.0", 3, &options, &error);
+    assert(!error && jsval.type == JSON_NUMBER && jsval.value.as_num == 1);
+    jsval = json_ndecode("0", 1, &options, &error);
+    assert(!error && jsval.type == JSON_INTEGER && jsval.value.as_int == 0);
+
+    if (!quiet) {
+        decode_expect("-");
+        decode_expect("01");
+        decode_expect("1.e5");
+        decode_expect("1e+");
+        decode_expect("--1");
+    }
+    return 1;
+}
+
+int test_decoder_values(bool quiet) {
+    JsonValue jsval;
+    JsonValue *item;
+    JsonArray *arr;
+    JsonObject *obj;
+    bool error;
+
+    jsval = json_sdecode(" [ true, null, -13.0e1, \"I say \\\"Ni!\\\"\" ] ", &error);
+    assert(!error && jsval.type == JSON_ARRAY);
+    arr = jsval.value.as_arr;
+    assert(arr->len == 4);
+    assert(jsonarr_getitem(arr, 0)->type == JSON_BOOL);
+    assert(jsonarr_getitem(arr, 0)->value.as_bool);
+    assert(jsonarr_getitem(arr, 1)->type == JSON_NULL);
+    assert(jsonarr_getitem(arr, 2)->value.as_num == -130);
+    assert(strcmp(jsonarr_getitem(arr, 3)->value.as_str, "I say \"Ni!\"") == 0);
+    jsonval_destruct(&jsval);
+
+    jsval = json_sdecode(
+        "{ \"a\": {}, \"b\": [], \"c\": { \"d\": [ false ] } }", &error
+    );
+    assert(!error && jsval.type == JSON_OBJECT);
+    obj = jsval.value.as_obj;
+    assert(obj->len == 3);
+    assert(jsonobj_getitem(obj, "a")->value.as_obj->len == 0);
+    assert(jsonobj_getitem(obj, "b")->value.as_arr->len == 0);
+    item = jsonobj_getitem(jsonobj_getitem(obj, "c")->value.as_obj, "d");
+    assert(item->type == JSON_ARRAY && item->value.as_arr->len == 1);
+    assert(!jsonarr_getitem(item->value.as_arr, 0)->value.as_bool);
+    jsonval_destruct(&jsval);
+
+    if (!quiet) {
+        decode_expect("    0000001");
+        decode_expect("    3.");
+        decode_expect("\"if you don't appease us.");
+        decode_expect("[ nil ]");
+        decode_expect("[ nul ]");
+        decode_expect("[ 0.0, ]");
+        decode_expect("{[]}");
+        decode_expect("{ \"foo\": { }");
+        decode_expect("{ \"foo\": \"bar\", }");
+        decode_expect("{ \"foo\" \"bar\" }");
+        decode_expect("[ 1 2 ]");
+        decode_expect("[ 1 ] 2");
+        decode_expect("[ 1x ]");
+        decode_expect("[ \"a\"x ]");
+        decode_expect("[ 1,\n\n    x ]");
+        decode_expect("");
+    }
     return 1;
 }
 
@@ -310,6 +2015,14 @@ int main() {
         printf("JsonObject tests passed.\n");
     }
 
+    if (test_arena()) {
+        printf("JsonArena tests passed.\n");
+    }
+
+    if (test_structidx()) {
+        printf("Structural index tests passed.\n");
+    }
+
     if (test_lexer()) {
         printf("Lexer tests passed.\n");
     }
@@ -322,5 +2035,77 @@ int main() {
         printf("Decoder tests passed.\n");
     }
 
+    if (test_decoder_values(true)) {
+        printf("Decoder value tests passed.\n");
+    }
+
+    if (test_decoder_slice(true)) {
+        printf("Decoder slice tests passed.\n");
+    }
+
+    if (test_decoder_strings(true)) {
+        printf("Decoder string tests passed.\n");
+    }
+
+    if (test_encoder_strings()) {
+        printf("Encoder string tests passed.\n");
+    }
+
+    if (test_encoder()) {
+        printf("Encoder tests passed.\n");
+    }
+
+    if (test_sink()) {
+        printf("Sink tests passed.\n");
+    }
+
+    if (test_writer()) {
+        printf("Writer tests passed.\n");
+    }
+
+    if (test_encoder_numbers()) {
+        printf("Encoder number tests passed.\n");
+    }
+
+    if (test_decoder_numbers(true)) {
+        printf("Decoder number tests passed.\n");
+    }
+
+    if (test_document(true)) {
+        printf("Document tests passed.\n");
+    }
+
+    if (test_pushparser(true)) {
+        printf("Push parser tests passed.\n");
+    }
+
+    if (test_mmap(true)) {
+        printf("Memory-mapped decoding tests passed.\n");
+    }
+
+    if (test_lines(true)) {
+        printf("JSON Lines tests passed.\n");
+    }
+
+    if (test_parallel()) {
+        printf("Parallel decoding tests passed.\n");
+    }
+
+    if (test_sax(true)) {
+        printf("SAX tests passed.\n");
+    }
+
+    if (test_cursor()) {
+        printf("Cursor tests passed.\n");
+    }
+
+    if (test_depth(true)) {
+        printf("Depth tests passed.\n");
+    }
+
+    if (test_validate()) {
+        printf("Validation tests passed.\n");
+    }
+
     return 0;
 }
@@ -1,40 +1,10 @@
 #include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
 
 #include "token.h"
 
 
-/** Construct a token and keep a copy of value in it. *end* is exclusive.
- *
- * Returns NULL when memory is low.
- */
-Token *token_construct(TokenKind kind, char *text, size_t start, size_t end) {
-    Token *token = malloc(sizeof (Token));
-    if (!token) {
-        return NULL;
-    }
-    token->value = calloc(end - start + 1, sizeof (char));
-    if (!token->value) {
-        free(token);
-        return NULL;
-    }
-    if (!strncpy(token->value, &text[start], end - start)) {
-        free(token);
-        return NULL;
-    }
-    token->kind = kind;
-    return token;
-}
-
-/** Destruct token and also destruct its value. */
-void token_destruct(Token *token) {
-    free(token->value);
-    free(token);
-}
-
-/** Print token for debugging. */
-void token_print(Token *token) {
+/** Print token for debugging, *text* being the text it was read from. */
+void token_print(const Token *token, const char *text) {
     printf("Token { kind: ");
     switch (token->kind) {
         case TOKEN_EOF:
@@ -74,5 +44,5 @@ void token_print(Token *token) {
             printf("%d", token->kind);
             break;
     }
-    printf(", value: %s }\n", token->value);
+    printf(", value: %.*s }\n", (int) token->len, &text[token->start]);
 }
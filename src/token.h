@@ -1,6 +1,8 @@
 #ifndef __JSON_TOKEN_H__
 #define __JSON_TOKEN_H__
 
+#include <stddef.h>
+
 
 /**
  * json:        element
@@ -43,23 +45,19 @@ typedef enum TokenKind {
     TOKEN_CLOSING_CURLY_BRACKET = '}'
 } TokenKind;
 
+/**
+ * A token is a plain value: its kind and where it lies in the lexer's text.
+ * The span of a string includes its quotes and is left escaped.
+ */
 typedef struct Token {
     TokenKind kind;
-    char *value;
+    size_t start;
+    size_t len;
 } Token;
 
 
-/** Construct a token and keep a copy of value in it. *end* is exclusive.
- *
- * Returns NULL when memory is low.
- */
-Token *token_construct(TokenKind kind, char *text, size_t start, size_t end);
-
-/** Destruct token and also destruct its value. */
-void token_destruct(Token *token);
-
-/** Print token for debugging. */
-void token_print(Token *token);
+/** Print token for debugging, *text* being the text it was read from. */
+void token_print(const Token *token, const char *text);
 
 
 #endif
@@ -0,0 +1,329 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "encoder.h"
+#include "json.h"
+#include "jsonerror.h"
+#include "writer.h"
+
+
+/** Record what went wrong and stop for good.
+ *
+ * Nothing is located, since the text may have gone to a sink already.
+ */
+static bool _json_writer_error(
+    JsonWriter *writer, JsonErrorCode code, const char *msg
+) {
+    if (writer->error.code == JSON_ERROR_NONE) {
+        jsonerror_set(&writer->error, code, msg, 0);
+    }
+    jsonerror_report(&writer->error);
+    return false;
+}
+
+/** Report success so far, turning errors of the encoder into the writer's.
+ */
+static bool _json_writer_ok(JsonWriter *writer) {
+    if (writer->encoder.error && writer->error.code == JSON_ERROR_NONE) {
+        return _json_writer_error(
+            writer,
+            writer->encoder.error,
+            (writer->encoder.error == JSON_ERROR_IO)
+                ? "cannot write to sink"
+                : "insufficient memory"
+        );
+    }
+    return writer->error.code == JSON_ERROR_NONE;
+}
+
+/** Write what comes before a value: a comma and a new line in an array.
+ *
+ * Return false if no value may come here.
+ */
+static bool _json_writer_before_value(JsonWriter *writer) {
+    if (!_json_writer_ok(writer)) {
+        return false;
+    }
+    if (writer->state != _JSON_WRITER_VALUE
+            && writer->state != _JSON_WRITER_MEMBER) {
+        return _json_writer_error(
+            writer, JSON_ERROR_SYNTAX, "misplaced value"
+        );
+    }
+    if (writer->state == _JSON_WRITER_VALUE && writer->depth) {
+        if (!writer->empty) {
+            encoder_putc(&writer->encoder, ',');
+        }
+        encoder_newline(&writer->encoder, writer->depth);
+        writer->empty = false;
+    }
+    return true;
+}
+
+/** Move on once a value is over, and report success. */
+static bool _json_writer_after_value(JsonWriter *writer) {
+    if (!writer->depth) {
+        writer->state = _JSON_WRITER_DONE;
+    } else if (writer->stack[writer->depth - 1] == '}') {
+        writer->state = _JSON_WRITER_KEY;
+    } else {
+        writer->state = _JSON_WRITER_VALUE;
+    }
+    return _json_writer_ok(writer);
+}
+
+static bool _json_writer_scalar(JsonWriter *writer, JsonValue *item) {
+    if (!_json_writer_before_value(writer)) {
+        return false;
+    }
+    encoder_scalar(&writer->encoder, item);
+    return _json_writer_after_value(writer);
+}
+
+/** Open a container closed by *closing*. */
+static bool _json_writer_begin(JsonWriter *writer, char closing) {
+    char *new_stack;
+    size_t new_cap;
+
+    if (!_json_writer_before_value(writer)) {
+        return false;
+    }
+    if (writer->depth == writer->cap) {
+        new_cap = writer->cap * JSON_WRITER_GROW_FACTOR;
+        new_stack = malloc(new_cap);
+        if (!new_stack) {
+            return _json_writer_error(
+                writer, JSON_ERROR_MEMORY, "insufficient memory"
+            );
+        }
+        memcpy(new_stack, writer->stack, writer->depth);
+        if (writer->stack != writer->_stack) {
+            free(writer->stack);
+        }
+        writer->stack = new_stack;
+        writer->cap = new_cap;
+    }
+    writer->stack[writer->depth++] = closing;
+    encoder_putc(&writer->encoder, (closing == ']') ? '[' : '{');
+    writer->state = (closing == ']') ? _JSON_WRITER_VALUE : _JSON_WRITER_KEY;
+    writer->empty = true;
+    return _json_writer_ok(writer);
+}
+
+/** Close the innermost container, which must be closed by *closing*. */
+static bool _json_writer_end(JsonWriter *writer, char closing) {
+    _JsonWriterState state = (closing == ']')
+        ? _JSON_WRITER_VALUE
+        : _JSON_WRITER_KEY;
+
+    if (!_json_writer_ok(writer)) {
+        return false;
+    }
+    if (!writer->depth || writer->stack[writer->depth - 1] != closing
+            || writer->state != state) {
+        return _json_writer_error(
+            writer,
+            JSON_ERROR_SYNTAX,
+            (closing == ']') ? "misplaced end of array"
+                : "misplaced end of object"
+        );
+    }
+    writer->depth--;
+    encoder_newline(&writer->encoder, writer->depth);
+    encoder_putc(&writer->encoder, closing);
+    // The enclosing container has this one in it.
+    writer->empty = false;
+    return _json_writer_after_value(writer);
+}
+
+
+/** Construct a writer into a buffer of its own, or into *sink* unless it
+ * is NULL, as JSON_ENCODE_* *flags* say.
+ */
+static JsonWriter *_json_writer_construct(
+    const JsonSink *sink, unsigned int flags
+) {
+    JsonWriter *writer = malloc(sizeof (JsonWriter));
+    JsonError error;
+
+    if (!writer) {
+        jsonerror_set(&error, JSON_ERROR_MEMORY, "insufficient memory", 0);
+        jsonerror_report(&error);
+        return NULL;
+    }
+    if (sink) {
+        writer->sink = *sink;
+        // Strings only last for the call that writes them: copy them all.
+        encoder_init_sink(&writer->encoder, &writer->sink, flags, false);
+    } else {
+        encoder_init(&writer->encoder, flags);
+    }
+    writer->state = _JSON_WRITER_VALUE;
+    writer->error.code = JSON_ERROR_NONE;
+    writer->stack = writer->_stack;
+    writer->depth = 0;
+    writer->cap = JSON_WRITER_INITIAL_DEPTH;
+    writer->empty = true;
+    return writer;
+}
+
+/** Construct a writer into a buffer of its own, as JSON_ENCODE_* *flags*
+ * say, or return NULL.
+ */
+JsonWriter *json_writer_construct(unsigned int flags) {
+    return _json_writer_construct(NULL, flags);
+}
+
+/** Construct a writer into *sink*, as JSON_ENCODE_* *flags* say, or return
+ * NULL.
+ */
+JsonWriter *json_writer_construct_sink(JsonSink sink, unsigned int flags) {
+    return _json_writer_construct(&sink, flags);
+}
+
+/** Destruct the writer, and whatever text it still holds. */
+void json_writer_destruct(JsonWriter *writer) {
+    if (writer->stack != writer->_stack) {
+        free(writer->stack);
+    }
+    if (writer->encoder.sink) {
+        encoder_release(&writer->encoder);
+    } else {
+        free(writer->encoder.buf);
+    }
+    free(writer);
+}
+
+bool json_writer_begin_object(JsonWriter *writer) {
+    return _json_writer_begin(writer, '}');
+}
+
+bool json_writer_end_object(JsonWriter *writer) {
+    return _json_writer_end(writer, '}');
+}
+
+bool json_writer_begin_array(JsonWriter *writer) {
+    return _json_writer_begin(writer, ']');
+}
+
+bool json_writer_end_array(JsonWriter *writer) {
+    return _json_writer_end(writer, ']');
+}
+
+/** Write the key of the next member of the innermost object. */
+bool json_writer_key(JsonWriter *writer, const char *key) {
+    bool pretty = writer->encoder.flags & JSON_ENCODE_PRETTY;
+
+    if (!_json_writer_ok(writer)) {
+        return false;
+    }
+    if (writer->state != _JSON_WRITER_KEY) {
+        return _json_writer_error(writer, JSON_ERROR_SYNTAX, "misplaced key");
+    }
+    if (!writer->empty) {
+        encoder_putc(&writer->encoder, ',');
+    }
+    encoder_newline(&writer->encoder, writer->depth);
+    encoder_string(&writer->encoder, key);
+    encoder_putc(&writer->encoder, ':');
+    if (pretty) {
+        encoder_putc(&writer->encoder, ' ');
+    }
+    writer->empty = false;
+    writer->state = _JSON_WRITER_MEMBER;
+    return _json_writer_ok(writer);
+}
+
+bool json_writer_null(JsonWriter *writer) {
+    JsonValue item = { .type = JSON_NULL };
+
+    return _json_writer_scalar(writer, &item);
+}
+
+bool json_writer_bool(JsonWriter *writer, bool value) {
+    JsonValue item = { .type = JSON_BOOL, .value.as_bool = value };
+
+    return _json_writer_scalar(writer, &item);
+}
+
+/** Write *value* as its shortest round-trip digits, or null if it is not
+ * finite.
+ */
+bool json_writer_double(JsonWriter *writer, double value) {
+    JsonValue item = { .type = JSON_NUMBER, .value.as_num = value };
+
+    return _json_writer_scalar(writer, &item);
+}
+
+bool json_writer_int64(JsonWriter *writer, int64_t value) {
+    JsonValue item = { .type = JSON_INTEGER, .value.as_int = value };
+
+    return _json_writer_scalar(writer, &item);
+}
+
+bool json_writer_uint64(JsonWriter *writer, uint64_t value) {
+    JsonValue item = { .type = JSON_UNSIGNED, .value.as_uint = value };
+
+    return _json_writer_scalar(writer, &item);
+}
+
+/** Write the UTF-8 string *str*, escaped. */
+bool json_writer_string(JsonWriter *writer, const char *str) {
+    JsonValue item = { .type = JSON_STRING, .value.as_str = (char *) str };
+
+    return _json_writer_scalar(writer, &item);
+}
+
+/** Hand what the writer holds to its sink, and report whether the sink took
+ * all of it.
+ */
+bool json_writer_flush(JsonWriter *writer) {
+    return encoder_flush(&writer->encoder) && _json_writer_ok(writer);
+}
+
+/** Check that the document is complete, and hand the rest of it to the
+ * sink, if any.
+ *
+ * Return false if the document is incomplete, something failed, or the sink
+ * did not take all of the text. A sink that is full still holds back part
+ * of it: json_writer_flush() is to be called again once it can take more,
+ * until it returns true.
+ */
+bool json_writer_finish(JsonWriter *writer) {
+    if (!_json_writer_ok(writer)) {
+        return false;
+    }
+    if (writer->state != _JSON_WRITER_DONE) {
+        return _json_writer_error(
+            writer, JSON_ERROR_EOF, "incomplete document"
+        );
+    }
+    return encoder_flush(&writer->encoder) && _json_writer_ok(writer);
+}
+
+/** The text written so far into the buffer of the writer, terminated, and
+ * its length in *len* unless it is NULL.
+ *
+ * It belongs to the writer, and is valid until the next call. Return NULL
+ * for a writer into a sink, or when memory is low.
+ */
+const char *json_writer_text(JsonWriter *writer, size_t *len) {
+    Encoder *encoder = &writer->encoder;
+
+    if (encoder->sink) {
+        return NULL;
+    }
+    // The terminator is not part of the text, so it is overwritten later.
+    encoder_putc(encoder, 0);
+    if (!_json_writer_ok(writer)) {
+        return NULL;
+    }
+    encoder->len--;
+    if (len) {
+        *len = encoder->len;
+    }
+    return encoder->buf;
+}
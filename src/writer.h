@@ -0,0 +1,50 @@
+#ifndef __JSON_WRITER_H__
+#define __JSON_WRITER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "encoder.h"
+#include "json.h"
+
+
+#define JSON_WRITER_INITIAL_DEPTH   32
+#define JSON_WRITER_GROW_FACTOR     2
+
+
+/** What the writer accepts next. */
+typedef enum _JsonWriterState {
+    // A value, at the top or in an array, or the end of the array.
+    _JSON_WRITER_VALUE,
+    // A key or the end of the object.
+    _JSON_WRITER_KEY,
+    // The value of the key just written.
+    _JSON_WRITER_MEMBER,
+    // Nothing: the document is complete.
+    _JSON_WRITER_DONE
+} _JsonWriterState;
+
+/**
+ * A writer that encodes a document call by call, without a tree, straight
+ * into the buffer of an Encoder.
+ *
+ * It only keeps the closing bracket of each open container, to check that
+ * calls come in an order that makes valid JSON.
+ */
+struct JsonWriter {
+    Encoder encoder;
+    JsonSink sink;
+    _JsonWriterState state;
+    // Why the writer failed, which sticks.
+    JsonError error;
+    // ']' or '}' for each open container, innermost last.
+    char *stack;
+    size_t depth;
+    size_t cap;
+    // Whether the innermost container has nothing in it yet.
+    bool empty;
+    char _stack[JSON_WRITER_INITIAL_DEPTH];
+};
+
+
+#endif